@@ -88,20 +88,20 @@ static void draw_floppy_leds(uint_fast8_t leds)
 
 /* ------------------------------------------------------------------ */
 
-static void insert_or_eject_floppy(int drive)
+static void insert_or_eject_floppy(ARMul_State *state, int drive)
 {
     static bool got_disc[4];
     static char image[] = "FloppyImage#";
     const char *err;
 
     if (got_disc[drive]) {
-        err = FDC_EjectFloppy(drive);
+        err = FDC_EjectFloppy(state, drive);
         warn_fdc("ejecting drive %d: %s\n", drive,
             err ? err : "ok");
         got_disc[drive] = err ? true : false;
     } else {
         image[sizeof image - 2] = '0' + drive;
-        err = FDC_InsertFloppy(drive, image);
+        err = FDC_InsertFloppy(state, drive, image);
         warn_fdc("inserting floppy image %s into drive %d: %s\n",
             image, drive, err ? err : "ok");
         got_disc[drive] = err ? false : true;
@@ -159,7 +159,7 @@ static void ControlPane_Redraw(ARMul_State *state) {
 
   y+=2;
   draw_keyboard_leds(KBD.Leds);
-  FDC_UpdateLEDs();
+  FDC_UpdateLEDs(state);
 } /* ControlPane_Redraw */
 
 
@@ -173,7 +173,7 @@ void ControlPane_Event(ARMul_State *state, XEvent *event) {
       XLookupString(&event->xkey, NULL, 0, &sym, NULL);
 
       if (sym >= XK_0 && sym <= XK_3) {
-        insert_or_eject_floppy(sym - XK_0);
+        insert_or_eject_floppy(state, sym - XK_0);
 
       } else if (sym == XK_q) {
         warn("arcem: user requested exit\n");
@@ -241,10 +241,10 @@ bool ControlPane_Init(ARMul_State *state) {
 
   /* setup callbacks for each time various LEDs change */
   KBD.leds_changed = draw_keyboard_leds;
-  FDC_SetLEDsChangeFunc(draw_floppy_leds);
+  FDC_SetLEDsChangeFunc(state, draw_floppy_leds);
 
   for (drive = 0; drive < 4; drive++) {
-    insert_or_eject_floppy(drive);
+    insert_or_eject_floppy(state, drive);
   }
   return true;
 } /* ControlPane_Init */
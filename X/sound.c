@@ -41,10 +41,11 @@ static const int32_t sound_buff_mask=BUFFER_SAMPLES-1;
 SoundData sound_buffer[256*2]; /* Must be >= 2*Sound_BatchSize! */
 #endif
 
-SoundData *Sound_GetHostBuffer(int32_t *destavail)
+SoundData *Sound_GetHostBuffer(ARMul_State *state,int32_t *destavail)
 {
 #ifdef SOUND_THREAD
   int32_t local_buffer_in,used,ofs,buffree;
+  UNUSED_VAR(state);
   /* Work out how much space is available until next wrap point, or we start overwriting data */
   pthread_mutex_lock(&mut);
   local_buffer_in = sound_buffer_in;
@@ -55,16 +56,18 @@ SoundData *Sound_GetHostBuffer(int32_t *destavail)
   *destavail = buffree>>1;
   return sound_buffer + ofs;
 #else
+  UNUSED_VAR(state);
   /* Just assume we always have enough space for the max batch size */
   *destavail = sizeof(sound_buffer)/(sizeof(SoundData)*2);
   return sound_buffer;
 #endif
 }
 
-void Sound_HostBuffered(SoundData *buffer,int32_t numSamples)
+void Sound_HostBuffered(ARMul_State *state,SoundData *buffer,int32_t numSamples)
 {
 #ifdef SOUND_THREAD
   int32_t local_buffer_in,used,ofs;
+  UNUSED_VAR(state);
   UNUSED_VAR(buffer);
   numSamples <<= 1;
   pthread_mutex_lock(&mut);
@@ -122,11 +125,11 @@ void Sound_HostBuffered(SoundData *buffer,int32_t numSamples)
     int32_t bufsize = buf.fragsize*buf.fragstotal;
     int32_t buffree = buf.bytes/sizeof(SoundData);
     int32_t used = (bufsize-buf.bytes)/sizeof(SoundData);
-    int32_t stepsize = Sound_DMARate>>2;
+    int32_t stepsize = Sound_GetDMARate(state)>>2;
     bufsize /= sizeof(SoundData);
     if(numSamples > buffree)
     {
-      warn_sound("*** sound overflow! %d %d %d %d ***\n",numSamples-buffree,ARMul_EmuRate,Sound_FudgeRate,Sound_DMARate);
+      warn_sound("*** sound overflow! %d %d %d %d ***\n",numSamples-buffree,ARMul_EmuRate,Sound_FudgeRate,Sound_GetDMARate(state));
       numSamples = buffree; /* We could block until space is available, but I'm woried we'd get stuck blocking forever because the FudgeRate increase wouldn't compensate for the ARMul cycles lost due to blocking */
       if(Sound_FudgeRate < -stepsize)
         Sound_FudgeRate = Sound_FudgeRate/2;
@@ -135,7 +138,7 @@ void Sound_HostBuffered(SoundData *buffer,int32_t numSamples)
     }
     else if(!used)
     {
-      warn_sound("*** sound underflow! %d %d %d ***\n",ARMul_EmuRate,Sound_FudgeRate,Sound_DMARate);
+      warn_sound("*** sound underflow! %d %d %d ***\n",ARMul_EmuRate,Sound_FudgeRate,Sound_GetDMARate(state));
       if(Sound_FudgeRate > stepsize)
         Sound_FudgeRate = Sound_FudgeRate/2;
       else
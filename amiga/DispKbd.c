@@ -939,7 +939,7 @@ Kbd_PollHostKbd(ARMul_State *state)
 	}
 
 	#ifdef __amigaos4__
-	ARexx_Handle();
+	ARexx_Handle(state);
 	
 	if(arexx_quit)
 		cleanup();
@@ -1027,6 +1027,10 @@ DisplayDev_Init(ARMul_State *state)
 									ASLFR_DoPatterns,TRUE,
 									TAG_DONE);
 
+	/* Settings from the tooltypes */
+	MEMC.FrameSkip = frameskip;
+	MEMC.AutoUpdateFlags = autoupdateflags;
+
 #if 0
 	return DisplayDev_Set(state,&SDD_DisplayDev);
 #else
@@ -15,6 +15,9 @@ struct ARexxIFace *IARexx;
 Object *arexx_obj = NULL;
 BOOL arexx_quit = FALSE;
 
+/* Machine that incoming commands act on, valid during ARexx_Handle */
+static ARMul_State *arexx_state = NULL;
+
 enum
 {
 	RX_QUIT=0,
@@ -55,8 +58,9 @@ void ARexx_Init()
 
 }
 
-void ARexx_Handle()
+void ARexx_Handle(ARMul_State *state)
 {
+	arexx_state = state;
 	RA_HandleRexx(arexx_obj);
 }
 
@@ -88,11 +92,11 @@ STATIC VOID rx_floppy(struct ARexxCmd *cmd, struct RexxMsg *rxm)
 	UNUSED_VAR(rxm);
 
 	drv = *(long *)cmd->ac_ArgList[0];
-	FDC_EjectFloppy(drv);
+	FDC_EjectFloppy(arexx_state,drv);
 
 	if(cmd->ac_ArgList[1])
 	{
-		err = FDC_InsertFloppy(drv,(char *)cmd->ac_ArgList[1]);
+		err = FDC_InsertFloppy(arexx_state,drv,(char *)cmd->ac_ArgList[1]);
 
 		if(err)
 		{
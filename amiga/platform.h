@@ -25,4 +25,6 @@ extern int force8bit;
 extern int swapmousebuttons;
 extern BOOL anymonitor;
 extern BOOL use_ocm;
+extern int frameskip;
+extern BOOL autoupdateflags;
 #endif
@@ -37,15 +37,17 @@ static bool openaudio(void)
 	return true;
 }
 
-SoundData *Sound_GetHostBuffer(int32_t *destavail)
+SoundData *Sound_GetHostBuffer(ARMul_State *state,int32_t *destavail)
 {
+	UNUSED_VAR(state);
 	/* Just assume we always have enough space for the max batch size */
 	*destavail = sizeof(sound_buffer)/(sizeof(SoundData)*2);
 	return sound_buffer;
 }
 
-void Sound_HostBuffered(SoundData *buffer,int32_t numSamples)
+void Sound_HostBuffered(ARMul_State *state,SoundData *buffer,int32_t numSamples)
 {
+	UNUSED_VAR(state);
 	numSamples *= 2;
 
 	/* TODO - Adjust Sound_FudgeRate to fine-tune how often we receive new data */
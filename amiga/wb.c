@@ -25,6 +25,8 @@ int force8bit;
 int swapmousebuttons;
 BOOL anymonitor;
 BOOL use_ocm;
+int frameskip;
+BOOL autoupdateflags;
 
 struct Library *IconBase;
 #ifdef __amigaos4__
@@ -63,6 +65,8 @@ static void gettooltypes(struct WBArg *wbarg, ArcemConfig *pConfig)
 	swapmousebuttons = 0;
 	anymonitor = FALSE;
 	use_ocm = FALSE;
+	frameskip = 0;
+	autoupdateflags = FALSE;
 
 	if((*wbarg->wa_Name) && (dobj=GetDiskObject(wbarg->wa_Name)))
 	{
@@ -158,15 +162,13 @@ static void gettooltypes(struct WBArg *wbarg, ArcemConfig *pConfig)
 		if(FindToolType(toolarray,"ANYMONITOR")) anymonitor = TRUE;
 		if(FindToolType(toolarray,"ENABLEOCM")) use_ocm = TRUE;
 
-		if(FindToolType(toolarray, "USEUPDATEFLAGS"))
-			DisplayDev_UseUpdateFlags = 1;
+		/* USEUPDATEFLAGS is the default */
 
 		if((s = (char *)FindToolType(toolarray, "FRAMESKIP")))
-			DisplayDev_FrameSkip = atoi(s);
-		else DisplayDev_FrameSkip = 0;
+			frameskip = atoi(s);
 
 		if(FindToolType(toolarray, "AUTOUPDATEFLAGS"))
-			DisplayDev_AutoUpdateFlags = 1;
+			autoupdateflags = TRUE;
 
 		if(FindToolType(toolarray, "NOCONSOLEOUTPUT"))
 		{
@@ -34,6 +34,7 @@ void wblaunch(struct WBStartup *, ArcemConfig *pConfig);
 static char *arcemconfig_StringDuplicate(const char *sInput);
 static void arcemconfig_StringReplace(char** sPtr, const char* sNew);
 static bool arcemconfig_StringToEnum(unsigned int* uPtr, const char* sInput, const ArcemConfig_Label *labels);
+static bool arcemconfig_StringToMHz(uint32_t *uPtr, const char *sInput);
 
 static const ArcemConfig_Label memsize_labels[] = {
     { "256K", MemSize_256K },
@@ -54,6 +55,17 @@ static const ArcemConfig_Label processor_labels[] = {
     { NULL, 0 }
 };
 
+#if defined(ARMUL_BLOCK_CACHE)
+static const ArcemConfig_Label engine_labels[] = {
+    { "interp", CPUEngine_Interpreter },
+    { "blocks", CPUEngine_Blocks },
+#if defined(ARMUL_NATIVE_X64)
+    { "native", CPUEngine_Native },
+#endif
+    { NULL, 0 }
+};
+#endif
+
 /** 
  * ArcemConfig_SetupDefaults
  *
@@ -70,6 +82,18 @@ ArcemConfig_Result ArcemConfig_SetupDefaults(ArcemConfig *pConfig)
 
   /* We default to an ARM 2AS architecture (includes SWP) without a cache */
   pConfig->eProcessor = Processor_ARM250;
+  /* Floating point is left to the FPEmulator module unless asked for */
+  pConfig->bFPA = false;
+  /* Measure EmuRate and run as fast as the host allows */
+  pConfig->uEmuRate = 0;
+  pConfig->uPaceRate = 0;
+
+#if defined(ARMUL_BLOCK_CACHE)
+  /* Use the block cache unless told otherwise */
+  pConfig->eCPUEngine = CPUEngine_Blocks;
+  /* Idle loops run at full length by default, so guest time tracks the host */
+  pConfig->bIdleSkip = false;
+#endif
 
   pConfig->sRomImageName = arcemconfig_StringDuplicate("ROM");
   /* If we've run out of memory this early, something is very wrong */
@@ -188,6 +212,29 @@ static int ArcemConfig_Handler(void* user, const char* section,
                 warn("Unrecognised value for %s: %s\n", name, value);
                 return 0;
             }
+        } else if (0 == strcmp(name, "fpa")) {
+            pConfig->bFPA = (atoi(value) != 0);
+        } else if (0 == strcmp(name, "emurate")) {
+            if (!arcemconfig_StringToMHz(&pConfig->uEmuRate, value)) {
+                warn("Unrecognised value for %s: %s\n", name, value);
+                return 0;
+            }
+        } else if (0 == strcmp(name, "pace")) {
+            if (!arcemconfig_StringToMHz(&pConfig->uPaceRate, value)) {
+                warn("Unrecognised value for %s: %s\n", name, value);
+                return 0;
+            }
+#if defined(ARMUL_BLOCK_CACHE)
+        } else if (0 == strcmp(name, "engine")) {
+            if (arcemconfig_StringToEnum(&uValue, value, engine_labels)) {
+                pConfig->eCPUEngine = uValue;
+            } else {
+                warn("Unrecognised value for %s: %s\n", name, value);
+                return 0;
+            }
+        } else if (0 == strcmp(name, "idleskip")) {
+            pConfig->bIdleSkip = (atoi(value) != 0);
+#endif
         } else {
             warn("Unknown section/name: %s, %s, %s\n", section, name, value);
             return 0;
@@ -293,6 +340,21 @@ ArcemConfig_Result ArcemConfig_ParseCommandLine(ArcemConfig *pConfig, int argc,
     "     '8M', '12M' or '16M'\n"
     "  --processor <value> - Set the emulated CPU\n"
     "     Where value is one of 'ARM2', 'ARM250', 'ARM3'\n"
+    "  --fpa - Attach an FPA floating point coprocessor\n"
+    "  --emurate <MHz> - Use a fixed emulated CPU clock speed for IOC, sound and\n"
+    "     video timing, instead of measuring the host. Makes timing reproducible\n"
+    "  --pace <MHz> - Throttle the emulated CPU to the given clock speed,\n"
+    "     e.g. '8' for an ARM2 or '25' for an ARM3. '0' runs flat out\n"
+#if defined(ARMUL_BLOCK_CACHE)
+    "  --engine <value> - Select the CPU emulation engine\n"
+#if defined(ARMUL_NATIVE_X64)
+    "     Where value is one of 'interp', 'blocks', 'native'\n"
+#else
+    "     Where value is one of 'interp', 'blocks'\n"
+#endif
+    "  --idleskip - Skip ahead to the next event when the CPU is in an idle loop,\n"
+    "     sleeping the host for the time skipped\n"
+#endif /* ARMUL_BLOCK_CACHE */
     "  --noaspect - Disable aspect ratio correction\n"
     "  --noupscale - Disable upscaling\n"
 #if defined(SYSTEM_riscos_single) || defined(SYSTEM_win)
@@ -420,7 +482,61 @@ ArcemConfig_Result ArcemConfig_ParseCommandLine(ArcemConfig *pConfig, int argc,
         ControlPane_Error(false,"No argument following the --processor option");
         return Result_Failure;
       }
-    } else if(0 == strcmp("--noaspect",argv[iArgument])) {
+    }
+    else if(0 == strcmp("--fpa",argv[iArgument])) {
+      pConfig->bFPA = true;
+      iArgument += 1;
+    }
+    else if(0 == strcmp("--emurate", argv[iArgument])) {
+      if(iArgument+1 < argc) { /* Is there a following argument? */
+        if (arcemconfig_StringToMHz(&pConfig->uEmuRate, argv[iArgument + 1])) {
+          iArgument += 2;
+        } else {
+          ControlPane_Error(false,"Unrecognised value '%s' to the --emurate option", argv[iArgument + 1]);
+          return Result_Failure;
+        }
+      } else {
+        /* No argument following the --emurate option */
+        ControlPane_Error(false,"No argument following the --emurate option");
+        return Result_Failure;
+      }
+    }
+    else if(0 == strcmp("--pace", argv[iArgument])) {
+      if(iArgument+1 < argc) { /* Is there a following argument? */
+        if (arcemconfig_StringToMHz(&pConfig->uPaceRate, argv[iArgument + 1])) {
+          iArgument += 2;
+        } else {
+          ControlPane_Error(false,"Unrecognised value '%s' to the --pace option", argv[iArgument + 1]);
+          return Result_Failure;
+        }
+      } else {
+        /* No argument following the --pace option */
+        ControlPane_Error(false,"No argument following the --pace option");
+        return Result_Failure;
+      }
+    }
+#if defined(ARMUL_BLOCK_CACHE)
+    else if(0 == strcmp("--engine", argv[iArgument])) {
+      if(iArgument+1 < argc) { /* Is there a following argument? */
+        if (arcemconfig_StringToEnum(&uValue, argv[iArgument + 1], engine_labels)) {
+          pConfig->eCPUEngine = uValue;
+          iArgument += 2;
+        } else {
+          ControlPane_Error(false,"Unrecognised value '%s' to the --engine option", argv[iArgument + 1]);
+          return Result_Failure;
+        }
+      } else {
+        /* No argument following the --engine option */
+        ControlPane_Error(false,"No argument following the --engine option");
+        return Result_Failure;
+      }
+    }
+    else if(0 == strcmp("--idleskip",argv[iArgument])) {
+      pConfig->bIdleSkip = true;
+      iArgument += 1;
+    }
+#endif /* ARMUL_BLOCK_CACHE */
+    else if(0 == strcmp("--noaspect",argv[iArgument])) {
       pConfig->bAspectRatioCorrection = false;
       iArgument += 1;
     } else if(0 == strcmp("--noupscale",argv[iArgument])) {
@@ -542,3 +658,24 @@ static bool arcemconfig_StringToEnum(unsigned int *uPtr, const char *sInput, con
     }
     return false;
 }
+
+/**
+ * arcemconfig_StringToMHz
+ *
+ * Convert a clock speed in MHz (e.g. "8" or "12.5") to Hz.
+ *
+ * @param uPtr Where to store the result
+ * @param sInput String to convert
+ * @returns false if the string isn't a valid speed
+ */
+static bool arcemconfig_StringToMHz(uint32_t *uPtr, const char *sInput) {
+    char *sEnd;
+    double dMHz = strtod(sInput, &sEnd);
+
+    /* Allow 0 (off), or 1MHz upwards, matching the EmuRate_Update clamp */
+    if ((sEnd == sInput) || (*sEnd != 0) || !((dMHz == 0) || (dMHz >= 1)) || (dMHz > 1000)) {
+        return false;
+    }
+    *uPtr = (uint32_t) (dMHz*1000000 + 0.5);
+    return true;
+}
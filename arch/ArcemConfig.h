@@ -63,6 +63,14 @@ typedef enum ArcemConfig_Processor_e {
   Processor_ARM3                  /* ARM 2AS */
 } ArcemConfig_Processor;
 
+#if defined(ARMUL_BLOCK_CACHE)
+typedef enum ArcemConfig_CPUEngine_e {
+  CPUEngine_Interpreter,          /* Decode cache only */
+  CPUEngine_Blocks,               /* Decode cache + block cache */
+  CPUEngine_Native                /* Block cache + blocks translated to x86-64 code (ARMUL_NATIVE_X64 builds only) */
+} ArcemConfig_CPUEngine;
+#endif
+
 typedef enum ArcemConfig_DisplayDriver_e {
   DisplayDriver_Palettised,
   DisplayDriver_Standard /* i.e. 16/32bpp true colour */
@@ -78,6 +86,13 @@ typedef struct ArcemConfig_Label_s {
 struct ArcemConfig_s {
   ArcemConfig_MemSize   eMemSize;
   ArcemConfig_Processor eProcessor; 
+  bool bFPA; /* Attach an FPA floating point coprocessor */
+  uint32_t uEmuRate; /* Fixed number of cycles per emulated second, 0 to measure from the host */
+  uint32_t uPaceRate; /* Throttle to this many cycles per second of host time, 0 to run flat out */
+#if defined(ARMUL_BLOCK_CACHE)
+  ArcemConfig_CPUEngine eCPUEngine;
+  bool bIdleSkip; /* Fast-forward through idle loops, sleeping the host instead (blocks and native engines only) */
+#endif
 
   char *sRomImageName;
 
@@ -19,6 +19,7 @@ struct IOCStruct {
 
   CycleCount TimersLastUpdated;
   CycleCount NextTimerTrigger;
+  EventQ_Handle TimerEvent; /* Event used to update the timers */
   uint_least16_t TimerFracBit;
   bool Timer0CanInt;
   bool Timer1CanInt;
@@ -27,7 +28,7 @@ struct IOCStruct {
   uint32_t InvIOCRate; /* Inverse IOC rate, 16.16 */
 };
 
-extern struct IOCStruct ioc;
+#define IOC (*(state->Ioc))
 
 
 #define IRQA_VFLYBK (1U << 3)   /* Start of display vertical flyback */
@@ -67,9 +68,15 @@ void IOC_DoIntCheck(ARMul_State *state);
 /*-----------------------------------------------------------------------------*/
 bool IO_Init(ARMul_State *state);
 
+/*-----------------------------------------------------------------------------*/
+void IO_Exit(ARMul_State *state);
+
 /*-----------------------------------------------------------------------------*/
 ARMword GetWord_IO(ARMul_State *state, ARMword address);
 
+/*-----------------------------------------------------------------------------*/
+bool IO_ReadIsSideEffectFree(ARMword address);
+
 /*-----------------------------------------------------------------------------*/
 void PutValIO(ARMul_State *state,ARMword address, ARMword data,bool bNw);
 
@@ -79,6 +86,7 @@ int IOC_WriteKbdRx(ARMul_State *state, uint_least8_t value);
 int IOC_ReadKbdTx(ARMul_State *state);
 
 void UpdateTimerRegisters(ARMul_State *state);
+void IO_UpdateEmuRate(ARMul_State *state);
 void IO_UpdateNfiq(ARMul_State *state);
 void IO_UpdateNirq(ARMul_State *state);
 
@@ -12,6 +12,7 @@
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #if defined(__riscos__) && defined(__TARGET_UNIXLIB__)
 #include <unixlib/local.h>
 #endif
@@ -39,19 +40,240 @@
 extern char arcemDir[256];
 #endif
 
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 
-struct MEMCStruct memc;
 
 /*-----------------------------------------------------------------------------*/
 
-static ARMword ARMul_ManglePhysAddr(ARMword phy);
+static ARMword ARMul_ManglePhysAddr(ARMul_State *state,ARMword phy);
+
+/*------------------------------------------------------------------------------*/
+/* Allocation of the large zero-filled blocks backing guest memory. On Linux
+   these are anonymous mappings: pages are only committed once touched, so
+   unused RAM (and its decode cache) costs nothing, and huge pages are used
+   where the host offers them to cut down on TLB misses. Only the first
+   hugelen bytes (the RAM, or its part of the decode cache) use huge pages;
+   the rest is kept to normal pages so that the ROM image and the shared ROM
+   handler cache can be mapped over it. *size is updated to the amount
+   actually allocated, which must be passed to ARMul_ChunkFree. */
+static void *ARMul_ChunkAlloc(size_t *size,size_t hugelen)
+{
+#ifdef __linux__
+  uint8_t *ptr;
+#ifdef MAP_HUGETLB
+  /* Explicit huge pages, if any have been reserved. A hugetlb mapping can
+     only be replaced in 2MB units, so reserve the chunk with normal pages
+     (2MB aligned) and then switch over the start of it */
+  const size_t hugesize = 2*1024*1024;
+  size_t hugetlblen = hugelen & ~(hugesize-1);
+  if (hugetlblen) {
+    size_t len = (*size+4095) & ~((size_t) 4095);
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_FIXED;
+    uint8_t *base = mmap(NULL,len+hugesize,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS,-1,0);
+    if (base == MAP_FAILED)
+      return NULL;
+    ptr = (uint8_t *) ((((uintptr_t) base)+hugesize-1) & ~((uintptr_t) (hugesize-1)));
+    if (ptr != base)
+      munmap(base,ptr-base);
+    munmap(ptr+len,(base+len+hugesize)-(ptr+len));
+    *size = len;
+#ifdef MAP_HUGE_2MB
+    flags |= MAP_HUGE_2MB;
+#endif
+    if (mmap(ptr,hugetlblen,PROT_READ | PROT_WRITE,flags,-1,0) != MAP_FAILED)
+      return ptr;
+    /* No huge pages available. Make sure the range is still mapped */
+    if (mmap(ptr,hugetlblen,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,-1,0) == MAP_FAILED) {
+      munmap(ptr,len);
+      return NULL;
+    }
+  } else
+#endif
+  {
+    ptr = mmap(NULL,*size,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS,-1,0);
+    if (ptr == MAP_FAILED)
+      return NULL;
+  }
+#ifdef MADV_HUGEPAGE
+  /* Otherwise ask for transparent huge pages */
+  if (hugelen)
+    madvise(ptr,hugelen,MADV_HUGEPAGE);
+#endif
+  return ptr;
+#else
+  UNUSED_VAR(hugelen);
+  return calloc(1,*size);
+#endif
+}
+
+static void ARMul_ChunkFree(void *ptr,size_t size)
+{
+#ifdef __linux__
+  if (ptr)
+    munmap(ptr,size);
+#else
+  UNUSED_VAR(size);
+  free(ptr);
+#endif
+}
+
+#ifdef __linux__
+/* Map the ROM image file over the ROM area of ROMRAMChunk. The mapping is
+   read-only and backed by the page cache, so every instance using the same
+   image shares one copy. Returns false if the caller needs to read it in. */
+static bool ARMul_MapROMFile(ARMul_State *state,FILE *ROMFile)
+{
+#ifdef HOST_BIGENDIAN
+  /* Needs byte swapping on load */
+  UNUSED_VAR(ROMFile);
+  return false;
+#else
+  void *ptr;
+  if(((FastMapUInt)MEMC.ROMHigh) & 4095)
+    return false;
+  ptr = mmap(MEMC.ROMHigh,MEMC.ROMHighSize,PROT_READ,MAP_PRIVATE | MAP_FIXED,fileno(ROMFile),0);
+  if(ptr != MAP_FAILED)
+    return true;
+  warn("Couldn't map ROM image, reading it in instead (%s)\n",strerror(errno));
+  /* Make sure there's still memory there to read into */
+  ptr = mmap(MEMC.ROMHigh,MEMC.ROMHighSize,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,-1,0);
+  if(ptr == MAP_FAILED)
+    ControlPane_Error(true,"Couldn't remap ROM area (%s)",strerror(errno));
+  return false;
+#endif
+}
+
+#ifdef ARMUL_INSTR_FUNC_INDEX
+/* Check that a handler cache file, or the directory it lives in, belongs to
+   us and can't be modified by anybody else */
+static bool ARMul_SharedROMFuncsPrivate(const struct stat *st)
+{
+  return (st->st_uid == geteuid()) && !(st->st_mode & (S_IWGRP | S_IWOTH));
+}
+
+/* The entries of a handler cache index ARMul_EmuFuncTable, so check they're
+   all in range */
+static bool ARMul_SharedROMFuncsValid(const ARMEmuFuncCache *funcs,size_t count)
+{
+  while(count--)
+    if(*funcs++ >= ARMUL_EMUFUNC_TABLE_SIZE)
+      return false;
+  return true;
+}
+
+/* Header page at the start of a shared handler cache file, before the
+   entries */
+typedef struct {
+  uint32_t TableHash;     /* ARMul_EmuFuncTable_Hash() of the build that wrote it */
+  uint32_t ROMSize;
+  uint64_t ROMHash;
+} ARMul_SharedROMFuncsHeader;
+
+/* Share the handler cache for ROMHigh & ROMLow (which are never written to)
+   between instances via a file in the user's $XDG_RUNTIME_DIR, named after
+   the ROM contents and the build's handler index assignment. The first
+   instance to run a given ROM decodes it up front and creates the file. The
+   rest only map it once they've checked that it's private to the user, that
+   its header matches the name, and that every entry is a valid index into
+   ARMul_EmuFuncTable. Instances which don't share it decode the ROM lazily,
+   like RAM. */
+static void ARMul_MapSharedROMFuncs(ARMul_State *state,ARMword romsize)
+{
+  ARMEmuFuncCache *funcs = FastMap_Phy2Func(state,MEMC.ROMHigh);
+  size_t len = ((romsize>>2)*sizeof(ARMEmuFuncCache)) & ~4095;
+  const uint8_t *rom = (const uint8_t *) MEMC.ROMHigh;
+  const char *dir = getenv("XDG_RUNTIME_DIR");
+  ARMul_SharedROMFuncsHeader header, fileheader;
+  char name[256], tmpname[280];
+  struct stat st;
+  size_t i;
+  int fd;
+
+  if(!len || (((FastMapUInt)funcs) & 4095))
+    return;
+
+  /* No per-user directory, no sharing */
+  if(!dir || (dir[0] != '/'))
+    return;
+  if(stat(dir,&st) || !S_ISDIR(st.st_mode) || !ARMul_SharedROMFuncsPrivate(&st)) {
+    warn("Not sharing ROM handler cache: %s isn't a private directory\n",dir);
+    return;
+  }
+
+  memset(&header,0,sizeof(header));
+  header.TableHash = ARMul_EmuFuncTable_Hash();
+  header.ROMSize = romsize;
+  header.ROMHash = 14695981039346656037u;
+  for(i=0;i<romsize;i++)
+    header.ROMHash = (header.ROMHash ^ rom[i]) * 1099511628211u;
+  if(snprintf(name,sizeof(name),"%s/arcem-romfuncs-%08"PRIx32"-%016"PRIx64"-%"PRIx32,dir,header.TableHash,header.ROMHash,romsize) >= (int) sizeof(name))
+    return;
+
+  fd = open(name,O_RDONLY | O_NOFOLLOW);
+  if((fd < 0) && (errno == ENOENT)) {
+    /* Publish our decode, renaming it into place so nobody sees a partial
+       file */
+    ARMul_EmuFuncCache_Decode(funcs,MEMC.ROMHigh,len/sizeof(ARMEmuFuncCache));
+    snprintf(tmpname,sizeof(tmpname),"%s.%ld",name,(long) getpid());
+    fd = open(tmpname,O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW,0600);
+    if(fd < 0)
+      return;
+    if((write(fd,&header,sizeof(header)) != (ssize_t) sizeof(header))
+       || (pwrite(fd,funcs,len,4096) != (ssize_t) len) || rename(tmpname,name)) {
+      close(fd);
+      unlink(tmpname);
+      return;
+    }
+    close(fd);
+    fd = open(name,O_RDONLY | O_NOFOLLOW);
+  }
+  if(fd < 0)
+    return;
+
+  /* Only trust a regular file of the right size that nobody else can have
+     written to, and which was written for this ROM by a build with the same
+     handler indices */
+  if(fstat(fd,&st) || !S_ISREG(st.st_mode) || !ARMul_SharedROMFuncsPrivate(&st) || (st.st_size != (off_t) (4096+len))
+     || (pread(fd,&fileheader,sizeof(fileheader),0) != (ssize_t) sizeof(fileheader)) || memcmp(&fileheader,&header,sizeof(header))) {
+    warn("Not sharing ROM handler cache: %s isn't a private file for this ROM\n",name);
+    close(fd);
+    return;
+  }
+
+  /* Mapped copy-on-write; entries only get rewritten if clobbered, which
+     ROM never is */
+  if(mmap(funcs,len,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_FIXED,fd,4096) == MAP_FAILED)
+    warn("Couldn't share ROM handler cache (%s)\n",strerror(errno));
+  else if(ARMul_SharedROMFuncsValid(funcs,len/sizeof(ARMEmuFuncCache))) {
+    close(fd);
+    return;
+  }
+  else
+    warn("Not sharing ROM handler cache: %s has bad entries\n",name);
+  /* The old mapping may have gone, so put back a private copy, to be
+     decoded lazily */
+  if(mmap(funcs,len,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED,-1,0) == MAP_FAILED)
+    ControlPane_Error(true,"Couldn't remap ROM handler cache (%s)",strerror(errno));
+  close(fd);
+}
+#endif
+#endif
 
 /*------------------------------------------------------------------------------*/
 /* OK - this is getting treated as an odds/sods engine - just hook up anything
    you need to do occasionally! */
 #ifndef _WIN32
+static ARMul_State *DumpState; /* Instance to dump on SIGUSR2 */
+
 static void DumpHandler(int sig) {
-  ARMul_State *state = &statestr;
+  ARMul_State *state = DumpState;
   FILE *res;
   int i, idx;
   ARMword size;
@@ -107,7 +329,7 @@ static void DumpHandler(int sig) {
 
   /* IOC timers */
   for(i=0;i<4;i++)
-    warn("Timer%d Count %08"PRIx32" Latch %08x\n",i,(uint32_t)ioc.TimerCount[i],ioc.TimerInputLatch[i]);
+    warn("Timer%d Count %08"PRIx32" Latch %08x\n",i,(uint32_t)IOC.TimerCount[i],IOC.TimerInputLatch[i]);
 
   /* Memory map */
   warn("MEMC using %dKB page size\n",4<<MEMC.PageSizeFlags);
@@ -144,7 +366,7 @@ static void DumpHandler(int sig) {
           break;
       }
       phys *= size;
-      mangle = ARMul_ManglePhysAddr(phys);
+      mangle = ARMul_ManglePhysAddr(state,phys);
       warn("log %08"PRIx32" -> phy %08"PRIx32" (pre-mangle %08"PRIx32") prot %s\n",logadr,mangle,phys,prot[(pt>>8)&3]);
     }
   }
@@ -194,6 +416,13 @@ ARMul_MemoryInit(ARMul_State *state)
   uint32_t extnrom_entry_count;
 #endif
   uint32_t initmemsize = 0;
+
+  state->Memc = calloc(1,sizeof(struct MEMCStruct));
+  if (!state->Memc) {
+    ControlPane_Error(false,"Couldn't allocate MEMC state");
+    return false;
+  }
+  MEMC.UseUpdateFlags = true;
   
   MEMC.DRAMPageSize = MEMC_PAGESIZE_3_32K;
   switch(CONFIG.eMemSize) {
@@ -244,6 +473,7 @@ ARMul_MemoryInit(ARMul_State *state)
   }
 
 #ifndef _WIN32
+  DumpState = state;
   signal(SIGUSR2,DumpHandler);
 #endif
 
@@ -295,7 +525,8 @@ ARMul_MemoryInit(ARMul_State *state)
   /* Now allocate ROMs & RAM in one chunk */
   RAMChunkSize = MAX(MEMC.RAMSize,512*1024); /* Ensure at least 512K RAM allocated to avoid any issues caused by DMA pointers going out of range */
   ROMRAMChunkSize = RAMChunkSize+MEMC.ROMHighSize+extnrom_size;
-  MEMC.ROMRAMChunk = calloc(1,ROMRAMChunkSize+256);
+  MEMC.ROMRAMChunkAlloc = ROMRAMChunkSize+256;
+  MEMC.ROMRAMChunk = ARMul_ChunkAlloc(&MEMC.ROMRAMChunkAlloc,RAMChunkSize);
   if(MEMC.ROMRAMChunk == NULL) {
     ControlPane_Error(false,"Couldn't allocate ROMRAMChunk");
     fclose(ROMFile);
@@ -303,29 +534,51 @@ ARMul_MemoryInit(ARMul_State *state)
   }
 
   /* Get everything 256 byte aligned for FastMap to work */
-  MEMC.PhysRam = (ARMword*) ((((FastMapUInt)MEMC.ROMRAMChunk)+255)&~255); /* RAM must come first for FastMap_LogRamFunc to work! */
+  MEMC.PhysRam = (ARMword*) ((((FastMapUInt)MEMC.ROMRAMChunk)+255)&~255); /* RAM must come first for the UpdateFlags tracking to work! */
   MEMC.ROMHigh = MEMC.PhysRam + (RAMChunkSize>>2);
 
   dbug(" Loading ROM....\n ");
 
+#ifdef __linux__
+  if(!ARMul_MapROMFile(state,ROMFile))
+#endif
   File_ReadEmu(ROMFile,(uint8_t *) MEMC.ROMHigh,MEMC.ROMHighSize);
 
   /* Close System ROM Image File */
   fclose(ROMFile);
 
 #ifdef ARMUL_INSTR_FUNC_CACHE
-  MEMC.EmuFuncChunk = calloc(sizeof(FastMapUInt)/4,ROMRAMChunkSize+256);
+  MEMC.EmuFuncChunkAlloc = sizeof(ARMEmuFuncCache)*((ROMRAMChunkSize+256)/4);
+  MEMC.EmuFuncChunk = ARMul_ChunkAlloc(&MEMC.EmuFuncChunkAlloc,sizeof(ARMEmuFuncCache)*(RAMChunkSize/4));
   if(MEMC.EmuFuncChunk == NULL) {
     ControlPane_Error(false,"Couldn't allocate EmuFuncChunk");
     ARMul_MemoryExit(state);
     return false;
   }
-#ifdef FASTMAP_64
+#if defined(ARMUL_INSTR_FUNC_INDEX)
+  /* ROMRAMChunk needs shifting to account for the shift that occurs in FastMap_Phy2Func */
+  state->FastMapInstrFuncOfs = ((FastMapUInt)MEMC.EmuFuncChunk)-(((FastMapUInt)MEMC.ROMRAMChunk)>>1);
+#elif defined(FASTMAP_64)
   /* On 64bit systems, ROMRAMChunk needs shifting to account for the shift that occurs in FastMap_Phy2Func */
   state->FastMapInstrFuncOfs = ((FastMapUInt)MEMC.EmuFuncChunk)-(((FastMapUInt)MEMC.ROMRAMChunk)<<1);
 #else
   state->FastMapInstrFuncOfs = ((FastMapUInt)MEMC.EmuFuncChunk)-((FastMapUInt)MEMC.ROMRAMChunk);
 #endif
+  state->CodePages = calloc((ROMRAMChunkSize+4095)>>12,1);
+  if(state->CodePages == NULL) {
+    ControlPane_Error(false,"Couldn't allocate code page table");
+    ARMul_MemoryExit(state);
+    return false;
+  }
+  state->CodePageBase = (FastMapUInt)MEMC.PhysRam;
+#endif
+
+#ifdef ARMUL_BLOCK_CACHE
+  if (!ARMul_BlockCache_Init(state,MEMC.PhysRam,ROMRAMChunkSize,CONFIG.eCPUEngine != CPUEngine_Interpreter)) {
+    ControlPane_Error(false,"Couldn't allocate block cache");
+    ARMul_MemoryExit(state);
+    return false;
+  }
 #endif
 
   /* Create Space for extension ROM in ROMLow */
@@ -339,7 +592,7 @@ ARMul_MemoryInit(ARMul_State *state)
       return false;
     }
 
-    /* calloc() now used to ensure that Extension ROM space is zero'ed */
+    /* ARMul_ChunkAlloc() ensures that Extension ROM space is zero'ed */
     MEMC.ROMLow = MEMC.ROMHigh + (MEMC.ROMHighSize>>2);
 
 #if defined(EXTNROM_SUPPORT)
@@ -349,6 +602,10 @@ ARMul_MemoryInit(ARMul_State *state)
 #endif /* EXTNROM_SUPPORT */
   }
 
+#if defined(__linux__) && defined(ARMUL_INSTR_FUNC_INDEX)
+  ARMul_MapSharedROMFuncs(state,MEMC.ROMHighSize+extnrom_size);
+#endif
+
 
   dbug(" ..Done\n ");
 
@@ -378,7 +635,10 @@ ARMul_MemoryInit(ARMul_State *state)
   FastMap_RebuildMapMode(state);
 
 #ifdef HOSTFS_SUPPORT
-  hostfs_init();
+  if (!hostfs_init(state)) {
+    ARMul_MemoryExit(state);
+    return false;
+  }
 #endif
 
   return true;
@@ -393,17 +653,31 @@ ARMul_MemoryInit(ARMul_State *state)
  */
 void ARMul_MemoryExit(ARMul_State *state)
 {
+  if (!state->Memc)
+    return;
   Sound_Shutdown(state);
   DisplayDev_Shutdown(state);
-  free(MEMC.ROMRAMChunk);
+  ARMul_ChunkFree(MEMC.ROMRAMChunk,MEMC.ROMRAMChunkAlloc);
   MEMC.ROMRAMChunk = NULL;
 #ifdef ARMUL_INSTR_FUNC_CACHE
-  free(MEMC.EmuFuncChunk);
+  ARMul_ChunkFree(MEMC.EmuFuncChunk,MEMC.EmuFuncChunkAlloc);
   MEMC.EmuFuncChunk = NULL;
+  free(state->CodePages);
+  state->CodePages = NULL;
+#endif
+#ifdef ARMUL_BLOCK_CACHE
+  ARMul_BlockCache_Exit(state);
 #endif
+#ifdef HOSTFS_SUPPORT
+  hostfs_exit(state);
+#endif
+  File_Exit(state);
+  IO_Exit(state);
+  free(state->Memc);
+  state->Memc = NULL;
 }
 
-static ARMword ARMul_ManglePhysAddr(ARMword phy)
+static ARMword ARMul_ManglePhysAddr(ARMul_State *state,ARMword phy)
 {
   /* Emulate the different ways that MEMC converts physical addresses to
      row & column addresses. We perform two mappings here: From the physical
@@ -510,6 +784,7 @@ static void FastMap_SetEntries(ARMul_State *state, ARMword addr,ARMword *data,Fa
 /*  dbug("FastMap_SetEntries(%08x,%08x,%08x,%08x,%08x)\n",addr,data,func,flags,size); */
   FastMapUInt offset = ((FastMapUInt)data)-addr; /* Offset so we can just add the phy addr to get a pointer back */
   flags |= offset>>8;
+  ARMul_MapChanged(state);
 /*  dbug("->entry %08x\n->FlagsAndData %08x\n",entry,flags); */
   while(size) {
     entry->FlagsAndData = flags;
@@ -530,116 +805,6 @@ static void FastMap_SetEntries_Repeat(ARMul_State *state,ARMword addr,ARMword *d
   FastMap_SetEntries(state,addr,data,func,flags,totsize);
 }
 
-static void ARMul_RebuildFastMapPTIdx(ARMul_State *state, ARMword idx);
-
-static void ARMul_PurgeFastMapPTIdx(ARMul_State *state,ARMword idx)
-{
-  FastMapEntry *entry;
-  FastMapUInt addr;
-  ARMword size;
-  int32_t pt;
-  if(MEMC.ROMMapFlag != MapFlag_Normal)
-    return; /* Still in ROM mode, abort */
-    
-  pt = MEMC.PageTable[idx];
-  if(pt>0)
-  {
-    ARMword logadr,phys,mask;
-    switch(MEMC.PageSizeFlags) {
-      default:
-      case MEMC_PAGESIZE_O_4K:
-        phys = pt & 127;
-        logadr = (pt & 0x7ff000)
-              | ((pt & 0x000c00)<<13);
-        mask = 0x7ffc00;
-        break;
-      case MEMC_PAGESIZE_1_8K:
-        phys = ((pt>>1) & 0x3f) | ((pt & 1) << 6);
-        logadr = (pt & 0x7fe000)
-              | ((pt & 0x000c00)<<13);
-        mask = 0x7fec00;
-        break;
-      case MEMC_PAGESIZE_2_16K:
-        phys = ((pt>>2) & 0x1f) | ((pt & 3) << 5);
-        logadr = (pt & 0x7fc000)
-              | ((pt & 0x000c00)<<13);
-        mask = 0x7fcc00;
-        break;
-      case MEMC_PAGESIZE_3_32K:
-        phys = ((pt>>3) & 0xf) | ((pt&1)<<4) | ((pt&2)<<5) | ((pt&4)<<3) | (pt&0x80) | ((pt>>4)&0x100);
-        logadr = (pt & 0x7f8000)
-              | ((pt & 0x000c00)<<13);
-        mask = 0x7f8c00;
-        break;
-    }
-    size=12+MEMC.PageSizeFlags;
-    phys = ARMul_ManglePhysAddr(phys<<size);
-    size = 1<<size;
-    entry = FastMap_GetEntryNoWrap(state,logadr);
-    
-    /* To cope with multiply mapped pages (i.e. multiple physical pages mapping to the same logical page) we need to check if the page we're about to unmap is still owned by us
-       If it is owned by us, we'll have to search the page tables for a replacement (if any)
-       Otherwise we don't need to do anything at all
-       Note that we only need to check the first page for ownership, because any change to the page size will result in the full map being rebuilt */
-       
-    addr = ((FastMapUInt)(MEMC.PhysRam+(phys>>2)))-logadr; /* Address part of FlagsAndData */
-    if((entry->FlagsAndData<<8) == addr)
-    {
-      /* We own this page */
-      ARMword idx2;
-      pt &= mask;
-      for(idx2=0;idx2<512;idx2++)
-      {
-        if(idx2 != idx)
-        {
-          int32_t pt2 = MEMC.PageTable[idx2];
-          if((pt2 > 0) && (((ARMword)pt2 & mask) == (ARMword)pt))
-          {
-            /* We've found a suitable replacement */
-            ARMul_RebuildFastMapPTIdx(state, idx2); /* Take the easy way out */
-            return;
-          }
-        }
-      }
-      /* No replacement found, so just nuke this entry */
-      while(size) {
-        if((entry->FlagsAndData<<8) == addr)
-          entry->FlagsAndData = 0; /* No need to nuke function pointer */
-        entry++;
-        size -= 4096;
-      }
-    }    
-  }
-}
-
-static void FastMap_DMAAbleWrite(ARMword address,ARMword data)
-{
-  UNUSED_VAR(data);
-  MEMC.UpdateFlags[address/UPDATEBLOCKSIZE]++;
-}
-
-static ARMword FastMap_LogRamFunc(ARMul_State *state, ARMword addr,ARMword data,ARMword flags)
-{
-  /* Write to DMAAble log RAM, kinda crappy */
-  ARMword *phy = FastMap_Log2Phy(FastMap_GetEntry(state,addr),addr&~3);
-  ARMword orig = *phy;
-  if(flags & FASTMAP_ACCESSFUNC_BYTE)
-  {
-    ARMword shift = ((addr&3)<<3);
-    data = (data&0xff)<<shift;
-    data |= orig &~ (0xff<<shift);
-  }
-  if(orig != data)
-  {
-    *phy = data;
-    FastMap_PhyClobberFunc(state,phy);
-    /* Convert pointer to physical addr, then update DMA flags */
-    addr = (ARMword) (((FastMapUInt)phy)-((FastMapUInt)MEMC.PhysRam));
-    FastMap_DMAAbleWrite(addr,data);
-  }
-  return 0;
-} 
-
 static void ARMul_RebuildFastMapPTIdx(ARMul_State *state, ARMword idx)
 {
   int32_t pt;
@@ -684,19 +849,11 @@ static void ARMul_RebuildFastMapPTIdx(ARMul_State *state, ARMword idx)
         break;
     }
     size=12+MEMC.PageSizeFlags;
-    phys = ARMul_ManglePhysAddr(phys<<size);
+    phys = ARMul_ManglePhysAddr(state,phys<<size);
     size = 1<<size;
     flags = PPL_To_Flags[(pt>>8)&3];
-    if((phys<512*1024) && DisplayDev_UseUpdateFlags)
-    {
-      /* DMAable, must use func on write */
-      FastMap_SetEntries(state,logadr,MEMC.PhysRam+(phys>>2),FastMap_LogRamFunc,flags|FASTMAP_W_FUNC,size);
-    }
-    else
-    {
-      /* Normal */
-      FastMap_SetEntries(state,logadr,MEMC.PhysRam+(phys>>2),0,flags,size);
-    }
+    /* Writes to DMAable RAM are tracked by FastMap_PhyClobberFunc, so all RAM can be mapped directly */
+    FastMap_SetEntries(state,logadr,MEMC.PhysRam+(phys>>2),0,flags,size);
   }
 }
 
@@ -716,7 +873,7 @@ static void DMA_PutVal(ARMul_State *state,ARMword address)
         if(MEMC.Vinit != RegVal)
         {
           MEMC.Vinit = RegVal;
-          (DisplayDev_Current->DAGWrite)(state,RegNum,RegVal);
+          (state->DisplayDevice->DAGWrite)(state,RegNum,RegVal);
         }
         break;
 
@@ -724,7 +881,7 @@ static void DMA_PutVal(ARMul_State *state,ARMword address)
         if(MEMC.Vstart != RegVal)
         {
           MEMC.Vstart = RegVal;
-          (DisplayDev_Current->DAGWrite)(state,RegNum,RegVal);
+          (state->DisplayDevice->DAGWrite)(state,RegNum,RegVal);
         }
         break;
 
@@ -732,7 +889,7 @@ static void DMA_PutVal(ARMul_State *state,ARMword address)
         if(MEMC.Vend != RegVal)
         {
           MEMC.Vend = RegVal;
-          (DisplayDev_Current->DAGWrite)(state,RegNum,RegVal);
+          (state->DisplayDevice->DAGWrite)(state,RegNum,RegVal);
         }
         break;
 
@@ -740,7 +897,7 @@ static void DMA_PutVal(ARMul_State *state,ARMword address)
         if(MEMC.Cinit != RegVal)
         {
           MEMC.Cinit = RegVal;
-          (DisplayDev_Current->DAGWrite)(state,RegNum,RegVal);
+          (state->DisplayDevice->DAGWrite)(state,RegNum,RegVal);
         }
         break;
 
@@ -748,7 +905,7 @@ static void DMA_PutVal(ARMul_State *state,ARMword address)
         MEMC.Sstart = RegVal;
         /* The data sheet does not define what happens if you write start before end. */
         MEMC.NextSoundBufferValid = true;
-        ioc.IRQStatus &= ~IRQB_SIRQ; /* Take sound interrupt off */
+        IOC.IRQStatus &= ~IRQB_SIRQ; /* Take sound interrupt off */
         IO_UpdateNirq(state);
         dbug_memc("Write to MEMC Sstart register\n");
         break;
@@ -770,7 +927,7 @@ static void DMA_PutVal(ARMul_State *state,ARMword address)
           MEMC.SendN = swap;
           MEMC.SstartC = MEMC.Sptr;
           MEMC.NextSoundBufferValid = false;
-          ioc.IRQStatus |= IRQB_SIRQ; /* Take sound interrupt on */
+          IOC.IRQStatus |= IRQB_SIRQ; /* Take sound interrupt on */
           IO_UpdateNirq(state);
         }
         break;
@@ -787,18 +944,151 @@ static void DMA_PutVal(ARMul_State *state,ARMword address)
     }
 }
 
+/* Page table writes aren't applied to the FastMap straight away. Instead the
+   logical pages they affect (both old and new) are mapped to
+   FastMap_PendingFunc, and the first access to any of them brings the whole
+   FastMap up to date in one go. This avoids repeatedly remapping (and
+   searching for replacement mappings) during the bursts of page table writes
+   that happen on every task switch. */
+
+#define FASTMAP_PENDING_FLAGS (FASTMAP_R_USR|FASTMAP_R_OS|FASTMAP_R_SVC|FASTMAP_W_USR|FASTMAP_W_OS|FASTMAP_W_SVC|FASTMAP_R_FUNC|FASTMAP_W_FUNC)
+
+static ARMword FastMap_PendingFunc(ARMul_State *state, ARMword addr,ARMword data,ARMword flags);
+
+/* Return the logical address of a (valid) page table entry */
+static ARMword MEMC_PageTableLogAddr(ARMul_State *state,int32_t pt)
+{
+  switch(MEMC.PageSizeFlags) {
+    default:
+    case MEMC_PAGESIZE_O_4K:
+      return (pt & 0x7ff000) | ((pt & 0x000c00)<<13);
+    case MEMC_PAGESIZE_1_8K:
+      return (pt & 0x7fe000) | ((pt & 0x000c00)<<13);
+    case MEMC_PAGESIZE_2_16K:
+      return (pt & 0x7fc000) | ((pt & 0x000c00)<<13);
+    case MEMC_PAGESIZE_3_32K:
+      return (pt & 0x7f8000) | ((pt & 0x000c00)<<13);
+  }
+}
+
+static void MEMC_TrapPage(ARMul_State *state, int32_t pt)
+{
+  ARMword logadr;
+  if(pt<=0)
+    return;
+  logadr = MEMC_PageTableLogAddr(state,pt);
+  if(FastMap_GetEntryNoWrap(state,logadr)->AccessFunc != FastMap_PendingFunc)
+  {
+    MEMC.PendingPages[MEMC.NumPendingPages++] = logadr>>12;
+    FastMap_SetEntries(state,logadr,0,FastMap_PendingFunc,FASTMAP_PENDING_FLAGS,4096<<MEMC.PageSizeFlags);
+  }
+}
+
+static void MEMC_ApplyPendingMap(ARMul_State *state)
+{
+  ARMword size = 4096<<MEMC.PageSizeFlags;
+  uint_fast16_t i;
+  bool orphans = false;
+
+  /* Unmap all the trapped pages, then map in the changed entries. Swapped
+     pages just end up being mapped to their new places. */
+  for(i=0;i<MEMC.NumPendingPages;i++)
+    FastMap_SetEntries(state,MEMC.PendingPages[i]<<12,0,0,0,size);
+  for(i=0;i<MEMC.NumPendingPT;i++)
+    ARMul_RebuildFastMapPTIdx(state,MEMC.PendingPT[i]);
+
+  /* Any trapped pages which are still unmapped may be (multiply) mapped by an
+     entry which wasn't written, so look for one, with the lowest numbered
+     entry taking priority */
+  for(i=0;i<MEMC.NumPendingPages;i++)
+    orphans |= !FastMap_GetEntryNoWrap(state,MEMC.PendingPages[i]<<12)->FlagsAndData;
+  if(orphans)
+  {
+    ARMword idx;
+    for(idx=0;idx<512;idx++)
+    {
+      int32_t pt = MEMC.PageTable[idx];
+      if((pt > 0) && !FastMap_GetEntryNoWrap(state,MEMC_PageTableLogAddr(state,pt))->FlagsAndData)
+        ARMul_RebuildFastMapPTIdx(state,idx);
+    }
+  }
+
+  MEMC.NumPendingPages = MEMC.NumPendingPT = 0;
+  memset(MEMC.PendingPTBits,0,sizeof(MEMC.PendingPTBits));
+}
+
+static ARMword FastMap_PendingFunc(ARMul_State *state, ARMword addr,ARMword data,ARMword flags)
+{
+  /* Access to a page affected by a page table write; update the map and retry */
+  FastMapEntry *entry;
+  FastMapRes res;
+  ARMword *phy;
+
+  MEMC_ApplyPendingMap(state);
+
+  entry = FastMap_GetEntry(state,addr);
+  if(flags & FASTMAP_ACCESSFUNC_WRITE)
+  {
+    res = FastMap_DecodeWrite(entry,state->FastMapMode);
+    if(FASTMAP_RESULT_DIRECT(res))
+    {
+      phy = FastMap_Log2Phy(entry,addr&~3);
+      if(flags & FASTMAP_ACCESSFUNC_BYTE)
+      {
+        ARMword shift = ((addr&3)<<3);
+        data = (data&0xff)<<shift;
+        data |= (*phy) &~ (0xff<<shift);
+      }
+      *phy = data;
+      FastMap_PhyClobberFunc(state,phy);
+    }
+    else if(FASTMAP_RESULT_FUNC(res))
+    {
+      return (entry->AccessFunc)(state,addr,data,flags);
+    }
+    else
+    {
+      ARMul_DATAABORT(addr);
+    }
+    return 0;
+  }
+  res = FastMap_DecodeRead(entry,state->FastMapMode);
+  if(FASTMAP_RESULT_DIRECT(res))
+    return *(FastMap_Log2Phy(entry,addr&~3));
+  else if(FASTMAP_RESULT_FUNC(res))
+    return (entry->AccessFunc)(state,addr,data,flags);
+  else if(flags & FASTMAP_ACCESSFUNC_FETCH)
+  {
+    ARMul_PREFETCHABORT(addr);
+    return ARMul_ABORTWORD;
+  }
+  ARMul_DATAABORT(addr);
+  return 0;
+}
+
 static void MEMC_PutVal(ARMul_State *state, ARMword address)
 {
     /* Logical-to-physical address translation */
     unsigned tmp;
+    int32_t old;
 
     tmp = address - MEMORY_0x3800000_W_LOG2PHYS;
 
     address = ((address >> 4) & 0x100) | (address & 0xff);
 
-    ARMul_PurgeFastMapPTIdx(state,address); /* Unmap old value */
+    old = MEMC.PageTable[address];
     MEMC.PageTable[address] = tmp & 0x0fffffff;
-    ARMul_RebuildFastMapPTIdx(state, address); /* Map in new value */
+    if((old == MEMC.PageTable[address]) || (MEMC.ROMMapFlag != MapFlag_Normal))
+      return; /* Nothing to do, or the map will be rebuilt on leaving ROM mode */
+
+    /* Defer the update until the old or new logical page is next accessed */
+    MEMC_TrapPage(state,old);
+    MEMC_TrapPage(state,MEMC.PageTable[address]);
+    if(!(MEMC.PendingPTBits[address>>5] & (1u<<(address&31))))
+    {
+      MEMC.PendingPTBits[address>>5] |= 1u<<(address&31);
+      MEMC.PendingPT[MEMC.NumPendingPT++] = address;
+    }
 }
 
 static ARMword FastMap_ROMMap1Func(ARMul_State *state, ARMword addr,ARMword data,ARMword flags)
@@ -832,31 +1122,6 @@ static ARMword FastMap_PhysRamFuncROMMap2(ARMul_State *state, ARMword addr,ARMwo
   }
   *phy = data;
   FastMap_PhyClobberFunc(state,phy);
-  if(addr < 512*1024)
-    FastMap_DMAAbleWrite(addr,data);
-  return 0;
-}
-
-static ARMword FastMap_PhysRamFunc(ARMul_State *state, ARMword addr,ARMword data,ARMword flags)
-{
-  ARMword *phy, orig;
-  /* Write to direct-mapped phys RAM. Address guaranteed to be valid. */
-  addr -= MEMORY_0x2000000_RAM_PHYS;
-  phy = &MEMC.PhysRam[addr>>2];
-  orig = *phy;
-  if(flags & FASTMAP_ACCESSFUNC_BYTE)
-  {
-    ARMword shift = ((addr&3)<<3);
-    data = (data&0xff)<<shift;
-    data |= orig &~ (0xff<<shift);
-  }
-  if(orig != data)
-  {
-    *phy = data;
-    FastMap_PhyClobberFunc(state,phy);
-    /* Update DMA flags */
-    FastMap_DMAAbleWrite(addr,data);
-  }
   return 0;
 }
 
@@ -890,7 +1155,7 @@ static ARMword FastMap_VIDCFunc(ARMul_State *state, ARMword addr,ARMword data,AR
   }
   if(flags & FASTMAP_ACCESSFUNC_WRITE)
   {
-    (DisplayDev_Current->VIDCPutVal)(state,addr,data,!!(flags&FASTMAP_ACCESSFUNC_BYTE));
+    (state->DisplayDevice->VIDCPutVal)(state,addr,data,!!(flags&FASTMAP_ACCESSFUNC_BYTE));
     return 0;
   }
   if(MEMC.ROMLow)
@@ -955,7 +1220,15 @@ void ARMul_RebuildFastMap(ARMul_State *state)
   ARMword i;
   FastMapEntry *entry;
   
-  /* completely rebuild the fast map */
+  /* Track writes to DMAable RAM if the display driver wants them */
+  state->UpdateFlagsBase = MEMC.PhysRam;
+  state->UpdateFlagsSize = (MEMC.UseUpdateFlags?512*1024:0);
+  state->UpdateFlags = MEMC.UpdateFlags;
+
+  /* completely rebuild the fast map, which takes care of any pending page table writes */
+  MEMC.NumPendingPages = MEMC.NumPendingPT = 0;
+  memset(MEMC.PendingPTBits,0,sizeof(MEMC.PendingPTBits));
+
   switch(MEMC.ROMMapFlag)
   {
   case MapFlag_Normal:
@@ -989,27 +1262,10 @@ void ARMul_RebuildFastMap(ARMul_State *state)
   {
     for(i=0;i<16*1024*1024;i+=4096)
     {
-      ARMword phy = ARMul_ManglePhysAddr(i);
-      if((phy < 512*1024) && DisplayDev_UseUpdateFlags)
-      {
-        /* Lower 512K must use access func for write
-           But we can use a fast function (for when the OS has correctly detected our RAM setup) or a slow one. */
-        if(i == phy)
-        {
-          /* Direct mapping, use fast func */
-          FastMap_SetEntries(state,MEMORY_0x2000000_RAM_PHYS+i,MEMC.PhysRam+(phy>>2),FastMap_PhysRamFunc,FASTMAP_R_SVC|FASTMAP_W_SVC|FASTMAP_W_FUNC,4096);
-        }
-        else
-        {
-          /* Indirect mapping, reuse LogRamFunc */
-          FastMap_SetEntries(state,MEMORY_0x2000000_RAM_PHYS+i,MEMC.PhysRam+(phy>>2),FastMap_LogRamFunc,FASTMAP_R_SVC|FASTMAP_W_SVC|FASTMAP_W_FUNC,4096);
-        }
-      }
-      else
-      {
-        /* Remainder can use direct access for read/write */
-        FastMap_SetEntries(state,MEMORY_0x2000000_RAM_PHYS+i,MEMC.PhysRam+(phy>>2),0,FASTMAP_R_SVC|FASTMAP_W_SVC,4096);
-      }
+      /* Direct access for read/write, with writes to the lower 512K tracked
+         by FastMap_PhyClobberFunc */
+      ARMword phy = ARMul_ManglePhysAddr(state,i);
+      FastMap_SetEntries(state,MEMORY_0x2000000_RAM_PHYS+i,MEMC.PhysRam+(phy>>2),0,FASTMAP_R_SVC|FASTMAP_W_SVC,4096);
     }
   }
 
@@ -1037,3 +1293,32 @@ void ARMul_RebuildFastMap(ARMul_State *state)
   else
     FastMap_SetEntries(state,MEMORY_0x3800000_R_ROM_HIGH,0,FastMap_MEMCFunc,FASTMAP_R_USR|FASTMAP_R_SVC|FASTMAP_R_OS|FASTMAP_W_SVC|FASTMAP_W_FUNC|FASTMAP_R_FUNC,0x800000);
 }
+
+/**
+ * ARMul_ReadIsSideEffectFree
+ *
+ * Check whether a word/byte load from the given logical address (using the
+ * current memory map & processor mode) could be performed any number of
+ * times without changing the state of the machine. Loads which would abort
+ * are treated as having side effects.
+ *
+ * @param state Emulator state
+ * @param addr Logical address
+ * @returns true if the load has no side effects
+ */
+bool ARMul_ReadIsSideEffectFree(ARMul_State *state,ARMword addr)
+{
+  FastMapEntry *entry;
+  FastMapRes res;
+
+  if(addr & ~UINT32_C(0x3ffffff))
+    return false; /* Address exception */
+
+  entry = FastMap_GetEntryNoWrap(state,addr);
+  res = FastMap_DecodeRead(entry,state->FastMapMode);
+  if(FASTMAP_RESULT_DIRECT(res))
+    return true;
+  if(FASTMAP_RESULT_FUNC(res) && (entry->AccessFunc == FastMap_ConIOFunc) && (MEMC.ROMMapFlag != MapFlag_UnaccessedROM))
+    return IO_ReadIsSideEffectFree(addr);
+  return false;
+}
@@ -70,22 +70,35 @@ struct MEMCStruct {
 
   /* Fastmap memory block pointers */
   void *ROMRAMChunk;
+  size_t ROMRAMChunkAlloc; /* Allocated sizes, for ARMul_ChunkFree */
 #ifdef ARMUL_INSTR_FUNC_CACHE
   void *EmuFuncChunk;
+  size_t EmuFuncChunkAlloc;
 #endif
 
   int32_t PageTable[512]; /* Good old fashioned MEMC1 page table */
 
+  /* Page table writes which haven't been applied to the FastMap yet */
+  uint_fast16_t NumPendingPT, NumPendingPages;
+  uint16_t PendingPT[512];    /* Page table entries written */
+  uint32_t PendingPTBits[512/32];
+  uint16_t PendingPages[(0x2000000/4096)]; /* Logical pages (in 4K units) mapped to FastMap_PendingFunc */
+
   uint32_t UpdateFlags[(512*1024)/UPDATEBLOCKSIZE]; /* One flag for
                                                        each block of DMAble RAM
                                                        incremented on a write */
-};
 
+  /* Display device settings */
+  bool UseUpdateFlags;  /* Whether the display device is using UpdateFlags */
+  bool AutoUpdateFlags; /* Automatically select whether to use UpdateFlags or not. If true, this causes UseUpdateFlags and FrameSkip to be updated automatically. */
+  int FrameSkip;        /* If UseUpdateFlags is true, this provides a frameskip value used by the standard & palettised drivers. If UseUpdateFlags is false, it acts as failsafe counter that forces an update when a certain number of frames have passed */
+};
 
-extern struct MEMCStruct memc;
 
-#define MEMC (memc)
+#define MEMC (*(state->Memc))
 
 void ARMul_RebuildFastMap(ARMul_State *state);
 
+bool ARMul_ReadIsSideEffectFree(ARMul_State *state,ARMword addr);
+
 #endif
@@ -15,20 +15,14 @@
 
 #include <string.h>
 
-const DisplayDev *DisplayDev_Current = NULL;
-
-bool DisplayDev_UseUpdateFlags = true;
-bool DisplayDev_AutoUpdateFlags = false;
-int DisplayDev_FrameSkip = 0;
-
 bool DisplayDev_Set(ARMul_State *state,const DisplayDev *dev)
 {
   struct Vidc_Regs Vidc;
-  if(DisplayDev_Current)
+  if(state->DisplayDevice)
   {
     Vidc = VIDC;
-    (DisplayDev_Current->Shutdown)(state);
-    DisplayDev_Current = NULL;
+    (state->DisplayDevice->Shutdown)(state);
+    state->DisplayDevice = NULL;
   }
   else
   {
@@ -38,17 +32,17 @@ bool DisplayDev_Set(ARMul_State *state,const DisplayDev *dev)
   {
     if (!(dev->Init)(state,&Vidc))
       return false;
-    DisplayDev_Current = dev;
+    state->DisplayDevice = dev;
   }
   return true;
 }
 
 void DisplayDev_Shutdown(ARMul_State *state)
 {
-  if(DisplayDev_Current)
+  if(state->DisplayDevice)
   {
-    (DisplayDev_Current->Shutdown)(state);
-    DisplayDev_Current = NULL;
+    (state->DisplayDevice->Shutdown)(state);
+    state->DisplayDevice = NULL;
   }
 }
 
@@ -61,15 +55,15 @@ void DisplayDev_GetCursorPos(ARMul_State *state,int *x,int *y)
 
 static const uint32_t vidcclocks[4] = {24000000,25175000,36000000,24000000};
 
-uint32_t DisplayDev_GetVIDCClockIn(void)
+uint32_t DisplayDev_GetVIDCClockIn(ARMul_State *state)
 {
-  return vidcclocks[ioc.IOEBControlReg & IOEB_CR_VIDC_MASK];
+  return vidcclocks[IOC.IOEBControlReg & IOEB_CR_VIDC_MASK];
 }
 
 void DisplayDev_VSync(ARMul_State *state)
 {
   /* Trigger VSync */
-  ioc.IRQStatus|=IRQA_VFLYBK;
+  IOC.IRQStatus|=IRQA_VFLYBK;
   IO_UpdateNirq(state);
   /* Update ARMul_EmuRate */
   EmuRate_Update(state);
@@ -12,13 +12,13 @@
 #ifndef DISPLAYDEV_H
 #define DISPLAYDEV_H
 
-typedef struct {
+struct DisplayDev {
   bool (*Init)(ARMul_State *state,const struct Vidc_Regs *Vidc); /* Initialise display device, return nonzero on failure */
   void (*Shutdown)(ARMul_State *state); /* Shutdown display device */
   void (*VIDCPutVal)(ARMul_State *state,ARMword address, ARMword data,bool bNw); /* Call made by core to handle writing to VIDC registers */
   void (*DAGWrite)(ARMul_State *state,uint_fast8_t reg,uint_fast16_t val); /* Call made by core when video DAG registers are updated. reg 0=Vinit, 1=Vstart, 2=Vend, 3=Cinit */
   void (*IOEBCRWrite)(ARMul_State *state,ARMword val); /* Call made by core when IOEB control register is updated */
-} DisplayDev;
+};
 
 /* Raw VIDC registers */
 struct Vidc_Regs {
@@ -51,12 +51,9 @@ struct Vidc_Regs {
 
 #define VIDC (*(state->Display))
 
-extern const DisplayDev *DisplayDev_Current; /* Pointer to current display device */
-extern bool DisplayDev_UseUpdateFlags; /* Global flag for whether the current device is using MEMC.UpdateFlags */
-
-extern bool DisplayDev_AutoUpdateFlags; /* Automatically select whether to use UpdateFlags or not. If true, this causes DisplayDev_UseUpdateFlags and DisplayDev_FrameSkip to be updated automatically. */
-
-extern int DisplayDev_FrameSkip; /* If DisplayDev_UseUpdateFlags is true, this provides a frameskip value used by the standard & palettised drivers. If DisplayDev_UseUpdateFlags is false, it acts as failsafe counter that forces an update when a certain number of frames have passed */
+/* The current display device is state->DisplayDevice, and the settings for
+   how it tracks screen updates (UseUpdateFlags, AutoUpdateFlags, FrameSkip)
+   live in the MEMC struct */
 
 extern bool DisplayDev_Set(ARMul_State *state,const DisplayDev *dev); /* Switch to indicated display device, returns nonzero on failure */
 
@@ -68,7 +65,7 @@ extern void DisplayDev_Shutdown(ARMul_State *state);
 /* Calculate cursor position relative to the first display pixel */
 extern void DisplayDev_GetCursorPos(ARMul_State *state,int *x,int *y);
 
-extern uint32_t DisplayDev_GetVIDCClockIn(void); /* Get VIDC source clock rate (affected by IOEB CR) */
+extern uint32_t DisplayDev_GetVIDCClockIn(ARMul_State *state); /* Get VIDC source clock rate (affected by IOEB CR) */
 
 extern void DisplayDev_VSync(ARMul_State *state); /* Trigger VSync interrupt & update ARMul_EmuRate. Note: Manipulates event queue! */
 
@@ -11,11 +11,17 @@ static inline FastMapRes FastMap_DecodeRead(const FastMapEntry *entry,FastMapUIn
 static inline FastMapRes FastMap_DecodeWrite(const FastMapEntry *entry,FastMapUInt mode);
 static inline ARMword *FastMap_Log2Phy(const FastMapEntry *entry,ARMword addr);
 #ifdef ARMUL_INSTR_FUNC_CACHE
-static inline ARMEmuFunc *FastMap_Phy2Func(ARMul_State *state,ARMword *addr);
+static inline ARMEmuFuncCache *FastMap_Phy2Func(ARMul_State *state,ARMword *addr);
 #endif
+#ifdef ARMUL_INSTR_FUNC_CACHE
+static inline void FastMap_PhyMarkCode(ARMul_State *state,ARMword *addr);
+#endif
+static inline void FastMap_PhyUpdateFlags(ARMul_State *state,ARMword *addr);
+static inline void FastMap_PhyUpdateFlagsRange(ARMul_State *state,ARMword *addr,size_t len);
 static inline void FastMap_PhyClobberFunc(ARMul_State *state,ARMword *addr);
 static inline void FastMap_PhyClobberFuncRange(ARMul_State *state,ARMword *addr,size_t len);
 static inline ARMword FastMap_LoadFunc(const FastMapEntry *entry,ARMul_State *state,ARMword addr);
+static inline ARMword FastMap_FetchFunc(const FastMapEntry *entry,ARMul_State *state,ARMword addr);
 static inline void FastMap_StoreFunc(const FastMapEntry *entry,ARMul_State *state,ARMword addr,ARMword data,ARMword flags);
 static inline void FastMap_RebuildMapMode(ARMul_State *state);
 
@@ -50,22 +56,62 @@ static inline ARMword *FastMap_Log2Phy(const FastMapEntry *entry,ARMword addr)
 }
 
 #ifdef ARMUL_INSTR_FUNC_CACHE
-static inline ARMEmuFunc *FastMap_Phy2Func(ARMul_State *state,ARMword *addr)
+static inline ARMEmuFuncCache *FastMap_Phy2Func(ARMul_State *state,ARMword *addr)
 {
-	/* Return ARMEmuFunc * for an address returned by Log2Phy */
-#ifdef FASTMAP_64
+	/* Return ARMEmuFuncCache * for an address returned by Log2Phy */
+#if defined(ARMUL_INSTR_FUNC_INDEX)
+	/* Shift addr so we access the indices as 16bit data types instead of 32bit */
+	return (ARMEmuFuncCache*)((((FastMapUInt)addr)>>1)+state->FastMapInstrFuncOfs);
+#elif defined(FASTMAP_64)
 	/* Shift addr so we access ARMEmuFunc *'s as 64bit data types instead of 32bit */
-	return (ARMEmuFunc*)((((FastMapUInt)addr)<<1)+state->FastMapInstrFuncOfs);
+	return (ARMEmuFuncCache*)((((FastMapUInt)addr)<<1)+state->FastMapInstrFuncOfs);
 #else
-	return (ARMEmuFunc*)(((FastMapUInt)addr)+state->FastMapInstrFuncOfs);
+	return (ARMEmuFuncCache*)(((FastMapUInt)addr)+state->FastMapInstrFuncOfs);
 #endif
 }
+
+static inline void FastMap_PhyMarkCode(ARMul_State *state,ARMword *addr)
+{
+	/* Note that the page containing addr now has entries in the instruction
+	   handler cache. Until then its cache entries are all clobbered, so
+	   writes to the page don't need to touch them. */
+	state->CodePages[(((FastMapUInt)addr)-state->CodePageBase)>>12] = 1;
+}
 #endif
 
+static inline void FastMap_PhyUpdateFlags(ARMul_State *state,ARMword *addr)
+{
+	/* Mark the display update block containing a write to DMA-able RAM as dirty */
+	FastMapUInt ofs = ((FastMapUInt)addr)-((FastMapUInt)state->UpdateFlagsBase);
+	if(ofs < state->UpdateFlagsSize)
+		state->UpdateFlags[ofs/UPDATEBLOCKSIZE]++;
+}
+
+static inline void FastMap_PhyUpdateFlagsRange(ARMul_State *state,ARMword *addr,size_t len)
+{
+	FastMapUInt ofs = ((FastMapUInt)addr)-((FastMapUInt)state->UpdateFlagsBase);
+	if((len>0) && (ofs < state->UpdateFlagsSize))
+	{
+		FastMapUInt last = (MIN(ofs+len,state->UpdateFlagsSize)-1)/UPDATEBLOCKSIZE;
+		for(ofs/=UPDATEBLOCKSIZE;ofs<=last;ofs++)
+			state->UpdateFlags[ofs]++;
+	}
+}
+
 static inline void FastMap_PhyClobberFunc(ARMul_State *state,ARMword *addr)
 {
+	FastMap_PhyUpdateFlags(state,addr);
 #ifdef ARMUL_INSTR_FUNC_CACHE
-	*(FastMap_Phy2Func(state,addr)) = FASTMAP_CLOBBEREDFUNC;
+	{
+		FastMapUInt page = (((FastMapUInt)addr)-state->CodePageBase)>>12;
+		if(!state->CodePages[page])
+			return; /* Never executed from, nothing to clobber */
+		*(FastMap_Phy2Func(state,addr)) = FASTMAP_CLOBBEREDFUNC;
+#ifdef ARMUL_BLOCK_CACHE
+		if(state->BlockPages[page])
+			ARMul_BlockCache_InvalidatePage(state,page);
+#endif
+	}
 #else
 	UNUSED_VAR(state);
 	UNUSED_VAR(addr);
@@ -74,11 +120,31 @@ static inline void FastMap_PhyClobberFunc(ARMul_State *state,ARMword *addr)
 
 static inline void FastMap_PhyClobberFuncRange(ARMul_State *state,ARMword *addr,size_t len)
 {
+	FastMap_PhyUpdateFlagsRange(state,addr,len);
 #ifdef ARMUL_INSTR_FUNC_CACHE
-	ARMEmuFunc *func = FastMap_Phy2Func(state,addr);
+	/* Work a page at a time, skipping pages which have never been executed
+	   from. A page which gets completely overwritten goes back to having no
+	   decoded instructions. */
 	while (len>0) {
-		*func++ = FASTMAP_CLOBBEREDFUNC;
-		len -= 4;
+		FastMapUInt ofs = ((FastMapUInt)addr)-state->CodePageBase;
+		size_t amt = 4096-(ofs&4095);
+		if(amt > len)
+			amt = len;
+		if(state->CodePages[ofs>>12])
+		{
+			ARMEmuFuncCache *func = FastMap_Phy2Func(state,addr);
+			size_t i;
+#ifdef ARMUL_BLOCK_CACHE
+			if(state->BlockPages[ofs>>12])
+				ARMul_BlockCache_InvalidatePage(state,ofs>>12);
+#endif
+			for(i=0;i<amt;i+=4)
+				*func++ = FASTMAP_CLOBBEREDFUNC;
+			if(amt == 4096)
+				state->CodePages[ofs>>12] = 0;
+		}
+		addr += amt>>2;
+		len -= amt;
 	}
 #else
 	UNUSED_VAR(state);
@@ -93,6 +159,12 @@ static inline ARMword FastMap_LoadFunc(const FastMapEntry *entry,ARMul_State *st
 	return (entry->AccessFunc)(state,addr,0,0);
 }
 
+static inline ARMword FastMap_FetchFunc(const FastMapEntry *entry,ARMul_State *state,ARMword addr)
+{
+	/* Return instruction fetch result, assumes it's a func */
+	return (entry->AccessFunc)(state,addr,0,FASTMAP_ACCESSFUNC_FETCH);
+}
+
 static inline void FastMap_StoreFunc(const FastMapEntry *entry,ARMul_State *state,ARMword addr,ARMword data,ARMword flags)
 {
 	/* Perform store, assumes it's a func */
@@ -102,6 +174,7 @@ static inline void FastMap_StoreFunc(const FastMapEntry *entry,ARMul_State *stat
 static inline void FastMap_RebuildMapMode(ARMul_State *state)
 {
 	state->FastMapMode = (state->NtransSig?FASTMAP_MODE_MBO|FASTMAP_MODE_SVC:state->OSmode?FASTMAP_MODE_MBO|FASTMAP_MODE_OS:FASTMAP_MODE_MBO|FASTMAP_MODE_USR);
+	ARMul_MapChanged(state);
 }
 
 /* Macros to evaluate DecodeRead/DecodeWrite results
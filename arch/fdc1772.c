@@ -61,6 +61,7 @@ struct FDCStruct{
   uint_least8_t LatchB;
   uint_least16_t LatchAold;
   uint_least16_t LatchBold;
+  CycleCount TimeWhenInUseChanged; /* When the LatchA in-use bit last changed */
   int_least16_t BytesToGo;
   int32_t DelayCount;
   int32_t DelayLatch;
@@ -121,7 +122,7 @@ struct FDCStruct{
 #define TYPE2_BIT_MULTISECTOR (1<<4)
 
 /* Structure containing the state of the floppy drive controller */
-struct FDCStruct FDC;
+#define FDC (*(state->Fdc))
 
 
 static const floppy_format avail_format[] = {
@@ -153,9 +154,9 @@ static void efseek(FILE *fp, long offset, int whence);
 /*--------------------------------------------------------------------------*/
 static void GenInterrupt(ARMul_State *state, const char *reason) {
   DBG(("FDC:GenInterrupt: %s\n",reason));
-  ioc.FIRQStatus |= FIQ_FDIRQ; /* FH1 line on IOC */
+  IOC.FIRQStatus |= FIQ_FDIRQ; /* FH1 line on IOC */
   DBG(("FDC:GenInterrupt FIRQStatus=0x%x Mask=0x%x\n",
-    ioc.FIRQStatus,ioc.FIRQMask));
+    IOC.FIRQStatus,IOC.FIRQMask));
   IO_UpdateNfiq(state);
 } /* GenInterrupt */
 
@@ -222,21 +223,21 @@ void FDC_Regular(ARMul_State *state)
 
 /*--------------------------------------------------------------------------*/
 static void ClearInterrupt(ARMul_State *state) {
-  ioc.FIRQStatus &= ~FIQ_FDIRQ; /* FH1 line on IOC */
+  IOC.FIRQStatus &= ~FIQ_FDIRQ; /* FH1 line on IOC */
   IO_UpdateNfiq(state);
 } /* ClearInterrupt */
 
 /*--------------------------------------------------------------------------*/
 static void GenDRQ(ARMul_State *state) {
   DBG(("FDC_GenDRQ (data=0x%x)\n",FDC.Data));
-  ioc.FIRQStatus |= FIQ_FDDRQ; /* FH0 line on IOC */
+  IOC.FIRQStatus |= FIQ_FDDRQ; /* FH0 line on IOC */
   IO_UpdateNfiq(state);
 } /* GenDRQ */
 
 /*--------------------------------------------------------------------------*/
 static void ClearDRQ(ARMul_State *state) {
   DBG(("FDC_ClearDRQ\n"));
-  ioc.FIRQStatus &= ~FIQ_FDDRQ; /* FH0 line on IOC */
+  IOC.FIRQStatus &= ~FIQ_FDDRQ; /* FH0 line on IOC */
   IO_UpdateNfiq(state);
   FDC.StatusReg&=~BIT_DRQ;
 } /* ClearDRQ */
@@ -250,7 +251,6 @@ static void ClearDRQ(ARMul_State *state) {
  * @param state Emulator state
  */
 void FDC_LatchAChange(ARMul_State *state,uint_fast8_t data) {
-  static CycleCount TimeWhenInUseChanged;
   CycleCount now,diff;
   int_fast8_t bit;
   uint_fast8_t val;
@@ -300,10 +300,10 @@ void FDC_LatchAChange(ARMul_State *state,uint_fast8_t data) {
 
         case 6:
           now=ARMul_Time;
-          diff=now-TimeWhenInUseChanged;
-          DBG(("Floppy In use line now %d (was %s for %"PRIu32" ticks)\n",
+          diff=now-FDC.TimeWhenInUseChanged;
+          DBG(("Floppy In use line now %d (was %s for %"PRIu64" ticks)\n",
                   val?1:0,val?"low":"high",diff));
-          TimeWhenInUseChanged=now;
+          FDC.TimeWhenInUseChanged=now;
           break;
 
         case 7:
@@ -314,7 +314,7 @@ void FDC_LatchAChange(ARMul_State *state,uint_fast8_t data) {
   } /* bit loop */
 
     if (diffmask & 0xf) {
-        FDC_UpdateLEDs();
+        FDC_UpdateLEDs(state);
     }
 
     return;
@@ -864,11 +864,18 @@ void FDC_Write(ARMul_State *state, uint_fast16_t offset, uint_fast8_t data) {
  *
  * Called on program startup, initialise the 1772 disk controller
  *
- * @param state Emulator state IMPROVE unused
+ * @param state Emulator state
+ * @returns false on failure
  */
-void FDC_Init(ARMul_State *state) {
+bool FDC_Init(ARMul_State *state) {
   uint_fast8_t drive;
 
+  state->Fdc = calloc(1,sizeof(struct FDCStruct));
+  if (!state->Fdc) {
+    ControlPane_Error(false,"Couldn't allocate FDC state");
+    return false;
+  }
+
   FDC.StatusReg=0;
   FDC.Track=0;
   FDC.Sector = 0;
@@ -892,26 +899,48 @@ void FDC_Init(ARMul_State *state) {
     if (!FileName)
         continue;
 
-    FDC_InsertFloppy(drive, FileName);
+    FDC_InsertFloppy(state, drive, FileName);
 
   }
 
   FDC.DelayCount=10000;
   FDC.DelayLatch=10000;
+  return true;
 } /* FDC_Init */
 
+/**
+ * FDC_Exit
+ *
+ * Called on shutdown, closes any disc images and frees the FDC state
+ *
+ * @param state Emulator state
+ */
+void FDC_Exit(ARMul_State *state) {
+  uint_fast8_t drive;
+
+  if (!state->Fdc)
+    return;
+  for (drive = 0; drive < 4; drive++) {
+    if (FDC.drive[drive].fp)
+      fclose(FDC.drive[drive].fp);
+  }
+  free(state->Fdc);
+  state->Fdc = NULL;
+} /* FDC_Exit */
+
 /**
  * FDC_InsertFloppy
  *
  * Associate disc image with drive.Drive must be empty
  * on startup or having been previously ejected.
  *
+ * @param state Emulator state
  * @oaram drive Drive number to load image into [0-3]
  * @param image Filename of image to load
  * @returns NULL on success or string of error message
  */
 const char *
-FDC_InsertFloppy(uint_fast8_t drive, const char *image)
+FDC_InsertFloppy(ARMul_State *state, uint_fast8_t drive, const char *image)
 {
   floppy_drive *dr;
   FILE *fp;
@@ -973,11 +1002,12 @@ FDC_InsertFloppy(uint_fast8_t drive, const char *image)
  * Close and forget about the disc image associated with drive.  Disc
  * must be inserted.
  *
+ * @param state Emulator state
  * @param drive Drive number to unload image [0-3]
  * @returns NULL on success or string of error message
  */
 const char *
-FDC_EjectFloppy(uint_fast8_t drive)
+FDC_EjectFloppy(ARMul_State *state, uint_fast8_t drive)
 {
   floppy_drive *dr;
 
@@ -1014,11 +1044,12 @@ FDC_EjectFloppy(uint_fast8_t drive)
  *
  * Check if there's a floppy disc inserted in the specified drive.
  *
+ * @param state Emulator state
  * @param drive Drive number to check [0-3]
  * @returns true if a disc is inserted, false otherwise
  */
 bool
-FDC_IsFloppyInserted(uint_fast8_t drive)
+FDC_IsFloppyInserted(ARMul_State *state, uint_fast8_t drive)
 {
     floppy_drive* dr;
 
@@ -1052,9 +1083,10 @@ static void efseek(FILE *fp, long offset, int whence)
  * X/ControlPane.c  draw_floppy_leds() for an example of
  * how to process the parameter.
  *
+ * @param state Emulator state
  * @param leds_changed Function to callback on LED changes
  */
-void FDC_SetLEDsChangeFunc(void (*leds_changed)(uint_fast8_t))
+void FDC_SetLEDsChangeFunc(ARMul_State *state, void (*leds_changed)(uint_fast8_t))
 {
   assert(leds_changed);
   
@@ -1066,8 +1098,9 @@ void FDC_SetLEDsChangeFunc(void (*leds_changed)(uint_fast8_t))
  *
  * Updates the LED callback with the current state.
  *
+ * @param state Emulator state
  */
-void FDC_UpdateLEDs(void)
+void FDC_UpdateLEDs(ARMul_State *state)
 {
   if (FDC.leds_changed) {
     FDC.leds_changed(~FDC.LatchA & 0xf);
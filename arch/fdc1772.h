@@ -10,9 +10,19 @@
  *
  * Called on program startup, initialise the 1772 disk controller
  *
- * @param state Emulator state IMPROVE unused
+ * @param state Emulator state
+ * @returns false on failure
+ */
+bool FDC_Init(ARMul_State *state);
+
+/**
+ * FDC_Exit
+ *
+ * Called on shutdown, closes any disc images and frees the FDC state
+ *
+ * @param state Emulator state
  */
-void FDC_Init(ARMul_State *state);
+void FDC_Exit(ARMul_State *state);
 
 /**
  * FDC_Read
@@ -62,11 +72,12 @@ void FDC_LatchBChange(ARMul_State *state,uint_fast8_t data);
  * Associate disc image with drive.Drive must be empty
  * on startup or having been previously ejected.
  *
+ * @param state Emulator state
  * @param drive Drive number to load image into [0-3]
  * @param image Filename of image to load
  * @returns NULL on success or string of error message
  */
-const char *FDC_InsertFloppy(uint_fast8_t drive, const char *image);
+const char *FDC_InsertFloppy(ARMul_State *state, uint_fast8_t drive, const char *image);
 
 /**
  * FDC_EjectFloppy
@@ -74,20 +85,22 @@ const char *FDC_InsertFloppy(uint_fast8_t drive, const char *image);
  * Close and forget about the disc image associated with drive.  Disc
  * must be inserted.
  *
+ * @param state Emulator state
  * @param drive Drive number to unload image [0-3]
  * @returns NULL on success or string of error message
  */
-const char *FDC_EjectFloppy(uint_fast8_t drive);
+const char *FDC_EjectFloppy(ARMul_State *state, uint_fast8_t drive);
 
 /**
  * FDC_IsFloppyInserted
  *
  * Check if there's a floppy disc inserted in the specified drive.
  *
+ * @param state Emulator state
  * @param drive Drive number to check [0-3]
  * @returns true if a disc is inserted, false otherwise
  */
-bool FDC_IsFloppyInserted(uint_fast8_t drive);
+bool FDC_IsFloppyInserted(ARMul_State *state, uint_fast8_t drive);
 
 /**
  * FDC_Regular
@@ -109,16 +122,18 @@ void FDC_Regular(ARMul_State *state);
  * X/ControlPane.c  draw_floppy_leds() for an example of
  * how to process the parameter.
  *
+ * @param state Emulator state
  * @param leds_changed Function to callback on LED changes
  */
-void FDC_SetLEDsChangeFunc(void (*leds_changed)(uint_fast8_t leds));
+void FDC_SetLEDsChangeFunc(ARMul_State *state, void (*leds_changed)(uint_fast8_t leds));
 
 /**
  * FDC_UpdateLEDs
  *
  * Updates the LED callback with the current state.
  *
+ * @param state Emulator state
  */
-void FDC_UpdateLEDs(void);
+void FDC_UpdateLEDs(ARMul_State *state);
 
 #endif
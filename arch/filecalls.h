@@ -181,4 +181,13 @@ size_t File_ReadRAM(ARMul_State *state,FILE *pFile,ARMword uAddress,size_t uCoun
  */
 size_t File_WriteRAM(ARMul_State *state,FILE *pFile,ARMword uAddress,size_t uCount);
 
+/**
+ * File_Exit
+ *
+ * Frees the buffers used by File_ReadRAM and File_WriteRAM
+ *
+ * @param state Emulator state
+ */
+void File_Exit(ARMul_State *state);
+
 #endif /* __FILECALLS_H */
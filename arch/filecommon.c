@@ -22,9 +22,56 @@
 
 #define USE_FILEBUFFER
 
-/* Note: Musn't be used as a parameter to ReadEmu/WriteEmu! */
-static ARMword temp_buf_word[32768/4];
-static uint8_t *const temp_buf = (uint8_t *) temp_buf_word;
+#define FILECOMMON (*(state->FileCommon))
+
+/* Per-state buffers for File_ReadRAM and File_WriteRAM, allocated on first
+   use and freed by File_Exit */
+struct FileCommonStruct {
+  /* For memory accessed via FastMap functions. Big enough for the largest
+     chunk those paths handle, i.e. one page plus word alignment */
+  ARMword temp_buf_word[4096/4];
+
+#ifdef USE_FILEBUFFER
+  uint8_t *buffer;
+  size_t buffer_size;
+
+  bool filebuffer_inuse;
+  FILE *filebuffer_file;
+  size_t filebuffer_remain; /* Reads: Total amount left to buffer. Writes: Total amount the user said he was going to write */
+  size_t filebuffer_buffered; /* Reads: How much is currently in the buffer. Writes: Total amount collected by filebuffer_write() */
+  size_t filebuffer_offset; /* Reads/writes: Current offset within buffer */
+#endif
+};
+
+static bool File_InitState(ARMul_State *state)
+{
+  if (state->FileCommon)
+    return true;
+  state->FileCommon = calloc(1, sizeof(struct FileCommonStruct));
+  if (!state->FileCommon) {
+    warn_data("filecommon could not allocate its state\n");
+    return false;
+  }
+  return true;
+}
+
+/**
+ * File_Exit
+ *
+ * Frees the buffers used by File_ReadRAM and File_WriteRAM
+ *
+ * @param state Emulator state
+ */
+void File_Exit(ARMul_State *state)
+{
+  if (!state->FileCommon)
+    return;
+#ifdef USE_FILEBUFFER
+  free(FILECOMMON.buffer);
+#endif
+  free(state->FileCommon);
+  state->FileCommon = NULL;
+}
 
 #ifdef USE_FILEBUFFER
 /* File buffering */
@@ -32,77 +79,68 @@ static uint8_t *const temp_buf = (uint8_t *) temp_buf_word;
 #define MAX_FILEBUFFER (1024*1024)
 #define MIN_FILEBUFFER (32768)
 
-static uint8_t *buffer=0;
-static size_t buffer_size=0;
-
-static void ensure_buffer_size(size_t buffer_size_needed)
+static void ensure_buffer_size(ARMul_State *state,size_t buffer_size_needed)
 {
-  if (buffer_size_needed > buffer_size) {
-    buffer = realloc(buffer, buffer_size_needed);
-    if (!buffer) {
+  if (buffer_size_needed > FILECOMMON.buffer_size) {
+    FILECOMMON.buffer = realloc(FILECOMMON.buffer, buffer_size_needed);
+    if (!FILECOMMON.buffer) {
       warn_data("filecommon could not increase buffer size to %"PRIuSIZE" bytes\n",
               buffer_size_needed);
     }
-    buffer_size = buffer_size_needed;
+    FILECOMMON.buffer_size = buffer_size_needed;
   }
 }
 
-bool filebuffer_inuse = false;
-FILE *filebuffer_file = NULL;
-size_t filebuffer_remain = 0; /* Reads: Total amount left to buffer. Writes: Total amount the user said he was going to write */
-size_t filebuffer_buffered = 0; /* Reads: How much is currently in the buffer. Writes: Total amount collected by filebuffer_write() */
-size_t filebuffer_offset = 0; /* Reads/writes: Current offset within buffer */
-
-static void filebuffer_fill(void)
+static void filebuffer_fill(ARMul_State *state)
 {
-  size_t temp = MIN(filebuffer_remain,MAX_FILEBUFFER);
-  filebuffer_offset = 0;
-  filebuffer_buffered = fread(buffer,1,temp,filebuffer_file);
-  if(filebuffer_buffered != temp)
-    filebuffer_remain = 0;
+  size_t temp = MIN(FILECOMMON.filebuffer_remain,MAX_FILEBUFFER);
+  FILECOMMON.filebuffer_offset = 0;
+  FILECOMMON.filebuffer_buffered = fread(FILECOMMON.buffer,1,temp,FILECOMMON.filebuffer_file);
+  if(FILECOMMON.filebuffer_buffered != temp)
+    FILECOMMON.filebuffer_remain = 0;
   else
-    filebuffer_remain -= filebuffer_buffered;
+    FILECOMMON.filebuffer_remain -= FILECOMMON.filebuffer_buffered;
 }
 
-static void filebuffer_initread(FILE *pFile,size_t uCount)
+static void filebuffer_initread(ARMul_State *state,FILE *pFile,size_t uCount)
 {
   size_t temp;
-  filebuffer_inuse = false;
-  filebuffer_file = pFile;
+  FILECOMMON.filebuffer_inuse = false;
+  FILECOMMON.filebuffer_file = pFile;
   if(uCount <= MIN_FILEBUFFER)
     return;
-  filebuffer_inuse = true;
+  FILECOMMON.filebuffer_inuse = true;
   temp = MIN(uCount,MAX_FILEBUFFER);
-  ensure_buffer_size(temp);
-  filebuffer_remain = uCount;
-  filebuffer_fill();
+  ensure_buffer_size(state,temp);
+  FILECOMMON.filebuffer_remain = uCount;
+  filebuffer_fill(state);
 }
 
-static size_t filebuffer_read(uint8_t *pBuffer,size_t uCount,bool endian)
+static size_t filebuffer_read(ARMul_State *state,uint8_t *pBuffer,size_t uCount,bool endian)
 {
   size_t ret, avail;
-  if(!filebuffer_inuse)
+  if(!FILECOMMON.filebuffer_inuse)
   {
     if(endian)
-      return File_ReadEmu(filebuffer_file,pBuffer,uCount);
+      return File_ReadEmu(FILECOMMON.filebuffer_file,pBuffer,uCount);
     else
-      return fread(pBuffer,1,uCount,filebuffer_file);
+      return fread(pBuffer,1,uCount,FILECOMMON.filebuffer_file);
   }
   ret = 0;
   while(uCount)
   {
-    if(filebuffer_buffered == filebuffer_offset)
+    if(FILECOMMON.filebuffer_buffered == FILECOMMON.filebuffer_offset)
     {
-      if(!filebuffer_remain)
+      if(!FILECOMMON.filebuffer_remain)
         return ret;
-      filebuffer_fill();
+      filebuffer_fill(state);
     }
-    avail = MIN(uCount,filebuffer_buffered-filebuffer_offset);
+    avail = MIN(uCount,FILECOMMON.filebuffer_buffered-FILECOMMON.filebuffer_offset);
     if(endian)
-      InvByteCopy(pBuffer,buffer+filebuffer_offset,avail);
+      InvByteCopy(pBuffer,FILECOMMON.buffer+FILECOMMON.filebuffer_offset,avail);
     else
-      memcpy(pBuffer,buffer+filebuffer_offset,avail);
-    filebuffer_offset += avail;
+      memcpy(pBuffer,FILECOMMON.buffer+FILECOMMON.filebuffer_offset,avail);
+    FILECOMMON.filebuffer_offset += avail;
     ret += avail;
     pBuffer += avail;
     uCount -= avail;
@@ -110,72 +148,72 @@ static size_t filebuffer_read(uint8_t *pBuffer,size_t uCount,bool endian)
   return ret;
 }
 
-static void filebuffer_initwrite(FILE *pFile,size_t uCount)
+static void filebuffer_initwrite(ARMul_State *state,FILE *pFile,size_t uCount)
 {
   size_t temp;
-  filebuffer_inuse = false;
-  filebuffer_file = pFile;
-  filebuffer_remain = uCount; /* Actually treated as total writeable */
-  filebuffer_buffered = 0;
+  FILECOMMON.filebuffer_inuse = false;
+  FILECOMMON.filebuffer_file = pFile;
+  FILECOMMON.filebuffer_remain = uCount; /* Actually treated as total writeable */
+  FILECOMMON.filebuffer_buffered = 0;
   if(uCount <= MIN_FILEBUFFER)
     return;
-  filebuffer_inuse = true;
+  FILECOMMON.filebuffer_inuse = true;
   temp = MIN(uCount,MAX_FILEBUFFER);
-  ensure_buffer_size(temp);
-  filebuffer_offset = 0;
+  ensure_buffer_size(state,temp);
+  FILECOMMON.filebuffer_offset = 0;
 }
 
-static void filebuffer_write(uint8_t *pBuffer,size_t uCount,bool endian)
+static void filebuffer_write(ARMul_State *state,uint8_t *pBuffer,size_t uCount,bool endian)
 {
-  if(filebuffer_remain == filebuffer_buffered)
+  if(FILECOMMON.filebuffer_remain == FILECOMMON.filebuffer_buffered)
     return;
-  if(!filebuffer_inuse)
+  if(!FILECOMMON.filebuffer_inuse)
   {
     size_t temp;
-    uCount = MIN(uCount,filebuffer_remain-filebuffer_buffered);
+    uCount = MIN(uCount,FILECOMMON.filebuffer_remain-FILECOMMON.filebuffer_buffered);
     if(endian)
-      temp = File_WriteEmu(filebuffer_file,pBuffer,uCount);
+      temp = File_WriteEmu(FILECOMMON.filebuffer_file,pBuffer,uCount);
     else
-      temp = fwrite(pBuffer,1,uCount,filebuffer_file);
-    filebuffer_buffered += temp;
+      temp = fwrite(pBuffer,1,uCount,FILECOMMON.filebuffer_file);
+    FILECOMMON.filebuffer_buffered += temp;
     if(temp != uCount)
-      filebuffer_remain = filebuffer_buffered;
+      FILECOMMON.filebuffer_remain = FILECOMMON.filebuffer_buffered;
      return;
   }
   while(uCount)
   {
-    size_t temp = MIN(uCount,buffer_size-filebuffer_offset);
+    size_t temp = MIN(uCount,FILECOMMON.buffer_size-FILECOMMON.filebuffer_offset);
     if(endian)
-      ByteCopy(buffer+filebuffer_offset,pBuffer,temp);
+      ByteCopy(FILECOMMON.buffer+FILECOMMON.filebuffer_offset,pBuffer,temp);
     else
-      memcpy(buffer+filebuffer_offset,pBuffer,temp);
-    filebuffer_offset += temp;
+      memcpy(FILECOMMON.buffer+FILECOMMON.filebuffer_offset,pBuffer,temp);
+    FILECOMMON.filebuffer_offset += temp;
     uCount -= temp;
     pBuffer += temp;
-    if(filebuffer_offset == buffer_size)
+    if(FILECOMMON.filebuffer_offset == FILECOMMON.buffer_size)
     {
       /* Flush */
-      size_t temp2 = fwrite(buffer,1,filebuffer_offset,filebuffer_file);
-      filebuffer_buffered += temp2;
-      if(temp2 != filebuffer_offset)
+      size_t temp2 = fwrite(FILECOMMON.buffer,1,FILECOMMON.filebuffer_offset,FILECOMMON.filebuffer_file);
+      FILECOMMON.filebuffer_buffered += temp2;
+      if(temp2 != FILECOMMON.filebuffer_offset)
       {
-        filebuffer_remain = filebuffer_buffered;
+        FILECOMMON.filebuffer_remain = FILECOMMON.filebuffer_buffered;
         return;
       }
-      filebuffer_offset = 0;
+      FILECOMMON.filebuffer_offset = 0;
     }
   }
 }
 
-static size_t filebuffer_endwrite(void)
+static size_t filebuffer_endwrite(ARMul_State *state)
 {
-  if(filebuffer_inuse && filebuffer_offset)
+  if(FILECOMMON.filebuffer_inuse && FILECOMMON.filebuffer_offset)
   {
     /* Flush */
-    size_t temp2 = fwrite(buffer,1,filebuffer_offset,filebuffer_file);
-    filebuffer_buffered += temp2;
+    size_t temp2 = fwrite(FILECOMMON.buffer,1,FILECOMMON.filebuffer_offset,FILECOMMON.filebuffer_file);
+    FILECOMMON.filebuffer_buffered += temp2;
   }
-  return filebuffer_buffered;
+  return FILECOMMON.filebuffer_buffered;
 }
 #endif
 
@@ -198,11 +236,13 @@ size_t File_ReadEmu(FILE *pFile,uint8_t *pBuffer,size_t uCount)
      the data will need endian swapping after reading, but we can't guarantee
      that we'll read all uCount bytes, so we can't easily pre-swap the buffer
      to avoid losing the original contents of the first/last words) */
+  ARMword temp_buf_word[4096/4];
+  uint8_t *temp_buf = (uint8_t *) temp_buf_word;
   size_t ret = 0;
   while(uCount > 0)
   {
     int offset = ((int) pBuffer)&3;
-    size_t count2 = MIN(sizeof(temp_buf)-offset,uCount);
+    size_t count2 = MIN(sizeof(temp_buf_word)-offset,uCount);
     size_t read = fread(temp_buf+offset,1,count2,pFile);
     InvByteCopy(pBuffer,temp_buf+offset,read);
     ret += read;
@@ -233,11 +273,13 @@ size_t File_WriteEmu(FILE *pFile,const uint8_t *pBuffer,size_t uCount)
 {
 #ifdef HOST_BIGENDIAN
   /* Split into chunks and copy into the temp buffer */
+  ARMword temp_buf_word[4096/4];
+  uint8_t *temp_buf = (uint8_t *) temp_buf_word;
   size_t ret = 0;
   while(uCount > 0)
   {
     int offset = ((int) pBuffer)&3;
-    size_t count2 = MIN(sizeof(temp_buf)-offset,uCount);
+    size_t count2 = MIN(sizeof(temp_buf_word)-offset,uCount);
     ByteCopy(temp_buf+offset,pBuffer,count2);
     size_t written = fwrite(temp_buf+offset,1,count2,pFile);
     ret += written;
@@ -266,8 +308,12 @@ size_t File_WriteEmu(FILE *pFile,const uint8_t *pBuffer,size_t uCount)
 size_t File_ReadRAM(ARMul_State *state, FILE *pFile,ARMword uAddress,size_t uCount)
 {
   size_t ret = 0;
+  uint8_t *temp_buf;
+  if (!File_InitState(state))
+    return 0;
+  temp_buf = (uint8_t *) FILECOMMON.temp_buf_word;
 #ifdef USE_FILEBUFFER
-  filebuffer_initread(pFile,uCount);
+  filebuffer_initread(state,pFile,uCount);
 #endif
 
   while(uCount > 0)
@@ -303,7 +349,7 @@ size_t File_ReadRAM(ARMul_State *state, FILE *pFile,ARMword uAddress,size_t uCou
       }
 
 #ifdef USE_FILEBUFFER
-      temp = filebuffer_read(phy,amt,true);
+      temp = filebuffer_read(state,phy,amt,true);
 #else
       temp = File_ReadEmu(pFile,phy,amt);
 #endif
@@ -324,7 +370,7 @@ size_t File_ReadRAM(ARMul_State *state, FILE *pFile,ARMword uAddress,size_t uCou
       ARMword *w;
       /* Read into temp buffer */
 #ifdef USE_FILEBUFFER
-      size_t temp = filebuffer_read(temp_buf+(uAddress&3),amt,false);
+      size_t temp = filebuffer_read(state,temp_buf+(uAddress&3),amt,false);
 #else
       size_t temp = fread(temp_buf+(uAddress&3),1,amt,pFile);
 #endif
@@ -387,11 +433,16 @@ size_t File_ReadRAM(ARMul_State *state, FILE *pFile,ARMword uAddress,size_t uCou
  */
 size_t File_WriteRAM(ARMul_State *state, FILE *pFile,ARMword uAddress,size_t uCount)
 {
-#ifdef USE_FILEBUFFER
-  filebuffer_initwrite(pFile,uCount);
-#else
+  uint8_t *temp_buf;
+#ifndef USE_FILEBUFFER
   size_t ret = 0;
 #endif
+  if (!File_InitState(state))
+    return 0;
+  temp_buf = (uint8_t *) FILECOMMON.temp_buf_word;
+#ifdef USE_FILEBUFFER
+  filebuffer_initwrite(state,pFile,uCount);
+#endif
 
   while(uCount > 0)
   {
@@ -425,7 +476,7 @@ size_t File_WriteRAM(ARMul_State *state, FILE *pFile,ARMword uAddress,size_t uCo
       }        
 
 #ifdef USE_FILEBUFFER
-      filebuffer_write(phy,amt,true);
+      filebuffer_write(state,phy,amt,true);
       /* Update state */
       uAddress += (ARMword)amt;
       uCount -= amt;
@@ -460,7 +511,7 @@ size_t File_WriteRAM(ARMul_State *state, FILE *pFile,ARMword uAddress,size_t uCo
       }
 
 #ifdef USE_FILEBUFFER
-      filebuffer_write(temp,amt,false);
+      filebuffer_write(state,temp,amt,false);
       /* Update state */
       uCount -= amt;
 #else
@@ -483,7 +534,7 @@ size_t File_WriteRAM(ARMul_State *state, FILE *pFile,ARMword uAddress,size_t uCo
     }
   }
 #ifdef USE_FILEBUFFER
-  return filebuffer_endwrite();
+  return filebuffer_endwrite(state);
 #else
   return ret;
 #endif
@@ -0,0 +1,555 @@
+/*
+  FPA floating point coprocessor
+
+  Part of Arcem released under the GNU GPL, see file COPYING
+  for details.
+
+  Registers are held as host doubles and results are rounded to single
+  precision where the instruction asks for it; extended precision is
+  treated as double. The memory formats (including the 3 word extended
+  format used by LDFE/STFE and LFM/SFM) are converted exactly.
+
+  Only the exceptions which can be spotted cheaply from the operands and
+  the result are raised: IVO, DVZ and OFL (the ones RISC OS enables traps
+  for). An exception whose trap is enabled makes the instruction bounce to
+  the undefined instruction vector without changing any state, the same as
+  real FPA hardware handing work to its support code. Packed decimal
+  transfers and undefined opcodes bounce the same way.
+
+ */
+#include "../armdefs.h"
+
+#ifdef ARMUL_COPRO_SUPPORT
+#include "../armcopro.h"
+#include "../armemu.h"
+#include "ControlPane.h"
+#include "fpa.h"
+
+#include <math.h>
+#include <string.h>
+
+#define FPA_SYSTEM_ID       UINT32_C(0x81000000) /* FPA10 */
+#define FPA_FPSR_WRITABLE   UINT32_C(0x001f1f1f) /* Trap enables, control bits, cumulative flags */
+#define FPA_TRAP_SHIFT      16
+
+#define FPA_EXC_IVO         0x01 /* Invalid operation */
+#define FPA_EXC_DVZ         0x02 /* Division by zero */
+#define FPA_EXC_OFL         0x04 /* Overflow */
+
+#define FPA_XFER_MAX        12   /* LFM/SFM of four registers */
+
+struct FPAStruct {
+  double F[8];                 /* F0-F7 */
+  ARMword FPSR;                /* Status register */
+  ARMword FPCR;                /* Control register */
+  ARMword Xfer[FPA_XFER_MAX];  /* Words of the LDC/STC in progress */
+  unsigned XferCount, XferPos;
+};
+
+#define FPA (*(state->Fpa))
+
+static const double FPA_Constants[8] = { 0.0, 1.0, 2.0, 3.0, 4.0, 5.0, 0.5, 10.0 };
+
+/* Release builds use -ffast-math, so NaNs and infinities are spotted by
+   looking at the bits rather than trusting comparisons */
+static inline uint64_t FPA_Bits(double d)
+{
+  uint64_t u;
+  memcpy(&u,&d,sizeof(u));
+  return u;
+}
+
+static inline double FPA_FromBits(uint64_t u)
+{
+  double d;
+  memcpy(&d,&u,sizeof(d));
+  return d;
+}
+
+#define FPA_DOUBLE_EXP  UINT64_C(0x7ff0000000000000)
+#define FPA_DOUBLE_SIGN UINT64_C(0x8000000000000000)
+
+static inline bool FPA_IsNaN(double d)
+{
+  return (FPA_Bits(d) & ~FPA_DOUBLE_SIGN) > FPA_DOUBLE_EXP;
+}
+
+static inline bool FPA_IsFinite(double d)
+{
+  return (FPA_Bits(d) & FPA_DOUBLE_EXP) != FPA_DOUBLE_EXP;
+}
+
+static inline bool FPA_IsZero(double d)
+{
+  return !(FPA_Bits(d) & ~FPA_DOUBLE_SIGN);
+}
+
+/**
+ * FPA_Raise
+ *
+ * Record exceptions in the cumulative flags of the FPSR, unless one of
+ * them is trapped.
+ *
+ * @param state Emulator state
+ * @param exc   FPA_EXC_* bits
+ * @returns false if the instruction must bounce to the support code
+ */
+static bool FPA_Raise(ARMul_State *state, ARMword exc)
+{
+  if (FPA.FPSR & (exc << FPA_TRAP_SHIFT))
+    return false;
+  FPA.FPSR |= exc;
+  return true;
+}
+
+/* Round to an integral value, using the rounding mode in bits 5-6 */
+static double FPA_RoundInt(double d, ARMword mode)
+{
+  double f;
+
+  if (!FPA_IsFinite(d))
+    return d;
+  switch (mode) {
+    case 1: return ceil(d);
+    case 2: return floor(d);
+    case 3: return (d < 0) ? ceil(d) : floor(d);
+    default:
+      /* Nearest, ties to even */
+      f = floor(d);
+      if ((d - f > 0.5) || ((d - f == 0.5) && (fmod(f,2.0) != 0)))
+        f += 1.0;
+      return f;
+  }
+}
+
+/* Round to the destination precision given by bits 19 & 7 */
+static inline double FPA_Precision(ARMword instr, double d)
+{
+  if (!BIT(19) && !BIT(7))
+    return (double) (float) d;
+  return d;
+}
+
+static inline double FPA_Fm(ARMul_State *state, ARMword instr)
+{
+  return BIT(3) ? FPA_Constants[BITS(0,2)] : FPA.F[BITS(0,2)];
+}
+
+/***************************************************************************\
+*                        Memory format conversion                           *
+\***************************************************************************/
+
+/* Extended precision: sign and 15 bit exponent in the first word, then a
+   64 bit mantissa with an explicit integer bit */
+static void FPA_ToExtended(double d, ARMword *w)
+{
+  uint64_t bits = FPA_Bits(d);
+  uint64_t mant = bits & ~(FPA_DOUBLE_SIGN | FPA_DOUBLE_EXP);
+  int exp = (int) ((bits & FPA_DOUBLE_EXP) >> 52);
+
+  w[0] = (ARMword) (bits >> 32) & 0x80000000;
+  if (exp == 0x7ff) {
+    /* Infinity or NaN, keeping the quiet bit in place */
+    w[0] |= 0x7fff;
+    mant <<= 11;
+  } else if (exp == 0) {
+    if (!mant) {
+      w[1] = w[2] = 0;
+      return;
+    }
+    /* Denormal, which is normal in extended precision */
+    exp = 1;
+    while (!(mant & (UINT64_C(1) << 52))) {
+      mant <<= 1;
+      exp--;
+    }
+    w[0] |= (ARMword) (exp - 1023 + 16383);
+    mant <<= 11;
+  } else {
+    w[0] |= (ARMword) (exp - 1023 + 16383);
+    mant = (mant | (UINT64_C(1) << 52)) << 11;
+  }
+  w[1] = (ARMword) (mant >> 32);
+  w[2] = (ARMword) mant;
+}
+
+static double FPA_FromExtended(const ARMword *w)
+{
+  uint64_t sign = ((uint64_t) (w[0] & 0x80000000)) << 32;
+  uint64_t mant = (((uint64_t) w[1]) << 32) | w[2];
+  int exp = (int) (w[0] & 0x7fff);
+  double d;
+
+  if (exp == 0x7fff) {
+    mant = (mant << 1) >> 12;
+    if (!mant && ((w[1] & 0x7fffffff) | w[2]))
+      mant = UINT64_C(1) << 51; /* NaN payload was below double precision */
+    return FPA_FromBits(sign | FPA_DOUBLE_EXP | mant);
+  }
+  if (!mant)
+    return FPA_FromBits(sign);
+  if (!exp)
+    exp = 1;
+  d = ldexp((double) mant,exp - 16383 - 63);
+  return sign ? -d : d;
+}
+
+static void FPA_ToWords(ARMul_State *state, ARMword instr, ARMword *w)
+{
+  double d = FPA.F[BITS(12,14)];
+  uint64_t bits;
+  float f;
+
+  switch ((BIT(22) << 1) | BIT(15)) {
+    case 0:
+      f = (float) d;
+      memcpy(w,&f,sizeof(f));
+      break;
+    case 1:
+      /* Doubles are stored high word first */
+      bits = FPA_Bits(d);
+      w[0] = (ARMword) (bits >> 32);
+      w[1] = (ARMword) bits;
+      break;
+    default:
+      FPA_ToExtended(d,w);
+      break;
+  }
+}
+
+static void FPA_FromWords(ARMul_State *state, ARMword instr, const ARMword *w)
+{
+  double *d = &FPA.F[BITS(12,14)];
+  float f;
+
+  switch ((BIT(22) << 1) | BIT(15)) {
+    case 0:
+      memcpy(&f,w,sizeof(f));
+      *d = f;
+      break;
+    case 1:
+      *d = FPA_FromBits((((uint64_t) w[0]) << 32) | w[1]);
+      break;
+    default:
+      *d = FPA_FromExtended(w);
+      break;
+  }
+}
+
+/* Number of words moved by an LDC/STC, or 0 if it isn't supported */
+static unsigned FPA_XferWords(ARMword instr)
+{
+  unsigned n = (BIT(22) << 1) | BIT(15);
+
+  if (CPNum == 2) /* LFM/SFM: 1-3 registers, 0 meaning 4 */
+    return 3 * (n ? n : 4);
+  /* LDF/STF: single, double, extended, packed */
+  return (n == 3) ? 0 : n + 1;
+}
+
+/***************************************************************************\
+*                           Coprocessor interface                           *
+\***************************************************************************/
+
+/**
+ * FPA_Initialise
+ *
+ * Allocate and reset the FPA state.
+ *
+ * @param state Emulator state
+ * @returns Bool of successful initialisation
+ */
+static bool FPA_Initialise(ARMul_State *state)
+{
+  state->Fpa = calloc(1,sizeof(struct FPAStruct));
+  if (!state->Fpa) {
+    ControlPane_Error(false,"Couldn't allocate FPA state");
+    return false;
+  }
+  FPA.FPSR = FPA_SYSTEM_ID;
+  return true;
+}
+
+static bool FPA_Exit(ARMul_State *state)
+{
+  free(state->Fpa);
+  state->Fpa = NULL;
+  return true;
+}
+
+/**
+ * FPA_LDC
+ *
+ * LDF (CP1) and LFM (CP2). The words arrive one per ARMul_DATA call and
+ * the registers are only written once the last one is in.
+ */
+static unsigned FPA_LDC(ARMul_State *state, unsigned type, ARMword instr, ARMword value)
+{
+  unsigned i;
+
+  switch (type) {
+    case ARMul_FIRST:
+      FPA.XferCount = FPA_XferWords(instr);
+      FPA.XferPos = 0;
+      return FPA.XferCount ? ARMul_DONE : ARMul_CANT;
+
+    case ARMul_DATA:
+      FPA.Xfer[FPA.XferPos++] = value;
+      if (FPA.XferPos < FPA.XferCount)
+        return ARMul_INC;
+      if (CPNum == 2) {
+        for (i = 0; i < FPA.XferCount; i += 3)
+          FPA.F[(BITS(12,14) + i/3) & 7] = FPA_FromExtended(&FPA.Xfer[i]);
+      } else {
+        FPA_FromWords(state,instr,FPA.Xfer);
+      }
+      return ARMul_DONE;
+  }
+  return ARMul_DONE;
+}
+
+/**
+ * FPA_STC
+ *
+ * STF (CP1) and SFM (CP2). The words are converted up front and handed
+ * out one per ARMul_DATA call.
+ */
+static unsigned FPA_STC(ARMul_State *state, unsigned type, ARMword instr, ARMword *value)
+{
+  unsigned i;
+
+  switch (type) {
+    case ARMul_FIRST:
+      FPA.XferCount = FPA_XferWords(instr);
+      FPA.XferPos = 0;
+      if (!FPA.XferCount)
+        return ARMul_CANT;
+      if (CPNum == 2) {
+        for (i = 0; i < FPA.XferCount; i += 3)
+          FPA_ToExtended(FPA.F[(BITS(12,14) + i/3) & 7],&FPA.Xfer[i]);
+      } else {
+        FPA_ToWords(state,instr,FPA.Xfer);
+      }
+      return ARMul_DONE;
+
+    case ARMul_DATA:
+      *value = FPA.Xfer[FPA.XferPos++];
+      return (FPA.XferPos < FPA.XferCount) ? ARMul_INC : ARMul_DONE;
+  }
+  return ARMul_DONE;
+}
+
+/**
+ * FPA_MCR
+ *
+ * FLT, WFS and WFC.
+ */
+static unsigned FPA_MCR(ARMul_State *state, unsigned type, ARMword instr, ARMword value)
+{
+  if (type != ARMul_FIRST)
+    return ARMul_DONE;
+
+  switch (BITS(20,23)) {
+    case 0x0: /* FLT */
+      if (BIT(19) && BIT(7))
+        return ARMul_CANT;
+      FPA.F[BITS(16,18)] = FPA_Precision(instr,(double) (int32_t) value);
+      return ARMul_DONE;
+
+    case 0x2: /* WFS */
+      FPA.FPSR = (FPA.FPSR & ~FPA_FPSR_WRITABLE) | (value & FPA_FPSR_WRITABLE);
+      return ARMul_DONE;
+
+    case 0x4: /* WFC, privileged */
+      if (R15MODE == USER26MODE)
+        return ARMul_CANT;
+      FPA.FPCR = value;
+      return ARMul_DONE;
+  }
+  return ARMul_CANT;
+}
+
+/**
+ * FPA_MRC
+ *
+ * FIX, RFS, RFC and the compares (which must target r15, and return the
+ * flags in bits 28-31).
+ */
+static unsigned FPA_MRC(ARMul_State *state, unsigned type, ARMword instr, ARMword *value)
+{
+  double fn, fm, d;
+
+  if (type != ARMul_FIRST)
+    return ARMul_DONE;
+
+  switch (BITS(20,23)) {
+    case 0x1: /* FIX */
+      fm = FPA.F[BITS(0,2)];
+      d = FPA_RoundInt(fm,BITS(5,6));
+      if (FPA_IsNaN(fm) || !(d < 2147483648.0) || (d < -2147483648.0)) {
+        if (!FPA_Raise(state,FPA_EXC_IVO))
+          return ARMul_CANT;
+        *value = (FPA_IsNaN(fm) || (d < 0)) ? UINT32_C(0x80000000) : UINT32_C(0x7fffffff);
+      } else {
+        *value = (ARMword) (int32_t) d;
+      }
+      return ARMul_DONE;
+
+    case 0x3: /* RFS */
+      *value = FPA.FPSR;
+      return ARMul_DONE;
+
+    case 0x5: /* RFC, privileged */
+      if (R15MODE == USER26MODE)
+        return ARMul_CANT;
+      *value = FPA.FPCR;
+      return ARMul_DONE;
+
+    case 0x9: /* CMF */
+    case 0xb: /* CNF */
+    case 0xd: /* CMFE */
+    case 0xf: /* CNFE */
+      if (BITS(12,15) != 15)
+        return ARMul_CANT;
+      fn = FPA.F[BITS(16,18)];
+      fm = FPA_Fm(state,instr);
+      if (BIT(21))
+        fm = -fm;
+      if (FPA_IsNaN(fn) || FPA_IsNaN(fm)) {
+        /* Unordered; only the E forms complain about it */
+        if (BIT(22) && !FPA_Raise(state,FPA_EXC_IVO))
+          return ARMul_CANT;
+        *value = CBIT | VBIT;
+      } else if (fn == fm) {
+        *value = ZBIT | CBIT;
+      } else if (fn < fm) {
+        *value = NBIT;
+      } else {
+        *value = CBIT;
+      }
+      return ARMul_DONE;
+  }
+  return ARMul_CANT;
+}
+
+/**
+ * FPA_CDP
+ *
+ * The dyadic (bit 15 clear) and monadic (bit 15 set) data operations.
+ */
+static unsigned FPA_CDP(ARMul_State *state, unsigned type, ARMword instr)
+{
+  double fn = 0, fm, r;
+  ARMword exc = 0;
+  bool finite, single = false;
+
+  if (type != ARMul_FIRST)
+    return ARMul_DONE;
+  if (BIT(19) && BIT(7))
+    return ARMul_CANT;
+
+  fm = FPA_Fm(state,instr);
+  if (BIT(15)) {
+    finite = FPA_IsFinite(fm);
+    switch (BITS(20,23)) {
+      case 0x0: r = fm; break;                          /* MVF */
+      case 0x1: r = -fm; break;                         /* MNF */
+      case 0x2: r = fabs(fm); break;                    /* ABS */
+      case 0x3:                                         /* RND */
+      case 0xe: r = FPA_RoundInt(fm,BITS(5,6)); break;  /* URD */
+      case 0x4: r = sqrt(fm); break;                    /* SQT */
+      case 0x5:                                         /* LOG */
+      case 0x6:                                         /* LGN */
+        if (FPA_IsZero(fm))
+          exc = FPA_EXC_DVZ;
+        r = BIT(20) ? log10(fm) : log(fm);
+        break;
+      case 0x7: r = exp(fm); break;                     /* EXP */
+      case 0x8: r = sin(fm); break;                     /* SIN */
+      case 0x9: r = cos(fm); break;                     /* COS */
+      case 0xa: r = tan(fm); break;                     /* TAN */
+      case 0xb: r = asin(fm); break;                    /* ASN */
+      case 0xc: r = acos(fm); break;                    /* ACS */
+      case 0xd: r = atan(fm); break;                    /* ATN */
+      default:  r = fm; break;                          /* NRM */
+    }
+    if (FPA_IsNaN(r) && !FPA_IsNaN(fm))
+      exc |= FPA_EXC_IVO;
+  } else {
+    fn = FPA.F[BITS(16,18)];
+    finite = FPA_IsFinite(fn) && FPA_IsFinite(fm);
+    switch (BITS(20,23)) {
+      case 0x0: r = fn + fm; break;                     /* ADF */
+      case 0x1: r = fn * fm; break;                     /* MUF */
+      case 0x2: r = fn - fm; break;                     /* SUF */
+      case 0x3: r = fm - fn; break;                     /* RSF */
+      case 0x6: r = pow(fn,fm); break;                  /* POW */
+      case 0x7: r = pow(fm,fn); break;                  /* RPW */
+      case 0x8: r = remainder(fn,fm); break;            /* RMF */
+      case 0x9: r = fn * fm; single = true; break;      /* FML */
+      case 0xc: r = atan2(fm,fn); break;                /* POL */
+      case 0x4:                                         /* DVF */
+      case 0x5:                                         /* RDF */
+      case 0xa:                                         /* FDV */
+      case 0xb:                                         /* FRD */
+        if (BIT(20)) {
+          double t = fn;
+          fn = fm;
+          fm = t;
+        }
+        if (FPA_IsZero(fm) && finite && !FPA_IsZero(fn))
+          exc = FPA_EXC_DVZ;
+        r = fn / fm;
+        single = BIT(23);
+        break;
+      default:
+        return ARMul_CANT;
+    }
+    if (FPA_IsNaN(r) && !FPA_IsNaN(fn) && !FPA_IsNaN(fm))
+      exc |= FPA_EXC_IVO;
+  }
+
+  r = single ? (double) (float) r : FPA_Precision(instr,r);
+  if (!exc && finite && !FPA_IsFinite(r) && !FPA_IsNaN(r))
+    exc = FPA_EXC_OFL;
+  if (exc && !FPA_Raise(state,exc))
+    return ARMul_CANT;
+  FPA.F[BITS(12,14)] = r;
+  return ARMul_DONE;
+}
+
+/* CP1 carries everything but LFM/SFM, and owns the state */
+static const ARMul_CoPro FPACoPro1 = {
+  FPA_Initialise,     /* CPInit */
+  FPA_Exit,           /* CPExit */
+  FPA_LDC,            /* LDC */
+  FPA_STC,            /* STC */
+  FPA_MRC,            /* MRC */
+  FPA_MCR,            /* MCR */
+  FPA_CDP             /* CDP */
+};
+
+static const ARMul_CoPro FPACoPro2 = {
+  NULL,               /* CPInit */
+  NULL,               /* CPExit */
+  FPA_LDC,            /* LDC */
+  FPA_STC,            /* STC */
+  ARMul_NoCoPro4W,    /* MRC */
+  ARMul_NoCoPro4R,    /* MCR */
+  ARMul_NoCoPro3R     /* CDP */
+};
+
+/**
+ * FPA_CoProAttach
+ *
+ * Attach the FPA floating point coprocessor to CP1 and CP2.
+ *
+ * @param state Emulator state
+ */
+void FPA_CoProAttach(ARMul_State *state)
+{
+  ARMul_CoProAttach(state, 1, &FPACoPro1);
+  ARMul_CoProAttach(state, 2, &FPACoPro2);
+}
+
+#endif
@@ -0,0 +1,25 @@
+/*
+  FPA floating point coprocessor
+
+  Part of Arcem released under the GNU GPL, see file COPYING
+  for details.
+
+  Implements the FPA10 instruction set natively using host doubles, so
+  that floating point code doesn't have to trap into the guest's
+  FPEmulator. Data processing, register transfer and LDF/STF use CP1;
+  LFM/SFM use CP2.
+
+ */
+#ifndef FPA_H
+#define FPA_H
+
+/**
+ * FPA_CoProAttach
+ *
+ * Attach the FPA floating point coprocessor to CP1 and CP2.
+ *
+ * @param state Emulator state
+ */
+void FPA_CoProAttach(ARMul_State *state);
+
+#endif
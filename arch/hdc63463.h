@@ -19,7 +19,9 @@ void HDC_Write(ARMul_State *state, uint_fast16_t offset, uint_fast16_t data);
 /* Read from HDC memory space */
 uint_fast16_t HDC_Read(ARMul_State *state, uint_fast16_t offset);
 
-void HDC_Init(ARMul_State *state);
+bool HDC_Init(ARMul_State *state);
+
+void HDC_Exit(ARMul_State *state);
 
 void HDC_Regular(ARMul_State *state);
 
@@ -1,6 +1,7 @@
 /* (c) David Alan Gilbert 1995 - see Readme file for copying info */
 /* SaveCMOS contributed by Richard York */
 #include <stdio.h>
+#include <stdlib.h>
 #include <time.h>
 #include "../armdefs.h"
 
@@ -30,9 +31,9 @@ static const char *I2CStateNameTrans[] = {"Idle",
                                           "AckAfterReceiveData" };
 */
 
-#define I2CDATAREAD ((ioc.ControlReg & (ioc.ControlRegInputData)) & 1)
-#define I2CCLOCKREAD ((ioc.ControlReg & 2)!=0)
-#define I2CDATAWRITE(v) { /*warn_i2c("I2C data write (%d)\n",v); */ ioc.ControlRegInputData &= ~1; ioc.ControlRegInputData |=v; };
+#define I2CDATAREAD ((IOC.ControlReg & (IOC.ControlRegInputData)) & 1)
+#define I2CCLOCKREAD ((IOC.ControlReg & 2)!=0)
+#define I2CDATAWRITE(v) { /*warn_i2c("I2C data write (%d)\n",v); */ IOC.ControlRegInputData &= ~1; IOC.ControlRegInputData |=v; };
 
 /* Macros taken from bcd.h in the Linux kernel - licensed under GPL2+ */
 #define BCD2BIN(val)    (((val) & 0x0f) + ((val)>>4)*10)
@@ -64,7 +65,7 @@ struct I2CStruct {
   uint8_t WordAddress; /* Note uint8_t - can never be outside Data bounds */
 };
 
-static struct I2CStruct I2C;
+#define I2C (*(state->I2c))
 
 /* These are "sensible" defaults from the git hexcmos file,
    as opposed to "factory" defaults, which are not quite as sensible */
@@ -481,6 +482,12 @@ static bool SetUpCMOS(ARMul_State *state)
 bool
 I2C_Init(ARMul_State *state)
 {
+  state->I2c = calloc(1,sizeof(struct I2CStruct));
+  if (!state->I2c) {
+    ControlPane_Error(false,"Couldn't allocate I2C state");
+    return false;
+  }
+
   I2C.OldDataState = 0;
   I2C.OldClockState = 0;
   I2C.IAmTransmitter = false;
@@ -492,3 +499,11 @@ I2C_Init(ARMul_State *state)
 
   return SetUpCMOS(state);
 } /* I2C_Init */
+
+/* ------------------------------------------------------------------------- */
+void
+I2C_Exit(ARMul_State *state)
+{
+  free(state->I2c);
+  state->I2c = NULL;
+} /* I2C_Exit */
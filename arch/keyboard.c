@@ -1,6 +1,8 @@
 /* arch/keyboard.c -- a model of the Archimedes keyboard. */
 
+#include <stdlib.h>
 #include "armarc.h"
+#include "ControlPane.h"
 #include "dbugsys.h"
 #include "../eventq.h"
 #include "keyboard.h"
@@ -376,10 +378,13 @@ void Keyboard_Poll(ARMul_State *state,CycleCount nowtime)
   }
 }
 
-void Kbd_Init(ARMul_State *state)
+bool Kbd_Init(ARMul_State *state)
 {
-  static arch_keyboard kbd;
-  state->Kbd = &kbd;
+  state->Kbd = calloc(1,sizeof(arch_keyboard));
+  if (!state->Kbd) {
+    ControlPane_Error(false,"Couldn't allocate keyboard state");
+    return false;
+  }
 
   KBD.KbdState            = KbdState_JustStarted;
   KBD.MouseTransEnable    = false;
@@ -397,5 +402,12 @@ void Kbd_Init(ARMul_State *state)
   KBD.leds_changed        = NULL;
 
   EventQ_Insert(state,ARMul_Time+12500,Keyboard_Poll);
+  return true;
+}
+
+void Kbd_Exit(ARMul_State *state)
+{
+  free(state->Kbd);
+  state->Kbd = NULL;
 }
 
@@ -195,7 +195,8 @@ void keyboard_key_changed(struct arch_keyboard *kb, arch_key_id kid,
 void keyboard_key_changed_ex(struct arch_keyboard *kb, uint8_t row,
     uint8_t col, bool up);
 
-void Kbd_Init(ARMul_State *state);
+bool Kbd_Init(ARMul_State *state);
+void Kbd_Exit(ARMul_State *state);
 void Kbd_StartToHost(ARMul_State *state);
 void Kbd_CodeFromHost(ARMul_State *state, uint8_t FromHost);
 
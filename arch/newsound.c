@@ -35,53 +35,71 @@
 #define MAX_BATCH_SIZE 1024
 
 int Sound_BatchSize = 1; /* How many 16*2 sample batches to try to do at once */
-CycleCount Sound_DMARate; /* How many cycles between DMA fetches */
 Sound_StereoSense eSound_StereoSense = Stereo_LeftRight;
 #ifdef SOUND_FUDGERATE_FRAC
 uint32_t Sound_FudgeRate = 1<<24;
 #else
-CycleDiff Sound_FudgeRate = 0;
+int32_t Sound_FudgeRate = 0;
 #endif
 
 uint32_t Sound_HostRate; /* Rate of host sound system, in 1/1024 Hz */
 
 
 static SoundData soundTable[256];
-static ARMword channelAmount[8][2];
 
 #define SOUNDBUFFER_SIZE (16*MAX_BATCH_SIZE) /* Size in stereo pairs. 16x factor is arbitrary, to cope with most of the sensible downsampling factors? */
-static SoundData soundBuffer[2*SOUNDBUFFER_SIZE];
-static uint32_t soundBufferAmt=0; /* Number of stereo pairs buffered */
 #define TIMESHIFT 9 /* Bigger values make the mixing more accurate. But 9 is the biggest value possible to avoid overflows in the 32bit accumulators. */
-static uint32_t soundTime=0; /* Offset into 1st sample pair of buffer */
-static uint32_t soundTimeStep; /* How many source samples (1 byte) per dest sample (2x16 bit), fixed point with TIMESHIFT fraction bits */
-static uint32_t soundScale; /* Output scale factor, 16.16 fixed point */
 #else
-static CycleCount Sound_DMARate; /* How many cycles between DMA fetches */
-static const CycleDiff Sound_FudgeRate = 0;
+static const int32_t Sound_FudgeRate = 0;
 #endif
 
+#define SOUND_GUEST_BATCHSIZE 4 /* DMA fetches per event when the host mustn't affect guest timing: no sound support, or a fixed EmuRate */
+
+struct SoundStruct {
+  uint32_t DMARate; /* How many cycles between DMA fetches */
+  EventQ_Handle DMAEvent; /* Event used for DMA fetches */
+
+  /* Inputs last used by Sound_UpdateDMARate */
+  uint8_t DMAOldSoundFreq;
+  uint_least8_t DMAOldIOEBCR;
+  uint32_t DMAOldEmuRate;
+
+#ifdef SOUND_SUPPORT
+  ARMword channelAmount[8][2];
+
+  SoundData soundBuffer[2*SOUNDBUFFER_SIZE];
+  uint32_t soundBufferAmt; /* Number of stereo pairs buffered */
+  uint32_t soundTime; /* Offset into 1st sample pair of buffer */
+  uint32_t soundTimeStep; /* How many source samples (1 byte) per dest sample (2x16 bit), fixed point with TIMESHIFT fraction bits */
+  uint32_t soundScale; /* Output scale factor, 16.16 fixed point */
+
+  /* Inputs last used by Sound_Process */
+  uint8_t MixOldSoundFreq;
+  uint_least8_t MixOldIOEBCR;
+  uint32_t MixOldHostRate;
+#endif
+};
+
+#define SOUND (*(state->Sound))
+
 static void Sound_UpdateDMARate(ARMul_State *state)
 {
   /* Calculate a new value for how often we should trigger a sound DMA fetch
      Relies on:
      VIDC.SoundFreq - the rate of the sound system we're trying to emulate
      ARMul_EmuRate - roughly how many EventQ clock cycles occur per second
-     ioc.IOEBControlReg - the VIDC clock source */
-  static uint8_t oldsoundfreq = 0;
-  static uint32_t oldemurate = 0;
-  static uint_least8_t oldioebcr = 0;
-  if((VIDC.SoundFreq == oldsoundfreq) && (ARMul_EmuRate == oldemurate) && (ioc.IOEBControlReg == oldioebcr))
+     IOC.IOEBControlReg - the VIDC clock source */
+  if((VIDC.SoundFreq == SOUND.DMAOldSoundFreq) && (ARMul_EmuRate == SOUND.DMAOldEmuRate) && (IOC.IOEBControlReg == SOUND.DMAOldIOEBCR))
     return;
-  oldsoundfreq = VIDC.SoundFreq;
-  oldemurate = ARMul_EmuRate;
-  oldioebcr = ioc.IOEBControlReg;
+  SOUND.DMAOldSoundFreq = VIDC.SoundFreq;
+  SOUND.DMAOldEmuRate = ARMul_EmuRate;
+  SOUND.DMAOldIOEBCR = IOC.IOEBControlReg;
   /* DMA fetches 16 bytes, at a rate of 1000000/(16*(VIDC.SoundFreq+2)) Hz, for a 24MHz VIDC clock
      So for a variable clock, and taking into account ARMul_EmuRate, we get:
-     Sound_DMARate = ARMul_EmuRate*16*(VIDC.SoundFreq+2)*24/VIDC_clk
+     DMARate = ARMul_EmuRate*16*(VIDC.SoundFreq+2)*24/VIDC_clk
  */
-  Sound_DMARate = (CycleCount) ((((uint64_t) ARMul_EmuRate)*(16*24)*(VIDC.SoundFreq+2))/DisplayDev_GetVIDCClockIn());
-/*  warn_sound("UpdateDMARate: f %d r %u -> %u\n",VIDC.SoundFreq,ARMul_EmuRate,Sound_DMARate); */
+  SOUND.DMARate = (uint32_t) ((((uint64_t) ARMul_EmuRate)*(16*24)*(VIDC.SoundFreq+2))/DisplayDev_GetVIDCClockIn(state));
+/*  warn_sound("UpdateDMARate: f %d r %u -> %u\n",VIDC.SoundFreq,ARMul_EmuRate,SOUND.DMARate); */
 }
 
 #ifdef SOUND_SUPPORT
@@ -168,38 +186,38 @@ void Sound_StereoUpdated(ARMul_State *state)
       reg = 8-reg; /* Swap stereo */
     switch (reg) {
       /* Centre */
-      case 4: channelAmount[i][0] = (ARMword) (0.5*65536);
-              channelAmount[i][1] = (ARMword) (0.5*65536);
+      case 4: SOUND.channelAmount[i][0] = (ARMword) (0.5*65536);
+              SOUND.channelAmount[i][1] = (ARMword) (0.5*65536);
               break;
 
       /* Left 100% */
-      case 1: channelAmount[i][0] = (ARMword) (1.0*65536);
-              channelAmount[i][1] = (ARMword) (0.0*65536);
+      case 1: SOUND.channelAmount[i][0] = (ARMword) (1.0*65536);
+              SOUND.channelAmount[i][1] = (ARMword) (0.0*65536);
               break;
       /* Left 83% */
-      case 2: channelAmount[i][0] = (ARMword) (0.83*65536);
-              channelAmount[i][1] = (ARMword) (0.17*65536);
+      case 2: SOUND.channelAmount[i][0] = (ARMword) (0.83*65536);
+              SOUND.channelAmount[i][1] = (ARMword) (0.17*65536);
               break;
       /* Left 67% */
-      case 3: channelAmount[i][0] = (ARMword) (0.67*65536);
-              channelAmount[i][1] = (ARMword) (0.33*65536);
+      case 3: SOUND.channelAmount[i][0] = (ARMword) (0.67*65536);
+              SOUND.channelAmount[i][1] = (ARMword) (0.33*65536);
               break;
 
       /* Right 100% */
-      case 7: channelAmount[i][1] = (ARMword) (1.0*65536);
-              channelAmount[i][0] = (ARMword) (0.0*65536);
+      case 7: SOUND.channelAmount[i][1] = (ARMword) (1.0*65536);
+              SOUND.channelAmount[i][0] = (ARMword) (0.0*65536);
               break;
       /* Right 83% */
-      case 6: channelAmount[i][1] = (ARMword) (0.83*65536);
-              channelAmount[i][0] = (ARMword) (0.17*65536);
+      case 6: SOUND.channelAmount[i][1] = (ARMword) (0.83*65536);
+              SOUND.channelAmount[i][0] = (ARMword) (0.17*65536);
               break;
       /* Right 67% */
-      case 5: channelAmount[i][1] = (ARMword) (0.67*65536);
-              channelAmount[i][0] = (ARMword) (0.33*65536);
+      case 5: SOUND.channelAmount[i][1] = (ARMword) (0.67*65536);
+              SOUND.channelAmount[i][0] = (ARMword) (0.33*65536);
               break;
 
       /* Bad setting - just mute it */
-      default: channelAmount[i][0] = channelAmount[i][1] = 0;
+      default: SOUND.channelAmount[i][0] = SOUND.channelAmount[i][1] = 0;
     }
   }
 }
@@ -210,7 +228,7 @@ void Sound_SoundFreqUpdated(ARMul_State *state)
   UNUSED_VAR(state);
 }
 
-static void Sound_Log2Lin(const uint8_t *in,SoundData *out,int32_t avail)
+static void Sound_Log2Lin(ARMul_State *state,const uint8_t *in,SoundData *out,int32_t avail)
 {
   /* Convert the source log data to linear. Note that no mixing is done here. */
   avail *= 2;
@@ -224,40 +242,40 @@ static void Sound_Log2Lin(const uint8_t *in,SoundData *out,int32_t avail)
     SoundData val1 = soundTable[in[2]];
     SoundData val2 = soundTable[in[1]];
     SoundData val3 = soundTable[in[0]];
-    *out++ = (channelAmount[0][0] * val0)>>16;
-    *out++ = (channelAmount[0][1] * val0)>>16;
-    *out++ = (channelAmount[1][0] * val1)>>16;
-    *out++ = (channelAmount[1][1] * val1)>>16;
-    *out++ = (channelAmount[2][0] * val2)>>16;
-    *out++ = (channelAmount[2][1] * val2)>>16;
-    *out++ = (channelAmount[3][0] * val3)>>16;
-    *out++ = (channelAmount[3][1] * val3)>>16;
+    *out++ = (SOUND.channelAmount[0][0] * val0)>>16;
+    *out++ = (SOUND.channelAmount[0][1] * val0)>>16;
+    *out++ = (SOUND.channelAmount[1][0] * val1)>>16;
+    *out++ = (SOUND.channelAmount[1][1] * val1)>>16;
+    *out++ = (SOUND.channelAmount[2][0] * val2)>>16;
+    *out++ = (SOUND.channelAmount[2][1] * val2)>>16;
+    *out++ = (SOUND.channelAmount[3][0] * val3)>>16;
+    *out++ = (SOUND.channelAmount[3][1] * val3)>>16;
     val0 = soundTable[in[7]];
     val1 = soundTable[in[6]];
     val2 = soundTable[in[5]];
     val3 = soundTable[in[4]];
-    *out++ = (channelAmount[4][0] * val0)>>16;
-    *out++ = (channelAmount[4][1] * val0)>>16;
-    *out++ = (channelAmount[5][0] * val1)>>16;
-    *out++ = (channelAmount[5][1] * val1)>>16;
-    *out++ = (channelAmount[6][0] * val2)>>16;
-    *out++ = (channelAmount[6][1] * val2)>>16;
-    *out++ = (channelAmount[7][0] * val3)>>16;
-    *out++ = (channelAmount[7][1] * val3)>>16;
+    *out++ = (SOUND.channelAmount[4][0] * val0)>>16;
+    *out++ = (SOUND.channelAmount[4][1] * val0)>>16;
+    *out++ = (SOUND.channelAmount[5][0] * val1)>>16;
+    *out++ = (SOUND.channelAmount[5][1] * val1)>>16;
+    *out++ = (SOUND.channelAmount[6][0] * val2)>>16;
+    *out++ = (SOUND.channelAmount[6][1] * val2)>>16;
+    *out++ = (SOUND.channelAmount[7][0] * val3)>>16;
+    *out++ = (SOUND.channelAmount[7][1] * val3)>>16;
     in += 8;
 #else
     int i;
     for(i=0;i<8;i++)
     {
       SoundData val = soundTable[*in++];
-      *out++ = (channelAmount[i][0] * val)>>16;
-      *out++ = (channelAmount[i][1] * val)>>16;
+      *out++ = (SOUND.channelAmount[i][0] * val)>>16;
+      *out++ = (SOUND.channelAmount[i][1] * val)>>16;
     }
 #endif
   }
 }
 
-static int32_t Sound_Mix(SoundData *out,int32_t destavail)
+static int32_t Sound_Mix(ARMul_State *state,SoundData *out,int32_t destavail)
 {
   /* This mixing function performs two roles:
   
@@ -314,11 +332,11 @@ static int32_t Sound_Mix(SoundData *out,int32_t destavail)
      ticks (shifted by TIMESHIFT). 
   */
      
-  const SoundData *in = soundBuffer;
-  int32_t srcavail = soundBufferAmt;
-  uint32_t time = soundTime;
-  const int32_t timestep = soundTimeStep;
-  const uint32_t scale = soundScale;
+  const SoundData *in = SOUND.soundBuffer;
+  int32_t srcavail = SOUND.soundBufferAmt;
+  uint32_t time = SOUND.soundTime;
+  const int32_t timestep = SOUND.soundTimeStep;
+  const uint32_t scale = SOUND.soundScale;
 
   /* We can only generate a destination sample if all the required source
      samples are present. Bias the source sample count by a suitable amount
@@ -426,64 +444,61 @@ static int32_t Sound_Mix(SoundData *out,int32_t destavail)
 
   /* Update globals */
   srcavail += 10+(timestep>>TIMESHIFT);
-  memmove(soundBuffer,in,srcavail*sizeof(SoundData)*2); /* TODO - Improve this. Should only memmove() once we're near the end of the buffer. */
-  soundBufferAmt = srcavail;
-  soundTime = time;
+  memmove(SOUND.soundBuffer,in,srcavail*sizeof(SoundData)*2); /* TODO - Improve this. Should only memmove() once we're near the end of the buffer. */
+  SOUND.soundBufferAmt = srcavail;
+  SOUND.soundTime = time;
 
   /* Return remaining output space */
   return destavail;
 }
 
-static void Sound_DoMix(void)
+static void Sound_DoMix(ARMul_State *state)
 {
   int32_t destavail;
   SoundData *out;
-  if(soundBufferAmt <= 10+(soundTimeStep>>TIMESHIFT))
+  if(SOUND.soundBufferAmt <= 10+(SOUND.soundTimeStep>>TIMESHIFT))
     return;
   /* Get host buffer params */
-  out = Sound_GetHostBuffer(&destavail);
+  out = Sound_GetHostBuffer(state,&destavail);
   if(destavail)
   {
     /* Mix into host buffer */
-    int32_t remain = Sound_Mix(out,destavail);
+    int32_t remain = Sound_Mix(state,out,destavail);
     /* Tell the host */
-    Sound_HostBuffered(out,destavail-remain);
+    Sound_HostBuffered(state,out,destavail-remain);
   }
 }
 
 static void Sound_Process(ARMul_State *state,int32_t avail)
 {
   /* Recalc soundTimeStep */
-  static uint8_t oldsoundfreq=0;
-  static uint_least8_t oldioebcr=0;
-  static uint32_t oldhostrate=0;
-  if((VIDC.SoundFreq != oldsoundfreq) || (ioc.IOEBControlReg != oldioebcr) || (Sound_HostRate != oldhostrate))
+  if((VIDC.SoundFreq != SOUND.MixOldSoundFreq) || (IOC.IOEBControlReg != SOUND.MixOldIOEBCR) || (Sound_HostRate != SOUND.MixOldHostRate))
   {
     uint32_t clockin;
     uint64_t a, b;
-    oldsoundfreq = VIDC.SoundFreq;
-    oldioebcr = ioc.IOEBControlReg;
-    oldhostrate = Sound_HostRate;
+    SOUND.MixOldSoundFreq = VIDC.SoundFreq;
+    SOUND.MixOldIOEBCR = IOC.IOEBControlReg;
+    SOUND.MixOldHostRate = Sound_HostRate;
     /* Arc sample rate has most likely changed; process as much of the existing buffer as possible (using the current step values) */
-    Sound_DoMix();
-    clockin = DisplayDev_GetVIDCClockIn();
+    Sound_DoMix(state);
+    clockin = DisplayDev_GetVIDCClockIn(state);
     /* Arc sound runs at a rate of (clockin*1024)/(24*(VIDC.SoundFreq+2)) in 1/1024Hz units
        We need that divided by Sound_HostRate, and the reciprocal */
     a = ((uint64_t) clockin)*1024;
     b = ((uint64_t) Sound_HostRate)*24*(VIDC.SoundFreq+2);
-    soundTimeStep = (uint32_t)((a<<TIMESHIFT)/b);
-    soundScale = (uint32_t)((b<<16)/a);
-    warn_sound("New sample period %d (VIDC %"PRIu32"MHz) host %"PRIu32"Hz -> timestep %08"PRIx32" scale %08"PRIx32"\n",VIDC.SoundFreq+2,clockin/1000000,Sound_HostRate>>10,soundTimeStep,soundScale);
-    soundTime = 0;
+    SOUND.soundTimeStep = (uint32_t)((a<<TIMESHIFT)/b);
+    SOUND.soundScale = (uint32_t)((b<<16)/a);
+    warn_sound("New sample period %d (VIDC %"PRIu32"MHz) host %"PRIu32"Hz -> timestep %08"PRIx32" scale %08"PRIx32"\n",VIDC.SoundFreq+2,clockin/1000000,Sound_HostRate>>10,SOUND.soundTimeStep,SOUND.soundScale);
+    SOUND.soundTime = 0;
   }
   if(avail)
   {
     /* Log -> lin conversion */
-    Sound_Log2Lin(((uint8_t *) MEMC.PhysRam) + (MEMC.Sptr<<4),soundBuffer+(soundBufferAmt<<1),avail);
-    soundBufferAmt += avail<<4;
+    Sound_Log2Lin(state,((uint8_t *) MEMC.PhysRam) + (MEMC.Sptr<<4),SOUND.soundBuffer+(SOUND.soundBufferAmt<<1),avail);
+    SOUND.soundBufferAmt += avail<<4;
   }
   /* Process this new data */
-  Sound_DoMix();
+  Sound_DoMix(state);
 }
 #endif /* SOUND_SUPPORT */
 
@@ -491,17 +506,31 @@ static void Sound_DMAEvent(ARMul_State *state,CycleCount nowtime)
 {
   int32_t srcbatchsize, avail;
 #ifdef SOUND_SUPPORT
-  int32_t bufspace;
+  int32_t bufspace, mixavail;
+#endif
+  CycleDiff next;
+#ifdef SOUND_FUDGERATE_FRAC
+  uint32_t fudge;
+#else
+  int32_t fudge;
 #endif
-  CycleCount next;
   Sound_UpdateDMARate(state);
 #ifdef SOUND_SUPPORT
-  /* Work out how many source DMA fetches are required to generate Sound_BatchSize dest samples, rounded to nearest (ish) */
-  srcbatchsize = (Sound_BatchSize*soundTimeStep + (8<<TIMESHIFT))>>(TIMESHIFT+4);
-  if(!srcbatchsize)
-    srcbatchsize = 1;
+  if(EmuRate_Fixed(state))
+  {
+    /* Sound_BatchSize & soundTimeStep depend on the host */
+    srcbatchsize = SOUND_GUEST_BATCHSIZE;
+  }
+  else
+  {
+    /* Work out how many source DMA fetches are required to generate Sound_BatchSize dest samples, rounded to nearest (ish) */
+    srcbatchsize = (Sound_BatchSize*SOUND.soundTimeStep + (8<<TIMESHIFT))>>(TIMESHIFT+4);
+    if(!srcbatchsize)
+      srcbatchsize = 1;
+  }
+  mixavail = 0;
 #else
-  srcbatchsize = 4;
+  srcbatchsize = SOUND_GUEST_BATCHSIZE;
 #endif
   /* How many DMA fetches are possible? */
   avail = 0;
@@ -522,7 +551,7 @@ static void Sound_DMAEvent(ARMul_State *state,CycleCount nowtime)
         MEMC.SendC = MEMC.SendN;
         MEMC.SendN = swap;
   
-        ioc.IRQStatus |= IRQB_SIRQ; /* Take sound interrupt on */
+        IOC.IRQStatus |= IRQB_SIRQ; /* Take sound interrupt on */
         IO_UpdateNirq(state);
   
         MEMC.NextSoundBufferValid = false;
@@ -535,21 +564,35 @@ static void Sound_DMAEvent(ARMul_State *state,CycleCount nowtime)
     if(avail > srcbatchsize)
       avail = srcbatchsize;
 #ifdef SOUND_SUPPORT
-    bufspace = (SOUNDBUFFER_SIZE-soundBufferAmt)>>4;
-    if(avail > bufspace)
-      avail = bufspace;
+    /* Don't fetch more than soundBuffer can take, so the guest waits for the
+       host to drain it. With a fixed EmuRate the guest mustn't see that, so
+       it fetches as normal and the samples that don't fit are dropped. */
+    bufspace = (SOUNDBUFFER_SIZE-SOUND.soundBufferAmt)>>4;
+    mixavail = avail;
+    if(mixavail > bufspace)
+    {
+      mixavail = bufspace;
+      if(EmuRate_Fixed(state))
+        warn_sound("*** sound buffer full, dropping %"PRId32" fetches ***\n",avail-bufspace);
+      else
+        avail = bufspace;
+    }
 #endif 
   }
   /* Process data first, so host can adjust fudge rate */
 #ifdef SOUND_SUPPORT
-  Sound_Process(state,avail);
+  Sound_Process(state,mixavail);
 #endif
   /* Work out when to reschedule the event
-     TODO - This is wrong; there's no guarantee the host accepted all the data we wanted to give him */
+     TODO - This is wrong; there's no guarantee the host accepted all the data we wanted to give him
+     With a fixed EmuRate the host's fudge factor is ignored, so that guest
+     timing doesn't depend on how quickly the host consumes the audio */
 #ifdef SOUND_FUDGERATE_FRAC
-  next = (CycleCount) ((((uint64_t) Sound_DMARate)*Sound_FudgeRate*((uint32_t)(avail?avail:srcbatchsize))) >> 24);
+  fudge = (EmuRate_Fixed(state) ? (1<<24) : Sound_FudgeRate);
+  next = (CycleDiff) ((((uint64_t) SOUND.DMARate)*fudge*((uint32_t)(avail?avail:srcbatchsize))) >> 24);
 #else
-  next = Sound_DMARate*(avail?avail:srcbatchsize)+Sound_FudgeRate;
+  fudge = (EmuRate_Fixed(state) ? 0 : Sound_FudgeRate);
+  next = ((CycleDiff) SOUND.DMARate)*(avail?avail:srcbatchsize)+fudge;
 #endif
   /* Clamp to a safe minimum value */
   if(next < 100)
@@ -561,25 +604,39 @@ static void Sound_DMAEvent(ARMul_State *state,CycleCount nowtime)
 
 bool Sound_Init(ARMul_State *state)
 {
+  state->Sound = calloc(1,sizeof(struct SoundStruct));
+  if (!state->Sound) {
+    ControlPane_Error(false,"Couldn't allocate sound state");
+    return false;
+  }
 #ifdef SOUND_SUPPORT
   SoundInitTable();
   Sound_UpdateDMARate(state);
-  EventQ_Insert(state,ARMul_Time+Sound_DMARate,Sound_DMAEvent);
+  SOUND.DMAEvent = EventQ_Insert(state,ARMul_Time+SOUND.DMARate,Sound_DMAEvent);
   return Sound_InitHost(state);
 #else
   Sound_UpdateDMARate(state);
-  EventQ_Insert(state,ARMul_Time+Sound_DMARate,Sound_DMAEvent);
+  SOUND.DMAEvent = EventQ_Insert(state,ARMul_Time+SOUND.DMARate,Sound_DMAEvent);
   return true;
 #endif
 }
 
 void Sound_Shutdown(ARMul_State *state)
 {
-  int idx = EventQ_Find(state,Sound_DMAEvent);
-  if(idx >= 0)
-    EventQ_Remove(state,idx);
+  if (!state->Sound)
+    return;
+
+  EventQ_Remove(state,SOUND.DMAEvent);
 
 #ifdef SOUND_SUPPORT
   Sound_ShutdownHost(state);
 #endif
+
+  free(state->Sound);
+  state->Sound = NULL;
+}
+
+uint32_t Sound_GetDMARate(ARMul_State *state)
+{
+  return SOUND.DMARate;
 }
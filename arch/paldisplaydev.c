@@ -151,8 +151,9 @@ struct PDD_Name(DisplayInfo) {
     uint_fast16_t VIDC_CR; /* Control register value in use for this frame */
     uint32_t Vptr; /* DMA pointer, in bits, as offset from start of phys RAM */
     int FrameSkip; /* Current frame skip counter */
+    EventQ_Handle Event; /* Handle of our event queue entry */
 
-    /* DisplayDev_AutoUpdateFlags logic */
+    /* MEMC.AutoUpdateFlags logic */
 
     int Auto_FrameCount; /* How many frames have passed */
     int Auto_ForceRefresh; /* How many frames caused a forced refresh */
@@ -218,7 +219,7 @@ struct PDD_Name(DisplayInfo) {
 
   Row output for 1X horizontal scaling to same-depth display buffer
 
-  Version for DisplayDev_UseUpdateFlags == 1
+  Version for MEMC.UseUpdateFlags == 1
 
 */
        
@@ -308,7 +309,7 @@ static inline int PDD_Name(RowFunc1XSameByteAligned)(ARMul_State *state,PDD_Row
 
   Row output via ExpandTable
 
-  Version for DisplayDev_UseUpdateFlags == 1
+  Version for MEMC.UseUpdateFlags == 1
 
 */
 
@@ -357,7 +358,7 @@ static inline int PDD_Name(RowFuncExpandTable)(ARMul_State *state,PDD_Row drow,i
 
   Row output for 1X horizontal scaling to same-depth display buffer
 
-  Version for DisplayDev_UseUpdateFlags == 0
+  Version for MEMC.UseUpdateFlags == 0
 
 */
 
@@ -435,7 +436,7 @@ static inline void PDD_Name(RowFunc1XSameByteAlignedNoFlags)(ARMul_State *state,
 
   Row output via ExpandTable
 
-  Version for DisplayDev_UseUpdateFlags == 0
+  Version for MEMC.UseUpdateFlags == 0
 
 */
 
@@ -590,23 +591,23 @@ static void PDD_Name(EventFunc)(ARMul_State *state,CycleCount nowtime)
   DisplayDev_VSync(state);
 
   NewCR = VIDC.ControlReg;
-  ClockIn = 2*DisplayDev_GetVIDCClockIn();
+  ClockIn = 2*DisplayDev_GetVIDCClockIn(state);
   ClockDivider = ClockDividers[NewCR&3];
 
   /* Work out when to reschedule ourselves */
   FramePeriod = (VIDC.Horiz_Cycle*2+2)*(VIDC.Vert_Cycle+1);
   framelength = (CycleCount)((((uint64_t) ARMul_EmuRate)*FramePeriod)*ClockDivider/ClockIn);
   framelength = MAX(framelength,1000);
-  EventQ_Reschedule(state,nowtime+framelength,PDD_Name(EventFunc),EventQ_Find(state,PDD_Name(EventFunc)));
+  EventQ_Reschedule(state,nowtime+framelength,PDD_Name(EventFunc),DC.Event);
 
-  if(DisplayDev_UseUpdateFlags)
+  if(MEMC.UseUpdateFlags)
   {
     /* Handle frame skip */
     if(DC.FrameSkip--)
     {
       return;
     }
-    DC.FrameSkip = DisplayDev_FrameSkip;
+    DC.FrameSkip = MEMC.FrameSkip;
   }
 
   /* Ensure mode changes if pixel clock changed */
@@ -678,12 +679,12 @@ static void PDD_Name(EventFunc)(ARMul_State *state,CycleCount nowtime)
   }
 
   /* Update AutoUpdateFlags */
-  if(DisplayDev_AutoUpdateFlags)
+  if(MEMC.AutoUpdateFlags)
   {
     DC.Auto_FrameCount++;
     if(DC.ForceRefresh)
       DC.Auto_ForceRefresh++;
-    if(DisplayDev_UseUpdateFlags)
+    if(MEMC.UseUpdateFlags)
     {
       /* Assuming refresh rate of 50Hz, disable UpdateFlags if we've been
          running at >=5fps for the last 5 seconds. 5fps is a bit low, but it
@@ -694,8 +695,8 @@ static void PDD_Name(EventFunc)(ARMul_State *state,CycleCount nowtime)
         if(DC.Auto_ForceRefresh >= 25)
         {
           /* Disable */
-          DisplayDev_UseUpdateFlags = 0;
-          DisplayDev_FrameSkip = DC.Auto_FrameCount/DC.Auto_ForceRefresh;
+          MEMC.UseUpdateFlags = 0;
+          MEMC.FrameSkip = DC.Auto_FrameCount/DC.Auto_ForceRefresh;
           ARMul_RebuildFastMap(state);
         }
         DC.Auto_FrameCount = 0;
@@ -711,8 +712,8 @@ static void PDD_Name(EventFunc)(ARMul_State *state,CycleCount nowtime)
         if(DC.Auto_ForceRefresh < 5)
         {
           /* Enable */        
-          DisplayDev_UseUpdateFlags = 1;
-          DisplayDev_FrameSkip = 0;
+          MEMC.UseUpdateFlags = 1;
+          MEMC.FrameSkip = 0;
           ARMul_RebuildFastMap(state);
           /* Ensure the updateflags get reset */
           DC.ForceRefresh = true;
@@ -721,7 +722,7 @@ static void PDD_Name(EventFunc)(ARMul_State *state,CycleCount nowtime)
         else
         {
           /* Adjust frameskip value */
-          DisplayDev_FrameSkip = DC.Auto_FrameCount/DC.Auto_ForceRefresh;
+          MEMC.FrameSkip = DC.Auto_FrameCount/DC.Auto_ForceRefresh;
         }
         DC.Auto_FrameCount = 0;
         DC.Auto_ForceRefresh = 0;
@@ -804,7 +805,7 @@ static void PDD_Name(EventFunc)(ARMul_State *state,CycleCount nowtime)
     if((DC.Vptr & 0x7) || ((Width*BPP)&0x7))
       flags |= ROWFUNC_UNALIGNED;
 
-    if(DisplayDev_UseUpdateFlags)
+    if(MEMC.UseUpdateFlags)
     {
       PDD_Name(FrameFunc)(state,Height,flags);
     }
@@ -813,7 +814,7 @@ static void PDD_Name(EventFunc)(ARMul_State *state,CycleCount nowtime)
       /* Only update if forced, or frameskip has run out */
       if((flags & ROWFUNC_FORCE) || (!DC.FrameSkip))
       {
-        DC.FrameSkip = DisplayDev_FrameSkip;
+        DC.FrameSkip = MEMC.FrameSkip;
 
         PDD_Name(FrameFuncNoFlags)(state,Height,flags);
       }
@@ -1046,20 +1047,14 @@ static bool PDD_Name(Init)(ARMul_State *state,const struct Vidc_Regs *Vidc)
   memset(HOSTDISPLAY.UpdateFlags,0,sizeof(HOSTDISPLAY.UpdateFlags)); /* Initial value in MEMC.UpdateFlags is 1 */   
 
   /* Schedule first update event */
-  EventQ_Insert(state,ARMul_Time+100,PDD_Name(EventFunc));
+  DC.Event = EventQ_Insert(state,ARMul_Time+100,PDD_Name(EventFunc));
 
   return true;
 }
 
 static void PDD_Name(Shutdown)(ARMul_State *state)
 {
-  int idx = EventQ_Find(state,PDD_Name(EventFunc));
-  if(idx >= 0)
-    EventQ_Remove(state,idx);
-  else
-  {
-    ControlPane_Error(true,"Couldn't find PDD_Name(EventFunc)!");
-  }
+  EventQ_Remove(state,DC.Event);
   free(state->Display);
   state->Display = NULL;
 }
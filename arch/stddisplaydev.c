@@ -208,8 +208,9 @@ struct SDD_Name(DisplayInfo) {
     uint32_t Vptr; /* DMA pointer, in bits, as offset from start of phys RAM */
     uint_least16_t LastVinit; /* Last Vinit, so we can sync changes with the frame start */
     int FrameSkip; /* Current frame skip counter */
+    EventQ_Handle Event; /* Handle of our event queue entry */
 
-    /* DisplayDev_AutoUpdateFlags logic */
+    /* MEMC.AutoUpdateFlags logic */
 
     int Auto_FrameCount; /* How many frames have passed */
     int Auto_ForceRefresh; /* How many frames caused a forced refresh */
@@ -344,7 +345,7 @@ typedef void (*SDD_Name(RowFuncNoFlags))(ARMul_State *state,SDD_Row drow);
 
   Screen output for 1X horizontal scaling
 
-  Version for DisplayDev_UseUpdateFlags == 1
+  Version for MEMC.UseUpdateFlags == 1
 
 */
 
@@ -737,7 +738,7 @@ static int SDD_Name(RowFunc8bpp1X)(ARMul_State *state,int row,SDD_Row drow,int f
 
   Screen output for 2X horizontal scaling
 
-  Version for DisplayDev_UseUpdateFlags == 1
+  Version for MEMC.UseUpdateFlags == 1
 
 */
 
@@ -1130,7 +1131,7 @@ static int SDD_Name(RowFunc8bpp2X)(ARMul_State *state,int row,SDD_Row drow,int f
 
   Screen output for 1X horizontal scaling
 
-  Version for DisplayDev_UseUpdateFlags == 0
+  Version for MEMC.UseUpdateFlags == 0
 
 */
 
@@ -1374,7 +1375,7 @@ static void SDD_Name(RowFunc8bpp1XNoFlags)(ARMul_State *state,SDD_Row drow)
 
   Screen output for 2X horizontal scaling
 
-  Version for DisplayDev_UseUpdateFlags == 0
+  Version for MEMC.UseUpdateFlags == 0
 
 */
 
@@ -1849,7 +1850,7 @@ static void SDD_Name(RowStart)(ARMul_State *state,CycleCount nowtime); /* Fill i
 
 static void SDD_Name(Flyback)(ARMul_State *state)
 {
-  CycleCount oldrate = ARMul_EmuRate;
+  uint32_t oldrate = ARMul_EmuRate;
 
   if(DC.FLYBK)
     return;
@@ -1870,7 +1871,7 @@ static void SDD_Name(Flyback)(ARMul_State *state)
     };
   
     const uint_fast16_t NewCR = VIDC.ControlReg;
-    const uint32_t ClockIn = 2*DisplayDev_GetVIDCClockIn();
+    const uint32_t ClockIn = 2*DisplayDev_GetVIDCClockIn(state);
     const uint_fast8_t ClockDivider = ClockDividers[NewCR&3]; 
   
     /* Calculate new line rate */
@@ -1882,7 +1883,7 @@ static void SDD_Name(Flyback)(ARMul_State *state)
 
 static void SDD_Name(Reschedule)(ARMul_State *state,CycleCount nowtime,EventQ_Func func,int row,bool flybk)
 {
-  int rows, idx=0;
+  int rows;
   /* Force frame end just in case registers have been poked mid-frame */
   if(row >= VIDC.Vert_Cycle+1)
   {
@@ -1890,18 +1891,14 @@ static void SDD_Name(Reschedule)(ARMul_State *state,CycleCount nowtime,EventQ_Fu
     flybk = true;
   }
   if(flybk)
-  {
-    EventQ_Func oldfunc = state->EventQ[0].Func;
     SDD_Name(Flyback)(state);
-    idx = EventQ_Find2(state,oldfunc);
-  }
   rows = row-DC.NextRow;
   if(rows < 1)
     rows = 1;
   DC.LastRow = DC.NextRow;
   DC.NextRow = row;
-  nowtime = state->EventQ[0].Time; /* Ignore the supplied time and use the time the event was last scheduled for - should eliminate any slip/skew */
-  EventQ_Reschedule(state,nowtime+rows*DC.LineRate,func,idx);
+  nowtime = EventQ_GetTime(state,DC.Event); /* Ignore the supplied time and use the time the event was last scheduled for - should eliminate any slip/skew */
+  EventQ_Reschedule(state,nowtime+rows*DC.LineRate,func,DC.Event);
 }
 
 static void SDD_Name(DisplayEnd)(ARMul_State *state,CycleCount nowtime)
@@ -1931,7 +1928,7 @@ static void SDD_Name(FrameStart)(ARMul_State *state,CycleCount nowtime)
   };
 
   const uint_fast16_t NewCR = VIDC.ControlReg;
-  const uint32_t ClockIn = 2*DisplayDev_GetVIDCClockIn();
+  const uint32_t ClockIn = 2*DisplayDev_GetVIDCClockIn(state);
   const uint_fast8_t ClockDivider = ClockDividers[NewCR&3];
 
   /* Calculate new line rate */
@@ -1941,7 +1938,7 @@ static void SDD_Name(FrameStart)(ARMul_State *state,CycleCount nowtime)
 
   DC.FLYBK = false;
 
-  if(DisplayDev_UseUpdateFlags)
+  if(MEMC.UseUpdateFlags)
   {
     /* Handle frame skip */
     if(DC.FrameSkip--)
@@ -1949,7 +1946,7 @@ static void SDD_Name(FrameStart)(ARMul_State *state,CycleCount nowtime)
       SDD_Name(SkipFrame)(state,nowtime);
       return;
     }
-    DC.FrameSkip = DisplayDev_FrameSkip;
+    DC.FrameSkip = MEMC.FrameSkip;
   }
 
   /* Ensure mode changes if pixel clock changed */
@@ -2038,12 +2035,12 @@ static void SDD_Name(FrameStart)(ARMul_State *state,CycleCount nowtime)
 #endif
 
   /* Update AutoUpdateFlags */
-  if(DisplayDev_AutoUpdateFlags)
+  if(MEMC.AutoUpdateFlags)
   {
     DC.Auto_FrameCount++;
     if(DC.ForceRefresh || HD.RefreshFlags[0])
       DC.Auto_ForceRefresh++;
-    if(DisplayDev_UseUpdateFlags)
+    if(MEMC.UseUpdateFlags)
     {
       /* Assuming refresh rate of 50Hz, disable UpdateFlags if we've been
          running at >=5fps for the last 5 seconds. 5fps is a bit low, but it
@@ -2054,8 +2051,8 @@ static void SDD_Name(FrameStart)(ARMul_State *state,CycleCount nowtime)
         if(DC.Auto_ForceRefresh >= 25)
         {
           /* Disable */
-          DisplayDev_UseUpdateFlags = 0;
-          DisplayDev_FrameSkip = DC.Auto_FrameCount/DC.Auto_ForceRefresh;
+          MEMC.UseUpdateFlags = 0;
+          MEMC.FrameSkip = DC.Auto_FrameCount/DC.Auto_ForceRefresh;
           ARMul_RebuildFastMap(state);
         }
         DC.Auto_FrameCount = 0;
@@ -2071,8 +2068,8 @@ static void SDD_Name(FrameStart)(ARMul_State *state,CycleCount nowtime)
         if(DC.Auto_ForceRefresh < 5)
         {
           /* Enable */        
-          DisplayDev_UseUpdateFlags = 1;
-          DisplayDev_FrameSkip = 0;
+          MEMC.UseUpdateFlags = 1;
+          MEMC.FrameSkip = 0;
           ARMul_RebuildFastMap(state);
           /* Ensure the updateflags get reset */
           DC.ForceRefresh = true;
@@ -2081,7 +2078,7 @@ static void SDD_Name(FrameStart)(ARMul_State *state,CycleCount nowtime)
         else
         {
           /* Adjust frameskip value */
-          DisplayDev_FrameSkip = DC.Auto_FrameCount/DC.Auto_ForceRefresh;
+          MEMC.FrameSkip = DC.Auto_FrameCount/DC.Auto_ForceRefresh;
         }
         DC.Auto_FrameCount = 0;
         DC.Auto_ForceRefresh = 0;
@@ -2092,7 +2089,7 @@ static void SDD_Name(FrameStart)(ARMul_State *state,CycleCount nowtime)
   /* Set up DMA */
   DC.Vptr = MEMC.Vinit<<7;
 
-  if(DisplayDev_UseUpdateFlags)
+  if(MEMC.UseUpdateFlags)
   {
     /* Schedule for first border row */
     SDD_Name(Reschedule)(state,nowtime,SDD_Name(RowStart),VIDC.Vert_BorderStart+1,false);
@@ -2103,7 +2100,7 @@ static void SDD_Name(FrameStart)(ARMul_State *state,CycleCount nowtime)
        We use the first RefreshFlags entry to detect if any DMA changes have occured since the start of the last frame. If any have, we redraw the entire screen */
     if(DC.ForceRefresh || HD.RefreshFlags[0] || !DC.FrameSkip)
     {
-      DC.FrameSkip = DisplayDev_FrameSkip;
+      DC.FrameSkip = MEMC.FrameSkip;
       HD.RefreshFlags[0] = 0;
 
       /* Schedule for first border row */
@@ -2130,8 +2127,8 @@ static void SDD_Name(FrameEnd)(ARMul_State *state,CycleCount nowtime)
   /* Set up the next frame */
   DC.LastRow = 0;
   DC.NextRow = VIDC.Vert_SyncWidth+1;
-  nowtime = state->EventQ[0].Time; /* Ignore the supplied time and use the time the event was last scheduled for - should eliminate any slip/skew */
-  EventQ_Reschedule(state,nowtime+DC.NextRow*DC.LineRate,SDD_Name(FrameStart),EventQ_Find2(state,SDD_Name(FrameEnd)));
+  nowtime = EventQ_GetTime(state,DC.Event); /* Ignore the supplied time and use the time the event was last scheduled for - should eliminate any slip/skew */
+  EventQ_Reschedule(state,nowtime+DC.NextRow*DC.LineRate,SDD_Name(FrameStart),DC.Event);
 }
 
 static void SDD_Name(RowStart)(ARMul_State *state,CycleCount nowtime)
@@ -2158,7 +2155,7 @@ static void SDD_Name(RowStart)(ARMul_State *state,CycleCount nowtime)
       /* Display */
       if (DC.ModeSupported)
       {
-        if(DisplayDev_UseUpdateFlags)
+        if(MEMC.UseUpdateFlags)
         {
           SDD_Name(DisplayRow)(state,row);
         }
@@ -2226,7 +2223,7 @@ static void SDD_Name(VIDCPutVal)(ARMul_State *state,ARMword address, ARMword dat
       {
         VIDEO_STAT(RefreshFlagsPalette,1,1);
         /* TODO - Make it configurable whether palette changes cause a screen refresh when UseUpdateFlags == false */
-        if(!DC.DirtyPalette && DisplayDev_UseUpdateFlags)
+        if(!DC.DirtyPalette && MEMC.UseUpdateFlags)
         {
           memset(HD.RefreshFlags,0xff,sizeof(HD.RefreshFlags));
         }
@@ -2419,26 +2416,14 @@ static bool SDD_Name(Init)(ARMul_State *state,const struct Vidc_Regs *Vidc)
   memset(HOSTDISPLAY.UpdateFlags,0,sizeof(HOSTDISPLAY.UpdateFlags)); /* Initial value in MEMC.UpdateFlags is 1 */   
 
   /* Schedule first update event */
-  EventQ_Insert(state,ARMul_Time+100,SDD_Name(FrameStart));
+  DC.Event = EventQ_Insert(state,ARMul_Time+100,SDD_Name(FrameStart));
 
   return true;
 }
 
 static void SDD_Name(Shutdown)(ARMul_State *state)
 {
-  int idx = EventQ_Find(state,SDD_Name(FrameStart));
-  if(idx == -1)
-    idx = EventQ_Find(state,SDD_Name(FrameEnd));
-  if(idx == -1)
-    idx = EventQ_Find(state,SDD_Name(RowStart));
-  if(idx == -1)
-    idx = EventQ_Find(state,SDD_Name(DisplayEnd));
-  if(idx >= 0)
-    EventQ_Remove(state,idx);
-  else
-  {
-    ControlPane_Error(true,"Couldn't find SDD event func!");
-  }
+  EventQ_Remove(state,DC.Event);
   free(state->Display);
   state->Display = NULL;
 }
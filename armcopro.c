@@ -21,6 +21,7 @@
 #include "armcopro.h"
 #include "armemu.h"
 #include "arch/cp15.h"
+#include "arch/fpa.h"
 #include "arch/fastmap.h"
 
 #include <assert.h>
@@ -64,12 +65,17 @@ bool ARMul_CoProInit(ARMul_State *state) {
       ARM3_CoProAttach(state);
     }
 
+    /* And the FPA on CP1 & CP2 */
+    if(state->HasFPA) {
+      FPA_CoProAttach(state);
+    }
+
     /* No handlers below here */
 
     for (i = 0; i < 16; i++) {
       /* Call all the initialisation routines */
-     if (state->CoPro[i]->CPInit) {
-       (state->CoPro[i]->CPInit)(state);
+     if (state->CoPro[i]->CPInit && !(state->CoPro[i]->CPInit)(state)) {
+       return false;
      }
    }
    return true;
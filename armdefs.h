@@ -20,20 +20,67 @@
 #define ARMDEFS_HEADER
 
 #include "c99.h"
+#include <time.h>
 
 /* Control caching of instruction handler functions */
 #define ARMUL_INSTR_FUNC_CACHE
 
+/* ARMUL_INSTR_FUNC_INDEX (normally set by the build system) stores the
+   instruction handler cache as 16-bit indices into ARMul_EmuFuncTable instead
+   of as function pointers. This makes the cache 1/2 (32bit hosts) or 1/4
+   (64bit hosts) of the size, at the cost of an extra lookup when fetching. */
+#if defined(ARMUL_INSTR_FUNC_INDEX) && !defined(ARMUL_INSTR_FUNC_CACHE)
+#error "ARMUL_INSTR_FUNC_INDEX requires ARMUL_INSTR_FUNC_CACHE"
+#endif
+
+/* ARMUL_THREADED_DISPATCH (normally set by the build system) switches the
+   interpreter loop to threaded code. Each instruction handler fetches the
+   next instruction itself and tail-calls the next handler, with R15 and the
+   pipeline contents passed along in host registers. Requires GCC or Clang,
+   and the compact handler cache (so that an instruction and its handler fit
+   in a single 64bit value). */
+#if defined(ARMUL_THREADED_DISPATCH) && !defined(__GNUC__)
+#error "ARMUL_THREADED_DISPATCH requires GCC or Clang"
+#endif
+#if defined(ARMUL_THREADED_DISPATCH) && !defined(ARMUL_INSTR_FUNC_INDEX)
+#error "ARMUL_THREADED_DISPATCH requires ARMUL_INSTR_FUNC_INDEX"
+#endif
+
 /* Support coprocessors for ARM3 cache control */
 #define ARMUL_COPRO_SUPPORT
 
+/* Cache straight-line runs of decoded instructions as blocks. Builds on top of
+   the instruction handler cache. */
+#define ARMUL_BLOCK_CACHE
+
+#if defined(ARMUL_BLOCK_CACHE) && !defined(ARMUL_INSTR_FUNC_CACHE)
+#error "ARMUL_BLOCK_CACHE requires ARMUL_INSTR_FUNC_CACHE"
+#endif
+
+/* Translate hot blocks to x86-64 code (the 'native' CPU engine). Uses the
+   System V calling convention, and needs mmap() for executable memory. */
+#if defined(ARMUL_BLOCK_CACHE) && defined(__x86_64__) && defined(__linux__)
+#define ARMUL_NATIVE_X64
+#endif
+
 typedef uint32_t ARMword; /* must be 32 bits wide */
 
 typedef struct ARMul_State ARMul_State;
-extern ARMul_State statestr;
 
 typedef void (*ARMEmuFunc)(ARMul_State *state, ARMword instr);
 
+/* Type of the entries in the instruction handler cache */
+#ifdef ARMUL_INSTR_FUNC_INDEX
+typedef uint16_t ARMEmuFuncCache;
+#define ARMUL_EMUFUNC_TABLE_SIZE 512
+extern ARMEmuFunc ARMul_EmuFuncTable[ARMUL_EMUFUNC_TABLE_SIZE];
+extern void ARMul_EmuFuncTable_Init(void);
+extern void ARMul_EmuFuncCache_Decode(ARMEmuFuncCache *out,const ARMword *instr,size_t count);
+extern uint32_t ARMul_EmuFuncTable_Hash(void);
+#else
+typedef ARMEmuFunc ARMEmuFuncCache;
+#endif
+
 #define LOW false
 #define HIGH true
 
@@ -130,6 +177,7 @@ typedef uintptr_t FastMapUInt;
 #define FASTMAP_ACCESSFUNC_WRITE       0x01UL
 #define FASTMAP_ACCESSFUNC_BYTE        0x02UL /* Only relevant for writes */
 #define FASTMAP_ACCESSFUNC_STATECHANGE 0x04UL /* Only relevant for writes */
+#define FASTMAP_ACCESSFUNC_FETCH       0x08UL /* Only relevant for reads, set for instruction fetches */
 
 #ifdef ARMUL_INSTR_FUNC_CACHE
 #define FASTMAP_CLOBBEREDFUNC 0 /* Value written when a func gets clobbered */
@@ -148,7 +196,7 @@ typedef struct {
 *                               Event queue                                 *
 \***************************************************************************/
 
-/* The event queue is a simple priority queue used for all time-based events
+/* The event queue is a binary heap priority queue used for all time-based events
    external to the CPU. Updating IOC timers, frontend screen output, etc.
 
    The CPU cycle counter is the timer used to trigger the events.
@@ -158,39 +206,41 @@ typedef struct {
    to do either of those will result in an infinite loop where the same event
    is repeatedly triggered without the CPU emulation advancing.
 
-   It's also acceptable for an event to remove itself and schedule several
-   other events, in its place. Just be careful about the order events are
-   inserted, otherwise when you call Remove(0) or RescheduleHead() the head
-   may not be the same as before. Also be wary of timer overflows; any event
-   scheduled for more than MAX_CYCLES_INTO_FUTURE cycles into the future will
-   be considered as having already been triggered and will fire immediately.
+   EventQ_Insert returns a handle which remains valid until the event is
+   removed, however the queue gets reordered. Anything that needs to
+   reschedule or remove an event from outside of its event function should
+   keep hold of the handle rather than searching the queue. It's also
+   acceptable for an event to remove itself and schedule several other events
+   in its place; just remember that RescheduleHead() only refers to the event
+   being run until something else is inserted or rescheduled. The queue grows
+   on demand, so there's no fixed limit on the number of events.
+
+   Time is a 64-bit count of emulated cycles since reset, so it won't wrap
+   within any realistic run time and times can be compared directly.
+
+   The CPU core doesn't check the queue or the IRQ/FIQ state after every
+   instruction; instead it only checks when ARMul_Time reaches the event
+   horizon (state->EventHorizon). This is the time of the head event, or
+   'now' if an interrupt is being requested. Anything which changes the head
+   of the queue, state->Exception or ARMul_Time (other than by advancing it)
+   must call EventQ_UpdateHorizon. The functions in eventq.h do this
+   automatically.
  */
 
-typedef uint32_t CycleCount;
-typedef int32_t CycleDiff;
-#define MAX_CYCLES_INTO_FUTURE INT32_MAX
+typedef uint64_t CycleCount;
+typedef int64_t CycleDiff;
+#define CYCLE_COUNT_NEVER UINT64_MAX /* Time of an event which will never fire */
 
 typedef void (*EventQ_Func)(ARMul_State *state,CycleCount nowtime);
 
+typedef int EventQ_Handle; /* Stable identifier for a queued event */
+
 typedef struct {
   CycleCount Time;  /* When to trigger the event */
   EventQ_Func Func;    /* Function to call */
+  EventQ_Handle Handle; /* Handle of this entry */
 } EventQ_Entry;
 
-#define EVENTQ_SIZE 8
-
-/* NOTE - For speed reasons there aren't any overflow checks in the eventq
-          code, so be aware of how many systems are using the queue. At the
-          moment, these are:
-
-          arch/newsound.c - One entry for sound DMA fetches
-          arch/XXXdisplaydev.c - One entry for screen updates
-          arch/keyboard.c - One entry for keyboard/mouse polling
-          arch/archio.c - One entry for IOC timers
-          arch/archio.c - One entry for FDC & HDC updates
-        = 5 total
-*/
-
 /***************************************************************************\
 *                          Main emulator state                              *
 \***************************************************************************/
@@ -204,8 +254,20 @@ typedef enum ARMStartIns {
 
 typedef struct arch_keyboard arch_keyboard;
 typedef struct Vidc_Regs Vidc_Regs;
+typedef struct DisplayDev DisplayDev;
 typedef struct ArcemConfig_s ArcemConfig;
 typedef struct ARMul_CoPro ARMul_CoPro;
+typedef struct ARMul_Block ARMul_Block;
+typedef struct ARMul_BlockCache ARMul_BlockCache;
+typedef struct MEMCStruct MEMCStruct;
+typedef struct IOCStruct IOCStruct;
+typedef struct HDCStruct HDCStruct;
+typedef struct FDCStruct FDCStruct;
+typedef struct I2CStruct I2CStruct;
+typedef struct SoundStruct SoundStruct;
+typedef struct HostFSStruct HostFSStruct;
+typedef struct FileCommonStruct FileCommonStruct;
+typedef struct FPAStruct FPAStruct;
 
 #define Exception_IRQ (UINT32_C(1) << 27)
 #define Exception_FIQ (UINT32_C(1) << 26)
@@ -226,8 +288,11 @@ struct ARMul_State {
    ARMword Exception;         /* IRQ & FIQ pins */
    ARMword Base;              /* extra hand for base writeback */
    Vidc_Regs *Display;        /* VIDC regs/host display struct */
+   const DisplayDev *DisplayDevice; /* Current display device */
    arch_keyboard *Kbd;        /* Keyboard struct */
    ArcemConfig *Config;
+   MEMCStruct *Memc;          /* MEMC regs & memory */
+   IOCStruct *Ioc;            /* IOC regs */
 
    /* Fastmap stuff */
    FastMapUInt FastMapMode;   /* Current access mode flags */
@@ -235,13 +300,55 @@ struct ARMul_State {
    FastMapUInt FastMapInstrFuncOfs; /* Offset between the RAM/ROM data and the ARMEmuFunc data */
 #endif
    FastMapEntry *FastMap;
+   ARMword FetchPage;         /* Logical page cached for instruction fetches, or ARMul_FETCHPAGE_INVALID */
+   ARMword *FetchData;        /* Host address of FetchPage */
+#ifdef ARMUL_INSTR_FUNC_CACHE
+   ARMEmuFuncCache *FetchFuncs; /* Instruction handler cache for FetchPage */
+   uint8_t *CodePages;        /* One flag per physical page, set once an instruction from it has been decoded */
+   FastMapUInt CodePageBase;  /* Physical address that CodePages[0] corresponds to */
+#endif
+   ARMword *UpdateFlagsBase;  /* Host address of the start of DMA-able RAM */
+   FastMapUInt UpdateFlagsSize; /* Amount of DMA-able RAM to track writes to, or 0 */
+   uint32_t *UpdateFlags;     /* One counter per UPDATEBLOCKSIZE bytes of it, incremented on write */
+
+#ifdef ARMUL_BLOCK_CACHE
+   /* Block cache stuff */
+   bool BlockBreak;           /* Set to force the current block to stop executing */
+   uint32_t BlockMapGen;      /* Incremented whenever the FastMap or FastMapMode changes */
+   ARMul_Block **BlockPages;  /* List of cached blocks for each physical page */
+   FastMapUInt BlockPageBase; /* Physical address that BlockPages[0] corresponds to */
+   ARMul_BlockCache *BlockCache;
+#endif
 
    /* Event queue */
-   EventQ_Entry EventQ[EVENTQ_SIZE];
-   uint_least8_t NumEvents;
+   EventQ_Entry *EventQ;      /* Binary min-heap of events, EventQ[0] is next */
+   int *EventQPos;            /* Heap position of each handle, or next free handle */
+   int NumEvents;
+   int EventQSize;            /* Allocated size of EventQ & EventQPos */
+   EventQ_Handle EventQFree;  /* Head of free handle list, -1 if none */
+   CycleCount EventHorizon;   /* Time at which the core must next check the EventQ & Exception */
 
    /* Enabled CPU features */
-   bool HasSWP, HasCP15;
+   bool HasSWP, HasCP15, HasFPA;
+
+   /* Other peripherals */
+   HDCStruct *Hdc;            /* Hard disc controller */
+   FDCStruct *Fdc;            /* Floppy disc controller */
+   I2CStruct *I2c;            /* I2C bus & CMOS */
+   SoundStruct *Sound;        /* Sound mixer */
+   HostFSStruct *HostFS;      /* HostFS open files etc. */
+   FileCommonStruct *FileCommon; /* File_ReadRAM/File_WriteRAM buffers */
+
+   /* EmuRate tracking */
+   uint32_t EmuRate;          /* An estimate of how many cycles the host is executing per second */
+   CycleCount EmuRateLastUpdateCycle;
+   clock_t EmuRateLastUpdateTime;
+   CycleDiff EmuRateSkippedCycles; /* Cycles skipped by idle loop detection */
+   CycleDiff IdleSleepCycles; /* Skipped cycles which the host hasn't slept for yet */
+
+   /* Real-time pacing */
+   CycleCount PaceBaseCycle;  /* Cycle count corresponding to PaceBaseTime */
+   uint64_t PaceBaseTime;     /* Host monotonic time, in nanoseconds */
 
    /* Less common stuff */   
    ARMword instr, pc;         /* saved register state */
@@ -251,6 +358,7 @@ struct ARMul_State {
 #ifdef ARMUL_COPRO_SUPPORT
    /* Rare stuff */
    const ARMul_CoPro *CoPro[16]; /* coprocessor interface */
+   FPAStruct *Fpa;            /* FPA floating point coprocessor */
 #endif
  };
 
@@ -259,18 +367,17 @@ extern void *state_alloc(int s);
 extern void state_free(void *p);
 #else
 /* If you need special allocation for the state rather than
- * using the usual static global, you can override these functions
+ * using the usual heap block, you can override these functions
  * and provide your own.
  */
 static inline void *state_alloc(int s)
 {
-	UNUSED_VAR(s);
-	return &statestr;
+	return malloc(s);
 }
 
 static inline void state_free(void *p)
 {
-	UNUSED_VAR(p);
+	free(p);
 }
 #endif
  
@@ -291,6 +398,29 @@ int ARMul_DoProg(ARMul_State *state);
 
 #define ARMul_Time (state->NumCycles)
 
+/***************************************************************************\
+*                        Definitons of the block cache                      *
+\***************************************************************************/
+
+#ifdef ARMUL_BLOCK_CACHE
+/* Allocate the block cache, for code contained in the given physical memory.
+   If enable is false only the page table used by the clobber hooks is
+   allocated, and the CPU runs purely from the instruction handler cache. */
+extern bool ARMul_BlockCache_Init(ARMul_State *state,ARMword *base,ARMword size,bool enable);
+extern void ARMul_BlockCache_Exit(ARMul_State *state);
+
+/* Discard all blocks which were built from the given physical page */
+extern void ARMul_BlockCache_InvalidatePage(ARMul_State *state,FastMapUInt page);
+
+/* Called by ARMul_MapChanged. Stops the current block and breaks any chained
+   blocks which relied on the old mapping. */
+static inline void ARMul_BlockCache_MapChanged(ARMul_State *state)
+{
+  state->BlockMapGen++;
+  state->BlockBreak = true;
+}
+#endif
+
 /***************************************************************************\
 *                  Definitons of things to handle aborts                    *
 \***************************************************************************/
@@ -310,12 +440,37 @@ extern void ARMul_Abort(ARMul_State *state, ARMword address);
 extern bool ARMul_MemoryInit(ARMul_State *state);
 extern void ARMul_MemoryExit(ARMul_State *state);
 
+/* Instruction fetches cache the result of the FastMap lookup for the current
+   code page, so that sequential fetches only need to index into it */
+#define ARMul_FETCHPAGE_INVALID 1 /* Never matches a page-aligned address */
+
+static inline void ARMul_FetchCache_Invalidate(ARMul_State *state)
+{
+  state->FetchPage = ARMul_FETCHPAGE_INVALID;
+}
+
+/* Must be called whenever the logical -> physical mapping or the access
+   permissions change */
+static inline void ARMul_MapChanged(ARMul_State *state)
+{
+  ARMul_FetchCache_Invalidate(state);
+#ifdef ARMUL_BLOCK_CACHE
+  ARMul_BlockCache_MapChanged(state);
+#endif
+}
+
 /***************************************************************************\
 *                               ARM Support                                 *
 \***************************************************************************/
 
 /* An estimate of how many cycles the host is executing per second */
-extern uint32_t ARMul_EmuRate;
+#define ARMul_EmuRate (state->EmuRate)
+
+/* Set up the EmuRate code, and real-time pacing if configured. Returns false on failure */
+bool EmuRate_Init(ARMul_State *state);
+
+/* Return the fixed EmuRate from the config, or 0 if it's measured from the host */
+uint32_t EmuRate_Fixed(ARMul_State *state);
 
 /* Reset the EmuRate code, to cope with situations where the emulator has just been resumed after being suspended for a period of time (i.e. > 1 second) */
 void EmuRate_Reset(ARMul_State *state);
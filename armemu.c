@@ -20,14 +20,21 @@
 #include "armdefs.h"
 #include "armemu.h"
 #include "armcopro.h"
+#include "eventq.h"
+#include <string.h>
 #include <time.h>
+#ifdef ARMUL_NATIVE_X64
+#include <stddef.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 #include "prof.h"
 #include "arch/archio.h"
+#include "arch/armarc.h"
+#include "arch/ArcemConfig.h"
 #include "arch/fastmap.h"
 #include "arch/ControlPane.h"
 
-ARMul_State statestr;
-
 typedef struct {
   ARMword instr;
 #ifdef ARMUL_INSTR_FUNC_CACHE
@@ -39,51 +46,117 @@ static const PipelineEntry abortpipe;
 
 static ARMEmuFunc ARMul_Emulate_DecodeInstr(ARMword instr);
 
+#ifdef ARMUL_THREADED_DISPATCH
+/* An instruction and its handler cache index, packed together so that the
+   threaded interpreter can keep its pipeline in registers */
+typedef uint64_t ARMul_ThreadOp;
+
+/* Threaded handler. Executes op, fetches the next instruction, and continues
+   with the handler for next. Only returns when an exception needs taking
+   (with the pipeline written back to pipe), or when the PC has been changed
+   and the block engine should be tried */
+typedef uint_fast8_t (*ARMul_ThreadFunc)(ARMul_State *state,PipelineEntry *pipe,ARMword r15,ARMul_ThreadOp op,ARMul_ThreadOp next,ARMul_ThreadOp next2);
+
+static ARMul_ThreadFunc ARMul_Threaded_DecodeInstr(ARMword instr);
+
+/* Threaded equivalent of each entry in ARMul_EmuFuncTable */
+static ARMul_ThreadFunc ARMul_ThreadFuncTable[ARMUL_EMUFUNC_TABLE_SIZE];
+#endif
+
+#ifdef ARMUL_INSTR_FUNC_INDEX
+/* Every handler which ARMul_Emulate_DecodeInstr can return, indexed by the
+   values held in the handler cache. Entry 0 is FASTMAP_CLOBBEREDFUNC. */
+ARMEmuFunc ARMul_EmuFuncTable[ARMUL_EMUFUNC_TABLE_SIZE];
+
+/* Handler index for each combination of the instruction bits which
+   ARMul_Emulate_DecodeInstr looks at: bits 20-27, bits 4-7, and whether the
+   destination register is R15 */
+static uint16_t ARMul_EmuFuncDecodeTable[8192];
+
+#define EMUFUNC_DECODE_KEY(instr) ((((instr)>>15) & 0x1fe0) | (((instr)>>3) & 0x1e) | ((((instr)>>12) & 0xf) == 0xf))
+#endif
+
+/* Decode an instruction into the form held in the handler cache */
+static inline ARMEmuFuncCache ARMul_Emulate_DecodeInstrCache(ARMword instr)
+{
+#ifdef ARMUL_INSTR_FUNC_INDEX
+  return ARMul_EmuFuncDecodeTable[EMUFUNC_DECODE_KEY(instr)];
+#else
+  return ARMul_Emulate_DecodeInstr(instr);
+#endif
+}
+
+/* Get the handler for a (non-clobbered) handler cache entry */
+static inline ARMEmuFunc ARMul_EmuFuncCache_Func(ARMEmuFuncCache c)
+{
+#ifdef ARMUL_INSTR_FUNC_INDEX
+  return ARMul_EmuFuncTable[c];
+#else
+  return c;
+#endif
+}
+
 /***************************************************************************\
 *                   Load Instruction                                        *
 \***************************************************************************/
+/* Look up the given page for instruction fetching, returning true if it's
+   directly readable (in which case it becomes the cached fetch page) */
+static inline bool
+ARMul_FetchCache_Fill(ARMul_State *state,ARMword page,FastMapEntry **pentry)
+{
+  FastMapEntry *entry = FastMap_GetEntryNoWrap(state,page);
+  FastMapRes res = FastMap_DecodeRead(entry,state->FastMapMode);
+/*  dbug("FetchCache_Fill: %08x maps to entry %08x res %08x (mode %08x pc %08x)\n",page,entry,res,MEMC.FastMapMode,state->Reg[15]); */
+  *pentry = entry;
+  if(!FASTMAP_RESULT_DIRECT(res))
+    return false;
+  state->FetchPage = page;
+  state->FetchData = FastMap_Log2Phy(entry,page);
+#ifdef ARMUL_INSTR_FUNC_CACHE
+  state->FetchFuncs = FastMap_Phy2Func(state,state->FetchData);
+#endif
+  return true;
+}
+
 static inline void
 ARMul_LoadInstr(ARMul_State *state,ARMword addr, PipelineEntry *p)
 {
   FastMapEntry *entry;
-  FastMapRes res;
   state->NumCycles++;
   addr &= 0x3fffffc;
 
   ARMul_CLEARABORT;
   
-  entry = FastMap_GetEntryNoWrap(state,addr);
-  res = FastMap_DecodeRead(entry,state->FastMapMode);
-/*  dbug("LoadInstr: %08x maps to entry %08x res %08x (mode %08x pc %08x)\n",addr,entry,res,MEMC.FastMapMode,state->Reg[15]); */
-  if(FASTMAP_RESULT_DIRECT(res))
+  if(((addr & ~UINT32_C(4095)) == state->FetchPage) || ARMul_FetchCache_Fill(state,addr & ~UINT32_C(4095),&entry))
   {
-    ARMword *data = FastMap_Log2Phy(entry,addr);
-    ARMword instr = *data;
+    uint_fast16_t idx = (addr & 4095)>>2;
+    ARMword instr = state->FetchData[idx];
 #ifdef ARMUL_INSTR_FUNC_CACHE
-    ARMEmuFunc *pfunc = FastMap_Phy2Func(state,data);
-    ARMEmuFunc temp = *pfunc;
+    ARMEmuFuncCache *pfunc = state->FetchFuncs+idx;
+    ARMEmuFuncCache temp = *pfunc;
     if(temp == FASTMAP_CLOBBEREDFUNC)
     {
       /* Decode the instruction */
-      temp = *pfunc = ARMul_Emulate_DecodeInstr(instr);
+      temp = *pfunc = ARMul_Emulate_DecodeInstrCache(instr);
+      FastMap_PhyMarkCode(state,state->FetchData);
     }
 #if 0
-    else if(temp != ARMul_Emulate_DecodeInstr(instr))
+    else if(temp != ARMul_Emulate_DecodeInstrCache(instr))
     {
-      warn("LoadInstr: %08x maps to entry %08x res %08x (mode %08x pc %08x)\n",addr,entry,res,MEMC.FastMapMode,state->Reg[15]);
-      warn("-> data %08x pfunc %08x instr %08x func %08x using ofs %08x\n",data,pfunc,instr,temp,MEMC.FastMapInstrFuncOfs);
-      warn("But should be %08x!\n",ARMul_Emulate_DecodeInstr(instr));
+      warn("LoadInstr: %08x maps to data %08x (mode %08x pc %08x)\n",addr,state->FetchData+idx,MEMC.FastMapMode,state->Reg[15]);
+      warn("-> pfunc %08x instr %08x func %08x using ofs %08x\n",pfunc,instr,temp,MEMC.FastMapInstrFuncOfs);
+      warn("But should be %08x!\n",ARMul_Emulate_DecodeInstrCache(instr));
       ControlPane_Error(true,"AMul_LoadInstr failure");
     }
 #endif
-    p->func = temp;
+    p->func = ARMul_EmuFuncCache_Func(temp);
 #endif
     p->instr = instr;
   }
-  else if(FASTMAP_RESULT_FUNC(res))
+  else if(FASTMAP_RESULT_FUNC(FastMap_DecodeRead(entry,state->FastMapMode)))
   {
     /* Use function, means we can't write back the decode result */
-    ARMword instr = FastMap_LoadFunc(entry,state,addr);
+    ARMword instr = FastMap_FetchFunc(entry,state,addr);
     p->instr = instr;
 #ifdef ARMUL_INSTR_FUNC_CACHE
     p->func = ARMul_Emulate_DecodeInstr(instr);
@@ -102,7 +175,6 @@ static void
 ARMul_LoadInstrTriplet(ARMul_State *state,ARMword addr,PipelineEntry *p)
 {
   FastMapEntry *entry;
-  FastMapRes res;
 
   if (((uint32_t) (addr << 20)) > 0xff000000) {
     ARMul_LoadInstr(state,addr,p);
@@ -116,26 +188,25 @@ ARMul_LoadInstrTriplet(ARMul_State *state,ARMword addr,PipelineEntry *p)
 
   ARMul_CLEARABORT;
   
-  entry = FastMap_GetEntryNoWrap(state,addr);
-  res = FastMap_DecodeRead(entry,state->FastMapMode);
-  if(FASTMAP_RESULT_DIRECT(res))
+  if(((addr & ~UINT32_C(4095)) == state->FetchPage) || ARMul_FetchCache_Fill(state,addr & ~UINT32_C(4095),&entry))
   {
-    ARMword *data = FastMap_Log2Phy(entry,addr);
+    ARMword *data = state->FetchData+((addr & 4095)>>2);
 #ifdef ARMUL_INSTR_FUNC_CACHE
-    ARMEmuFunc *pfunc = FastMap_Phy2Func(state,data);
+    ARMEmuFuncCache *pfunc = state->FetchFuncs+((addr & 4095)>>2);
 #endif
     int i;
     for(i=0;i<3;i++)
     {
       ARMword instr = *data;
 #ifdef ARMUL_INSTR_FUNC_CACHE
-      ARMEmuFunc temp = *pfunc;
+      ARMEmuFuncCache temp = *pfunc;
       if(temp == FASTMAP_CLOBBEREDFUNC)
       {
         /* Decode the instruction */
-        temp = *pfunc = ARMul_Emulate_DecodeInstr(instr);
+        temp = *pfunc = ARMul_Emulate_DecodeInstrCache(instr);
+        FastMap_PhyMarkCode(state,state->FetchData);
       }
-      p->func = temp;
+      p->func = ARMul_EmuFuncCache_Func(temp);
       pfunc++;
 #endif
       p->instr = instr;
@@ -143,7 +214,7 @@ ARMul_LoadInstrTriplet(ARMul_State *state,ARMword addr,PipelineEntry *p)
       p++;
     }
   }
-  else if(FASTMAP_RESULT_FUNC(res))
+  else if(FASTMAP_RESULT_FUNC(FastMap_DecodeRead(entry,state->FastMapMode)))
   {
     /* We would use the function here... except calling the function may alter the mapping (e.g. during first remapped ROM read following a reset)
        So instead we'll just fall back to calling LoadInstr 3 times, since this isn't a very common case anyway */
@@ -185,9 +256,7 @@ ARMul_Align(ARMword address, ARMword data)
 static inline void
 ARMul_NegZero(ARMul_State *state, ARMword result)
 {
-  ARMword flags = state->Reg[15] & ~(NBIT|ZBIT);
-  if (NEG(result))
-      flags |= NBIT;
+  ARMword flags = (state->Reg[15] & ~(NBIT|ZBIT)) | (result & NBIT);
   if (result == 0)
       flags |= ZBIT;
   state->Reg[15] = flags;
@@ -195,46 +264,37 @@ ARMul_NegZero(ARMul_State *state, ARMword result)
 
 
 /***************************************************************************\
-* Assigns the flags after an addition of a and b to give result             *
+* Assigns all four flags after an addition of a and b to give result. The   *
+* carry in (if any) must already be included in result.                     *
 \***************************************************************************/
 
 static inline void
 ARMul_AddFlags(ARMul_State *state, ARMword a, ARMword b, ARMword result)
 {
-  ARMword flags = state->Reg[15] & ~(NBIT|ZBIT|CBIT|VBIT);
+  ARMword flags = (state->Reg[15] & ~(NBIT|ZBIT|CBIT|VBIT)) | (result & NBIT);
   if (result == 0)
     flags |= ZBIT;
-  if ((a | b) >> 30) { /* possible C,V,N to set */
-    if (NEG(result))
-      flags |= NBIT;
-    if ((NEG(a) && (NEG(b) || POS(result))) ||
-        (NEG(b) && POS(result)))
-      flags |= CBIT;
-    if ((NEG(a) && NEG(b) && POS(result)) ||
-        (POS(a) && POS(b) && NEG(result)))
-      flags |= VBIT;
-  }
+  /* Carry out & overflow, computed from the top bits */
+  flags |= (((a & b) | ((a | b) & ~result)) >> 2) & CBIT;
+  flags |= (((a ^ result) & (b ^ result)) >> 3) & VBIT;
   state->Reg[15] = flags;
 }
 
 
 /***************************************************************************\
-* Assigns the flags after an subtraction of a and b to give result          *
+* Assigns all four flags after an subtraction of a and b to give result.    *
+* The borrow in (if any) must already be included in result.                *
 \***************************************************************************/
 
 static inline void
 ARMul_SubFlags(ARMul_State *state, ARMword a, ARMword b, ARMword result)
 {
-  ARMword flags = state->Reg[15] & ~(CBIT|VBIT);
-  if ((a >= b) || ((b | a) >> 31)) {
-    if ((NEG(a) && POS(b)) ||
-        (NEG(a) && POS(result)) ||
-        (POS(b) && POS(result)))
-      flags |= CBIT;
-    if ((NEG(a) && POS(b) && POS(result)) ||
-        (POS(a) && NEG(b) && NEG(result)))
-      flags |= VBIT;
-  }
+  ARMword flags = (state->Reg[15] & ~(NBIT|ZBIT|CBIT|VBIT)) | (result & NBIT);
+  if (result == 0)
+    flags |= ZBIT;
+  /* Not borrow & overflow, computed from the top bits */
+  flags |= (((a & ~b) | ((a | ~b) & ~result)) >> 2) & CBIT;
+  flags |= (((a ^ b) & (a ^ result)) >> 3) & VBIT;
   state->Reg[15] = flags;
 }
 
@@ -651,6 +711,91 @@ static bool StoreByte(ARMul_State *state, ARMword instr, ARMword address)
 }
 
 
+/***************************************************************************\
+* LDM/STM transfers of up to 16 words can touch at most two pages. If both  *
+* are directly accessible the whole transfer is done straight to/from host  *
+* memory, otherwise (access functions, aborts) the per-word path is used.   *
+\***************************************************************************/
+
+typedef struct {
+  ARMword *Data[2];   /* Host address of the words in each page */
+  ARMword Count;      /* Number of words in the first page */
+  ARMword Total;      /* Total number of words */
+} ARMul_MultMem;
+
+static inline bool ARMul_MultMem_Resolve(ARMul_State *state, ARMword instr,
+                                         ARMword address, bool write,
+                                         ARMul_MultMem *mem)
+{
+  FastMapEntry *entry;
+  FastMapRes res;
+  ARMword first = (4096-(address & 4092))>>2;
+
+  if (state->Aborted)
+    return false;
+  entry = FastMap_GetEntry(state,address);
+  res = (write ? FastMap_DecodeWrite(entry,state->FastMapMode) : FastMap_DecodeRead(entry,state->FastMapMode));
+  if (!FASTMAP_RESULT_DIRECT(res))
+    return false;
+  mem->Data[0] = FastMap_Log2Phy(entry,address&~3);
+  mem->Total = LSMNumRegs>>2;
+  if (mem->Total <= first) {
+    mem->Count = mem->Total;
+    mem->Data[1] = NULL;
+    return true;
+  }
+
+  /* Crosses into the next page */
+  address += first<<2;
+  entry = FastMap_GetEntry(state,address);
+  res = (write ? FastMap_DecodeWrite(entry,state->FastMapMode) : FastMap_DecodeRead(entry,state->FastMapMode));
+  if (!FASTMAP_RESULT_DIRECT(res))
+    return false;
+  mem->Data[1] = FastMap_Log2Phy(entry,address&~3);
+  mem->Count = first;
+  return true;
+}
+
+static inline void ARMul_MultMem_Load(ARMul_State *state, ARMword instr,
+                                      const ARMul_MultMem *mem)
+{
+  ARMword *data = mem->Data[0], left = mem->Count, temp;
+  /* This assumes we don't differentiate between N & S cycles */
+  ARMul_CLEARABORT;
+  for (temp = 0; temp < 16; temp++)
+    if (BIT(temp)) {
+      state->Reg[temp] = *(data++);
+      if (!--left)
+        data = mem->Data[1];
+    }
+  state->NumCycles += mem->Total;
+}
+
+static inline void ARMul_MultMem_Store(ARMul_State *state, ARMword instr,
+                                       const ARMul_MultMem *mem, ARMword WBBase)
+{
+  ARMword *data = mem->Data[0], left = mem->Count, temp;
+  /* This assumes we don't differentiate between N & S cycles */
+  ARMul_CLEARABORT;
+  for (temp = 0; !BIT(temp); temp++);
+  *(data++) = state->Reg[temp++];
+  if (!--left)
+    data = mem->Data[1];
+  /* Base is written back after the first register is stored */
+  if (BIT(21) && LHSReg != 15)
+    LSBase = WBBase;
+  for (; temp < 16; temp++)
+    if (BIT(temp)) {
+      *(data++) = state->Reg[temp];
+      if (!--left)
+        data = mem->Data[1];
+    }
+  FastMap_PhyClobberFuncRange(state,mem->Data[0],mem->Count<<2);
+  if (mem->Total > mem->Count)
+    FastMap_PhyClobberFuncRange(state,mem->Data[1],(mem->Total-mem->Count)<<2);
+  state->NumCycles += mem->Total;
+}
+
 /***************************************************************************\
 * This function does the work of loading the registers listed in an LDM     *
 * instruction, when the S bit is clear.  The code here is always increment  *
@@ -661,6 +806,7 @@ static bool StoreByte(ARMul_State *state, ARMword instr, ARMword address)
 static void LoadMult(ARMul_State *state, ARMword instr,
                      ARMword address, ARMword WBBase)
 {ARMword dest, temp, temp2;
+ ARMul_MultMem mem;
 
  UNDEF_LSMNoRegs;
  UNDEF_LSMPCBase;
@@ -675,27 +821,9 @@ static void LoadMult(ARMul_State *state, ARMword instr,
  temp2 = state->Reg[15];
 
     /* Check if we can use the fastmap */
-    if((((uint32_t) (address<<20)) <= 0xfc000000) && !state->Aborted)
-    {
-       FastMapEntry *entry = FastMap_GetEntry(state,address);
-       FastMapRes res = FastMap_DecodeRead(entry,state->FastMapMode);
-       if(FASTMAP_RESULT_DIRECT(res))
-       {
-           ARMword *data, count;
-          /* Do it fast
-             This assumes we don't differentiate between N & S cycles */
-          ARMul_CLEARABORT;
-          data = FastMap_Log2Phy(entry,address&~3);
-          count=0;
-          for(temp=0;temp<16;temp++)
-            if(BIT(temp))
-            {
-              state->Reg[temp] = *(data++);
-              count++;
-            }
-          state->NumCycles += count;
-          goto done;
-       }
+    if (ARMul_MultMem_Resolve(state,instr,address,false,&mem)) {
+       ARMul_MultMem_Load(state,instr,&mem);
+       goto done;
     }
 
     for (temp = 0; !BIT(temp); temp++); /* N cycle first */
@@ -745,6 +873,7 @@ done:
 static void LoadSMult(ARMul_State *state, ARMword instr,
                       ARMword address, ARMword WBBase)
 {ARMword dest, temp, temp2;
+ ARMul_MultMem mem;
 
  UNDEF_LSMNoRegs;
  UNDEF_LSMPCBase;
@@ -766,27 +895,9 @@ static void LoadSMult(ARMul_State *state, ARMword instr,
     }
 
     /* Check if we can use the fastmap */
-    if((((uint32_t) (address<<20)) <= 0xfc000000) && !state->Aborted)
-    {
-       FastMapEntry *entry = FastMap_GetEntry(state,address);
-       FastMapRes res = FastMap_DecodeRead(entry,state->FastMapMode);
-       if(FASTMAP_RESULT_DIRECT(res))
-       {
-          ARMword *data, count;
-          /* Do it fast
-             This assumes we don't differentiate between N & S cycles */
-          ARMul_CLEARABORT;
-          data = FastMap_Log2Phy(entry,address&~3);
-          count=0;
-          for(temp=0;temp<16;temp++)
-            if(BIT(temp))
-            {
-              state->Reg[temp] = *(data++);
-              count++;
-            }
-          state->NumCycles += count;
-          goto done;
-       }
+    if (ARMul_MultMem_Resolve(state,instr,address,false,&mem)) {
+       ARMul_MultMem_Load(state,instr,&mem);
+       goto done;
     }
 
     for (temp = 0; !BIT(temp); temp++); /* N cycle first */
@@ -844,6 +955,7 @@ static void StoreMult(ARMul_State *state, ARMword instr,
                       ARMword address, ARMword WBBase)
 {
     ARMword temp;
+    ARMul_MultMem mem;
 
     UNDEF_LSMNoRegs;
     UNDEF_LSMPCBase;
@@ -856,44 +968,9 @@ static void StoreMult(ARMul_State *state, ARMword instr,
     for (temp = 0; !BIT(temp); temp++); /* N cycle first */
 
     /* Check if we can use the fastmap */
-    if((((uint32_t) (address<<20)) <= 0xfc000000) && !state->Aborted)
-    {
-        FastMapEntry *entry = FastMap_GetEntry(state,address);
-        FastMapRes res = FastMap_DecodeWrite(entry,state->FastMapMode);
-        if(FASTMAP_RESULT_DIRECT(res))
-        {
-            ARMword *data, count;
-#ifdef ARMUL_INSTR_FUNC_CACHE
-            ARMEmuFunc *pfunc;
-#endif
-            /* Do it fast
-               This assumes we don't differentiate between N & S cycles */
-            ARMul_CLEARABORT;
-            data = FastMap_Log2Phy(entry,address&~3);
-            count=1;
-#ifdef ARMUL_INSTR_FUNC_CACHE
-            pfunc = FastMap_Phy2Func(state,data);
-            *(pfunc++) = FASTMAP_CLOBBEREDFUNC;
-#else
-            FastMap_PhyClobberFunc(state,data);
-#endif
-            *(data++) = state->Reg[temp++];
-            if (BIT(21) && LHSReg != 15)
-                LSBase = WBBase;
-            for(;temp<16;temp++)
-                if(BIT(temp))
-                {
-#ifdef ARMUL_INSTR_FUNC_CACHE
-                    *(pfunc++) = FASTMAP_CLOBBEREDFUNC;
-#else
-                    FastMap_PhyClobberFunc(state,data);
-#endif
-                    *(data++) = state->Reg[temp];
-                    count++;
-                }
-            state->NumCycles += count;
-            return;
-        }
+    if (ARMul_MultMem_Resolve(state,instr,address,true,&mem)) {
+        ARMul_MultMem_Store(state,instr,&mem,WBBase);
+        return;
     }
 
     if (state->Aborted) {
@@ -938,6 +1015,7 @@ static void StoreSMult(ARMul_State *state, ARMword instr,
                        ARMword address, ARMword WBBase)
 {
     ARMword temp;
+    ARMul_MultMem mem;
 
     UNDEF_LSMNoRegs;
     UNDEF_LSMPCBase;
@@ -955,44 +1033,9 @@ static void StoreSMult(ARMul_State *state, ARMword instr,
     for (temp = 0; !BIT(temp); temp++); /* N cycle first */
 
     /* Check if we can use the fastmap */
-    if((((uint32_t) (address<<20)) <= 0xfc000000) && !state->Aborted)
-    {
-        FastMapEntry *entry = FastMap_GetEntry(state,address);
-        FastMapRes res = FastMap_DecodeWrite(entry,state->FastMapMode);
-        if(FASTMAP_RESULT_DIRECT(res))
-        {
-            ARMword *data, count;
-#ifdef ARMUL_INSTR_FUNC_CACHE
-            ARMEmuFunc *pfunc;
-#endif
-            /* Do it fast
-               This assumes we don't differentiate between N & S cycles */
-            ARMul_CLEARABORT;
-            data = FastMap_Log2Phy(entry,address&~3);
-            count=1;
-#ifdef ARMUL_INSTR_FUNC_CACHE
-            pfunc = FastMap_Phy2Func(state,data);
-            *(pfunc++) = FASTMAP_CLOBBEREDFUNC;
-#else
-            FastMap_PhyClobberFunc(state,data);
-#endif
-            *(data++) = state->Reg[temp++];
-            if (BIT(21) && LHSReg != 15)
-                LSBase = WBBase;
-            for(;temp<16;temp++)
-                if(BIT(temp))
-                {
-#ifdef ARMUL_INSTR_FUNC_CACHE
-                    *(pfunc++) = FASTMAP_CLOBBEREDFUNC;
-#else
-                    FastMap_PhyClobberFunc(state,data);
-#endif
-                    *(data++) = state->Reg[temp];
-                    count++;
-                }
-            state->NumCycles += count;
-            goto done;
-        }
+    if (ARMul_MultMem_Resolve(state,instr,address,true,&mem)) {
+        ARMul_MultMem_Store(state,instr,&mem,WBBase);
+        goto done;
     }
 
     if (state->Aborted) {
@@ -1037,36 +1080,142 @@ done:
 *                               EmuRate code                                *
 \***************************************************************************/
 
-static CycleCount EmuRate_LastUpdateCycle;
-static clock_t EmuRate_LastUpdateTime;
-uint32_t ARMul_EmuRate = 1000000; /* Start with safe value of 1MHz */
+/* Fixed rate timing. When CONFIG.uEmuRate (or CONFIG.uPaceRate) is set,
+   EmuRate is never measured, so the IOC, sound and video timing seen by the
+   guest depends only on the number of cycles executed.
+
+   Real-time pacing. When CONFIG.uPaceRate is set, a periodic event sleeps the
+   host whenever the emulated clock gets ahead of the host's monotonic clock,
+   so that the emulator runs at that many cycles per second. */
+
+uint32_t EmuRate_Fixed(ARMul_State *state)
+{
+  return (CONFIG.uEmuRate ? CONFIG.uEmuRate : CONFIG.uPaceRate);
+}
+
+#define PACE_EVENTS_PER_SEC 1000 /* How often to check the host clock */
+#define PACE_MAX_LAG 100000000 /* If the host falls more than this many ns behind, give up trying to catch up */
+
+#ifdef CLOCK_MONOTONIC
+static uint64_t Pace_HostTime(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ((uint64_t) ts.tv_sec)*1000000000+ts.tv_nsec;
+}
+
+static void Pace_Sleep(uint64_t ns)
+{
+  struct timespec ts;
+  ts.tv_sec = (time_t) (ns/1000000000);
+  ts.tv_nsec = (long) (ns%1000000000);
+  nanosleep(&ts,NULL);
+}
+
+static void Pace_Rebase(ARMul_State *state,CycleCount nowtime)
+{
+  state->PaceBaseCycle = nowtime;
+  state->PaceBaseTime = Pace_HostTime();
+}
+
+static void Pace_Event(ARMul_State *state,CycleCount nowtime)
+{
+  uint32_t rate = CONFIG.uPaceRate;
+  CycleCount cycles = nowtime-state->PaceBaseCycle;
+  uint64_t target = state->PaceBaseTime + (cycles/rate)*1000000000 + ((cycles%rate)*1000000000)/rate;
+  uint64_t now = Pace_HostTime();
+
+  if(target > now)
+    Pace_Sleep(target-now);
+  else if(now-target > PACE_MAX_LAG)
+    Pace_Rebase(state,nowtime);
+
+  EventQ_RescheduleHead(state,nowtime+rate/PACE_EVENTS_PER_SEC,Pace_Event);
+}
+#endif
+
+#ifdef ARMUL_BLOCK_CACHE
+#define IDLE_SLEEPS_PER_SEC 1000 /* Batch up skipped cycles into sleeps of at least this length */
+
+/* Called when the block cache skips an idle loop ahead to the next event.
+   Without pacing, the host then sleeps for roughly as long as it would have
+   taken to emulate the skipped cycles, so that an idle guest doesn't leave
+   the host spinning from one event to the next. With pacing, Pace_Event
+   takes care of the sleeping. */
+static void EmuRate_IdleSkip(ARMul_State *state,CycleDiff skip)
+{
+  state->NumCycles += skip;
+  state->EmuRateSkippedCycles += skip;
+#ifdef CLOCK_MONOTONIC
+  if(!CONFIG.uPaceRate)
+  {
+    uint32_t rate = ARMul_EmuRate;
+    CycleDiff cycles = state->IdleSleepCycles + skip;
+    if(cycles >= (CycleDiff) (rate/IDLE_SLEEPS_PER_SEC))
+    {
+      Pace_Sleep(((uint64_t) cycles/rate)*1000000000 + (((uint64_t) cycles%rate)*1000000000)/rate);
+      cycles = 0;
+    }
+    state->IdleSleepCycles = cycles;
+  }
+#endif
+}
+#endif
+
+bool EmuRate_Init(ARMul_State *state)
+{
+  if(EmuRate_Fixed(state))
+    ARMul_EmuRate = EmuRate_Fixed(state);
+  else
+    ARMul_EmuRate = 1000000; /* Start with safe value of 1MHz */
+  if(!CONFIG.uPaceRate)
+    return true;
+#ifdef CLOCK_MONOTONIC
+  Pace_Rebase(state,ARMul_Time);
+  EventQ_Insert(state,ARMul_Time+CONFIG.uPaceRate/PACE_EVENTS_PER_SEC,Pace_Event);
+  return true;
+#else
+  ControlPane_Error(false,"Real-time pacing is not available in this build of ArcEm. Exiting");
+  return false;
+#endif
+}
 
 void EmuRate_Reset(ARMul_State *state)
 {
   /* Reset the EmuRate code */
-  EmuRate_LastUpdateCycle = ARMul_Time;
-  EmuRate_LastUpdateTime = clock();
+  state->EmuRateLastUpdateCycle = ARMul_Time;
+  state->EmuRateLastUpdateTime = clock();
+  state->EmuRateSkippedCycles = 0;
+  state->IdleSleepCycles = 0;
+#ifdef CLOCK_MONOTONIC
+  /* Don't try to catch up on time spent suspended */
+  if(CONFIG.uPaceRate)
+    Pace_Rebase(state,ARMul_Time);
+#endif
 }
 
 void EmuRate_Update(ARMul_State *state)
 {
-  uint64_t iocrate;
   clock_t nowtime, timediff;
   CycleCount nowcycle = ARMul_Time;
-  CycleDiff cycles = nowcycle-EmuRate_LastUpdateCycle;
+  CycleDiff cycles = nowcycle-state->EmuRateLastUpdateCycle;
+  /* Nothing to do if the rate is fixed */
+  if(EmuRate_Fixed(state))
+    return;
   /* Ignore if not much time has passed */
   if(cycles < 40000)
     return;
   nowtime = clock();
-  timediff = nowtime-EmuRate_LastUpdateTime;
+  timediff = nowtime-state->EmuRateLastUpdateTime;
   if(timediff < 10)
     return;
 
-  EmuRate_LastUpdateCycle = nowcycle;
-  EmuRate_LastUpdateTime = nowtime;
+  state->EmuRateLastUpdateCycle = nowcycle;
+  state->EmuRateLastUpdateTime = nowtime;
 
-  /* Update IOC timers before we calculate the new value */
-  UpdateTimerRegisters(state);
+  /* Only count the cycles which were actually emulated */
+  cycles -= state->EmuRateSkippedCycles;
+  state->EmuRateSkippedCycles = 0;
 
   /* Calculate new rate */
   
@@ -1085,15 +1234,9 @@ void EmuRate_Update(ARMul_State *state)
 #endif
 
   /* Recalculate IOC rates */
+  IO_UpdateEmuRate(state);
 
-  iocrate = (((uint64_t) 2000000)<<16)/ARMul_EmuRate;
-  ioc.InvIOCRate = (uint32_t) ((((uint64_t) ARMul_EmuRate)<<16)/2000000);
-  ioc.IOCRate = (uint32_t) iocrate;
-
-  /* Update IOC timers again, to ensure the next interrupt occurs at the right time */
-  UpdateTimerRegisters(state);
-
-  /*dbug("EmuRate %d IOC %.4f InvIOC %.4f\n",ARMul_EmuRate,((float)ioc.IOCRate)/65536,((float)ioc.InvIOCRate)/65536);  */
+  /*dbug("EmuRate %d IOC %.4f InvIOC %.4f\n",ARMul_EmuRate,((float)IOC.IOCRate)/65536,((float)IOC.InvIOCRate)/65536);  */
 }
 
 /***************************************************************************\
@@ -1119,6 +1262,50 @@ static ARMEmuFunc ARMul_Emulate_DecodeInstr(ARMword instr) {
   return f;
 } /* ARMul_Emulate_DecodeInstr */
 
+#ifdef ARMUL_INSTR_FUNC_INDEX
+/* Build ARMul_EmuFuncTable & ARMul_EmuFuncDecodeTable by running the decoder
+   over every combination of the bits it looks at */
+void ARMul_EmuFuncTable_Init(void)
+{
+  uint_fast16_t key, count = 1;
+  for(key=0;key<8192;key++)
+  {
+    ARMword instr = ((key & 0x1fe0)<<15) | ((key & 0x1e)<<3) | ((key & 1) ? 0xf000 : 0);
+    ARMEmuFunc f = ARMul_Emulate_DecodeInstr(instr);
+    uint_fast16_t i;
+    for(i=1;(i<count) && (ARMul_EmuFuncTable[i] != f);i++) {}
+    if(i == count)
+    {
+      if(count == ARMUL_EMUFUNC_TABLE_SIZE)
+        ControlPane_Error(true,"ARMUL_EMUFUNC_TABLE_SIZE is too small");
+#ifdef ARMUL_THREADED_DISPATCH
+      ARMul_ThreadFuncTable[count] = ARMul_Threaded_DecodeInstr(instr);
+#endif
+      ARMul_EmuFuncTable[count++] = f;
+    }
+    ARMul_EmuFuncDecodeTable[key] = i;
+  }
+}
+
+/* Decode a run of instructions straight into the handler cache format */
+void ARMul_EmuFuncCache_Decode(ARMEmuFuncCache *out,const ARMword *instr,size_t count)
+{
+  while(count--)
+    *out++ = ARMul_Emulate_DecodeInstrCache(*instr++);
+}
+
+/* Hash of the handler index assignment, so that handler caches which are
+   saved by one build aren't picked up by another */
+uint32_t ARMul_EmuFuncTable_Hash(void)
+{
+  uint32_t hash = 2166136261u;
+  uint_fast16_t key;
+  for(key=0;key<8192;key++)
+    hash = (hash ^ ARMul_EmuFuncDecodeTable[key]) * 16777619u;
+  return hash;
+}
+#endif
+
 /* Pipeline entry used for prefetch aborts */
 static const PipelineEntry abortpipe = {
   ARMul_ABORTWORD
@@ -1129,12 +1316,33 @@ static const PipelineEntry abortpipe = {
 
 #define FLATPIPE
 
+#if defined(ARMUL_BLOCK_CACHE) && !defined(FLATPIPE)
+#error "ARMUL_BLOCK_CACHE requires FLATPIPE"
+#endif
+
 #ifdef FLATPIPE
 #define PIPESIZE 3
 #else
 #define PIPESIZE 4 /* 3 or 4. 4 seems to be slightly faster? */
 #endif
 
+/* Called once ARMul_Time reaches the event horizon. Triggers any events which
+   are due, recalculates the horizon, and returns the exceptions (if any)
+   which need taking given the interrupt mask in r15 */
+static inline ARMword ARMul_ServiceEvents(ARMul_State *state,ARMword r15)
+{
+  CycleCount local_time = ARMul_Time;
+  while(local_time >= state->EventQ[0].Time)
+  {
+    EventQ_Func func = state->EventQ[0].Func;
+    Prof_BeginFunc(func);
+    (func)(state,local_time);
+    Prof_EndFunc(func);
+  }
+  EventQ_UpdateHorizon(state);
+  return state->Exception &~r15;
+}
+
 static inline void execute_instruction(ARMul_State *state,const PipelineEntry *entry,ARMword r15)
 {
   ARMword instr = entry->instr;
@@ -1151,6 +1359,997 @@ static inline void execute_instruction(ARMul_State *state,const PipelineEntry *e
   }
 }
 
+#ifdef ARMUL_BLOCK_CACHE
+/***************************************************************************\
+*                               Block cache                                 *
+\***************************************************************************/
+
+/* The block cache holds straight-line runs of decoded instructions, to avoid
+   the cost of going through the FastMap for every instruction fetch.
+
+   Blocks are keyed by physical address and never cross a 4K page boundary.
+   Each block also contains the two words which follow its last instruction,
+   as these will have been fetched by the pipeline by the time the last
+   instruction executes. This means the block executor never has to perform
+   a real instruction fetch, and a block can only be entered at an address
+   which isn't one of the last two words of a page.
+
+   Writes to a physical page which contains blocks will discard all of the
+   blocks for that page (via FastMap_PhyClobberFunc). Any change to the
+   FastMap or FastMapMode stops the current block and breaks any chained
+   blocks, to ensure the correct code and access permissions are used.
+
+   When execution can't continue from a block (e.g. block invalidated, or
+   running off the end of the page), the remaining pipeline contents are
+   handed back to ARMul_Emulate26. */
+
+#define BLOCK_MAX_OPS 32    /* Maximum number of instructions in a block */
+#define BLOCK_LOOKAHEAD 2   /* Number of prefetched words held after the last instruction */
+#define BLOCK_POOL_SIZE 4096 /* Number of blocks */
+#define BLOCK_HASH_SIZE 8192 /* Number of hash buckets, must be power of 2 */
+
+#define BLOCK_WORDS_PER_PAGE (4096/4)
+
+typedef struct {
+  ARMul_Block *Block;     /* Block to continue execution in */
+  uint32_t Serial;        /* Serial number of Block when the link was made */
+  uint32_t MapGen;        /* state->BlockMapGen when the link was made */
+  ARMword Addr;           /* Logical address the link is valid for */
+} ARMul_BlockLink;
+
+/* Block-level handlers
+
+   Each instruction in a block can optionally have a block-level handler,
+   which is called in place of the normal handler from the instruction cache.
+   These take the pipeline entry along with some pre-decoded operands, and
+   come in two flavours:
+
+   Pre-decoded handlers are used for the common data processing instructions
+   with an immediate operand. The register numbers and rotated immediate are
+   extracted once when the block is built, rather than on every execution.
+   Only instructions which don't read or write R15 are handled this way.
+
+   Superinstructions execute a common pair of instructions in one dispatch,
+   saving a trip around the block executor loop for the second instruction.
+   The first instruction of each pair must not be able to write to the PC
+   or the PSR (other than the flags), so that the only things which can stop
+   the second instruction from executing immediately afterwards are a data
+   abort (for loads), a pending event, or a pending exception. In those cases
+   the fused handler stops after the first instruction and leaves the rest
+   to the normal loop. */
+
+typedef struct ARMul_BlockOpInfo ARMul_BlockOpInfo;
+
+/* Returns the number of instructions executed, 1 or 2. *r15 is updated to
+   the value used by the last instruction executed. */
+typedef uint_fast8_t (*ARMul_BlockFunc)(ARMul_State *state,const PipelineEntry *op,const ARMul_BlockOpInfo *info,ARMword *r15);
+
+struct ARMul_BlockOpInfo {
+  ARMul_BlockFunc Func;   /* Block-level handler, or NULL to use the normal handler */
+  ARMword Imm;            /* Rotated immediate operand */
+  uint8_t Rd,Rn;          /* Destination & first operand registers */
+};
+
+#define PREDECODED(name,expr) \
+static uint_fast8_t ARMul_Predecoded_ ## name(ARMul_State *state,const PipelineEntry *op,const ARMul_BlockOpInfo *info,ARMword *r15) \
+{ \
+  if (ARMul_CCCheck(op->instr,(*r15 & CCBITS))) { \
+    ARMword lhs = state->Reg[info->Rn]; \
+    ARMword rhs = info->Imm; \
+    expr; \
+    UNUSED_VAR(lhs); \
+  } \
+  return 1; \
+}
+
+PREDECODED(And, state->Reg[info->Rd] = lhs & rhs)
+PREDECODED(Eor, state->Reg[info->Rd] = lhs ^ rhs)
+PREDECODED(Sub, state->Reg[info->Rd] = lhs - rhs)
+PREDECODED(Rsb, state->Reg[info->Rd] = rhs - lhs)
+PREDECODED(Add, state->Reg[info->Rd] = lhs + rhs)
+PREDECODED(Orr, state->Reg[info->Rd] = lhs | rhs)
+PREDECODED(Mov, state->Reg[info->Rd] = rhs)
+PREDECODED(Bic, state->Reg[info->Rd] = lhs & ~rhs)
+PREDECODED(Mvn, state->Reg[info->Rd] = ~rhs)
+PREDECODED(Subs, ARMword dest = lhs - rhs;
+                 ARMul_SubFlags(state,lhs,rhs,dest);
+                 state->Reg[info->Rd] = dest)
+PREDECODED(Adds, ARMword dest = lhs + rhs;
+                 ARMul_AddFlags(state,lhs,rhs,dest);
+                 state->Reg[info->Rd] = dest)
+PREDECODED(Cmp,  ARMword dest = lhs - rhs;
+                 ARMul_SubFlags(state,lhs,rhs,dest))
+PREDECODED(Cmn,  ARMword dest = lhs + rhs;
+                 ARMul_AddFlags(state,lhs,rhs,dest))
+
+#undef PREDECODED
+
+/* Equivalent of the block executor moving on to the next instruction.
+   Returns false (without changing anything) if the next instruction can't be
+   executed straight away. */
+static inline bool ARMul_Fused_Step(ARMul_State *state,ARMword *r15)
+{
+  ARMword next;
+  if ((state->NextInstr > PCINCED) || state->BlockBreak)
+    return false;
+  next = state->Reg[15];
+  if (state->NextInstr == NORMAL)
+    next += 4;
+  if (ARMul_Time+1 >= state->EventHorizon)
+    return false; /* Event due, or interrupt requested */
+  state->NumCycles++;
+  ARMul_CLEARABORT;
+  NORMALCYCLE;
+  state->Reg[15] = next;
+  *r15 = next;
+  return true;
+}
+
+#define FUSEDPAIR(name,first,second) \
+static uint_fast8_t ARMul_Fused_ ## name(ARMul_State *state,const PipelineEntry *op,const ARMul_BlockOpInfo *info,ARMword *r15) \
+{ \
+  UNUSED_VAR(info); \
+  if (ARMul_CCCheck(op[0].instr,(*r15 & CCBITS))) \
+    EMFUNCDECL26(first)(state,op[0].instr); \
+  if (!ARMul_Fused_Step(state,r15)) \
+    return 1; \
+  if (ARMul_CCCheck(op[1].instr,(*r15 & CCBITS))) \
+    EMFUNCDECL26(second)(state,op[1].instr); \
+  return 2; \
+}
+
+FUSEDPAIR(CmpImmB,CmppImm,Branch)                 /* CMP Rn,#imm ; Bcc */
+FUSEDPAIR(CmpRegB,CmppRegNorm,Branch)             /* CMP Rn,Rm ; Bcc */
+FUSEDPAIR(SubsImmB,SubsImmNorm,Branch)            /* SUBS Rd,Rn,#imm ; Bcc */
+FUSEDPAIR(MovMov,MovRegNorm,MovRegNorm)           /* MOV Rd,Rm ; MOV Rd,Rm */
+FUSEDPAIR(LdrAdd,LoadNoWritePreIncImm,AddImm)     /* LDR Rd,[Rn,#imm] ; ADD Rd,Rn,#imm */
+FUSEDPAIR(LdrPostAdd,LoadNoWritePostIncImm,AddImm) /* LDR Rd,[Rn],#imm ; ADD Rd,Rn,#imm */
+
+#undef FUSEDPAIR
+
+/* Fill in the pre-decoded operands for the given instruction */
+static void ARMul_Emulate_PredecodeInstr(ARMword instr,ARMul_BlockOpInfo *info)
+{
+  /* Indexed by BITS(20,24), i.e. opcode & S bit */
+  static const ARMul_BlockFunc funcs[32] = {
+    ARMul_Predecoded_And, NULL, ARMul_Predecoded_Eor, NULL,
+    ARMul_Predecoded_Sub, ARMul_Predecoded_Subs, ARMul_Predecoded_Rsb, NULL,
+    ARMul_Predecoded_Add, ARMul_Predecoded_Adds, NULL, NULL,
+    NULL, NULL, NULL, NULL,
+    NULL, NULL, NULL, NULL,
+    NULL, ARMul_Predecoded_Cmp, NULL, ARMul_Predecoded_Cmn,
+    ARMul_Predecoded_Orr, NULL, ARMul_Predecoded_Mov, NULL,
+    ARMul_Predecoded_Bic, NULL, ARMul_Predecoded_Mvn, NULL
+  };
+  ARMul_BlockFunc func = NULL;
+  if (((instr & 0x0e000000) == 0x02000000) && (DESTReg != 15))
+  {
+    func = funcs[BITS(20,24)];
+    /* MOV & MVN don't use Rn */
+    if ((LHSReg == 15) && (func != ARMul_Predecoded_Mov) && (func != ARMul_Predecoded_Mvn))
+      func = NULL;
+  }
+  info->Func = func;
+  info->Imm = DPImmRHS;
+  info->Rd = DESTReg;
+  info->Rn = LHSReg;
+}
+
+/* Return the fused handler for the given pair of instructions, if any */
+static ARMul_BlockFunc ARMul_Emulate_FuseInstr(ARMword instr,ARMword next)
+{
+  if (DESTReg == 15)
+    return NULL;
+  switch (instr & 0x0ff00000) {
+    case 0x03500000: /* CMP immediate */
+      if ((next & 0x0f000000) == 0x0a000000)
+        return ARMul_Fused_CmpImmB;
+      break;
+    case 0x01500000: /* CMP register */
+      if ((next & 0x0f000000) == 0x0a000000)
+        return ARMul_Fused_CmpRegB;
+      break;
+    case 0x02500000: /* SUBS immediate */
+      if ((next & 0x0f000000) == 0x0a000000)
+        return ARMul_Fused_SubsImmB;
+      break;
+    case 0x01a00000: /* MOV register */
+      if (((next & 0x0ff00000) == 0x01a00000) && ((next & 0xf000) != 0xf000))
+        return ARMul_Fused_MovMov;
+      break;
+    case 0x05900000: /* LDR pre-indexed, up, no writeback */
+      if (((next & 0x0ff00000) == 0x02800000) && ((next & 0xf000) != 0xf000))
+        return ARMul_Fused_LdrAdd;
+      break;
+    case 0x04900000: /* LDR post-indexed, up */
+      if (((next & 0x0ff00000) == 0x02800000) && ((next & 0xf000) != 0xf000))
+        return ARMul_Fused_LdrPostAdd;
+      break;
+  }
+  return NULL;
+}
+
+#ifdef ARMUL_NATIVE_X64
+/* Native code for a block, see armemux64.c */
+typedef uint32_t (*ARMul_NativeFunc)(ARMul_State *state,ARMword *r15);
+#endif
+
+struct ARMul_Block {
+  ARMword *Phys;          /* Physical address of first instruction */
+  uint32_t Serial;        /* Nonzero serial number, zero if block is free */
+  uint_fast16_t NumOps;   /* Number of instructions which can be executed */
+  ARMul_Block *PageNext;  /* Next block in page list, or next free block */
+  ARMul_Block **PagePrev; /* Pointer to whatever points to us in the page list */
+  ARMul_BlockLink FallThrough; /* Chained block following on from NumOps */
+  ARMul_BlockLink Branch; /* Last block jumped to from within this block */
+  PipelineEntry Ops[BLOCK_MAX_OPS+BLOCK_LOOKAHEAD];
+  ARMul_BlockOpInfo Info[BLOCK_MAX_OPS]; /* Block-level handlers & operands for Ops[] */
+  uint_fast16_t IdleOps;  /* Length of the (possibly idle) loop at the start of the block, or 0 */
+  uint16_t IdleRegs;      /* Registers written by the loop (bit 15 for the PSR) */
+#ifdef ARMUL_NATIVE_X64
+  ARMul_NativeFunc Native; /* Translated code, or NULL */
+  uint32_t Runs;          /* Number of times the block has been entered, until it's translated */
+#endif
+};
+
+/* Snapshot of an idle loop candidate, taken each time it branches back to
+   its own start */
+typedef struct {
+  const ARMul_Block *Block;
+  uint32_t Serial;
+  CycleCount Horizon;
+  ARMword Regs[16];
+} ARMul_IdleState;
+
+struct ARMul_BlockCache {
+  ARMul_Block *Free;      /* Free list */
+  uint32_t NextSerial;
+  size_t NumPages;
+  ARMul_Block *Hash[BLOCK_HASH_SIZE];
+  ARMul_Block Pool[BLOCK_POOL_SIZE];
+#ifdef ARMUL_NATIVE_X64
+  uint8_t *Code;          /* Executable buffer for native code, or NULL if not in use */
+  uint8_t *CodeNext;      /* Next free byte of it */
+  uint8_t *CodeEnd;
+  bool CodeFull;          /* Buffer is full, flush the cache before building the next block */
+#endif
+};
+
+typedef enum {
+  BLOCKRUN_NONE,          /* No block available, state->Reg[15] contains the new PC */
+  BLOCKRUN_PIPE,          /* Continue with the pipeline contents in pipe[1] & pipe[2] */
+  BLOCKRUN_EXCEPTION      /* An exception was taken */
+} ARMul_BlockRunResult;
+
+#define BLOCK_HASH(phys) ((((FastMapUInt)(phys))>>2) & (BLOCK_HASH_SIZE-1))
+
+#ifdef ARMUL_NATIVE_X64
+#include "armemux64.c"
+#endif
+
+bool ARMul_BlockCache_Init(ARMul_State *state,ARMword *base,ARMword size,bool enable)
+{
+  ARMul_BlockCache *cache;
+  size_t i;
+  /* The page table is always needed, since the clobber hooks consult it */
+  state->BlockPages = calloc((size+4095)>>12,sizeof(ARMul_Block *));
+  if(!state->BlockPages)
+    return false;
+  state->BlockPageBase = (FastMapUInt)base;
+  state->BlockBreak = true;
+  if(!enable)
+    return true;
+  cache = calloc(1,sizeof(ARMul_BlockCache));
+  if(!cache)
+  {
+    free(state->BlockPages);
+    state->BlockPages = NULL;
+    return false;
+  }
+  cache->NumPages = (size+4095)>>12;
+  for(i=0;i<BLOCK_POOL_SIZE-1;i++)
+    cache->Pool[i].PageNext = &cache->Pool[i+1];
+  cache->Free = &cache->Pool[0];
+  cache->NextSerial = 1;
+#ifdef ARMUL_NATIVE_X64
+  if((CONFIG.eCPUEngine == CPUEngine_Native) && !ARMul_Native_Init(cache))
+  {
+    ControlPane_Error(false,"Couldn't map memory the native engine can write and then execute, using blocks instead");
+    CONFIG.eCPUEngine = CPUEngine_Blocks;
+  }
+#endif
+  state->BlockCache = cache;
+  return true;
+}
+
+void ARMul_BlockCache_Exit(ARMul_State *state)
+{
+  free(state->BlockPages);
+  state->BlockPages = NULL;
+#ifdef ARMUL_NATIVE_X64
+  if(state->BlockCache)
+    ARMul_Native_Exit(state->BlockCache);
+#endif
+  free(state->BlockCache);
+  state->BlockCache = NULL;
+}
+
+static void ARMul_BlockCache_FreeBlock(ARMul_BlockCache *cache,ARMul_Block *blk)
+{
+  ARMul_Block **bucket = &cache->Hash[BLOCK_HASH(blk->Phys)];
+  if(*bucket == blk)
+    *bucket = NULL;
+  if(blk->PageNext)
+    blk->PageNext->PagePrev = blk->PagePrev;
+  *blk->PagePrev = blk->PageNext;
+  blk->Serial = 0;
+  blk->PageNext = cache->Free;
+  cache->Free = blk;
+}
+
+void ARMul_BlockCache_InvalidatePage(ARMul_State *state,FastMapUInt page)
+{
+  ARMul_BlockCache *cache = state->BlockCache;
+  ARMul_Block *blk = state->BlockPages[page];
+  while(blk)
+  {
+    ARMul_Block *next = blk->PageNext;
+    ARMul_Block **bucket = &cache->Hash[BLOCK_HASH(blk->Phys)];
+    if(*bucket == blk)
+      *bucket = NULL;
+    blk->Serial = 0;
+    blk->PageNext = cache->Free;
+    cache->Free = blk;
+    blk = next;
+  }
+  state->BlockPages[page] = NULL;
+  /* The current block may have been one of the ones we just discarded */
+  state->BlockBreak = true;
+}
+
+static void ARMul_BlockCache_Flush(ARMul_State *state)
+{
+  ARMul_BlockCache *cache = state->BlockCache;
+  size_t i;
+  memset(cache->Hash,0,sizeof(cache->Hash));
+  memset(state->BlockPages,0,cache->NumPages*sizeof(ARMul_Block *));
+  cache->Free = NULL;
+  for(i=BLOCK_POOL_SIZE;i-- > 0;)
+  {
+    cache->Pool[i].Serial = 0;
+    cache->Pool[i].PageNext = cache->Free;
+    cache->Free = &cache->Pool[i];
+  }
+#ifdef ARMUL_NATIVE_X64
+  /* Nothing refers to the native code any more */
+  cache->CodeNext = cache->Code;
+  cache->CodeFull = false;
+#endif
+}
+
+/* Returns true if the instruction will always cause a change in control flow,
+   meaning there's no point continuing the block past it */
+static inline bool ARMul_BlockCache_EndsBlock(ARMword instr)
+{
+  if((instr>>28) != AL)
+    return false;
+  switch(BITS(25,27)) {
+    case 0: /* Data processing, multiply, swap */
+    case 1:
+      return (BITS(12,15) == 15);
+    case 3: /* LDR/STR with register offset, or undefined */
+      if(BIT(4))
+        return true;
+      /* fall through */
+    case 2: /* LDR/STR */
+      return (BIT(20) && (BITS(12,15) == 15));
+    case 4: /* LDM/STM */
+      return (BIT(20) && BIT(15));
+    default: /* Branch, coprocessor, SWI */
+      return true;
+  }
+}
+
+/* Returns true if the instruction can be part of an idle loop, i.e. it only
+   writes to registers (which are added to *regs) and any loads it performs
+   can be checked by ARMul_BlockCache_IdleLoads */
+static bool ARMul_BlockCache_IdleOp(ARMword instr,uint16_t *regs)
+{
+  switch(BITS(25,27)) {
+    case 0: /* Data processing, multiply, swap */
+      if(BITS(4,7) == 9)
+      {
+        if(BITS(22,24) || (BITS(16,19) == 15))
+          return false; /* SWP, or multiply to PC */
+        *regs |= (1<<BITS(16,19)) | (BIT(20)<<15);
+        return true;
+      }
+      if(BIT(4) && BIT(7))
+        return false; /* Undefined */
+      /* fall through */
+    case 1: /* Data processing */
+      if(BITS(12,15) == 15)
+        return false; /* PC write, or TSTP etc. */
+      if((BITS(21,24) & 0xc) == 0x8)
+      {
+        if(!BIT(20))
+          return false; /* Not a compare */
+      }
+      else
+        *regs |= 1<<BITS(12,15);
+      *regs |= BIT(20)<<15;
+      return true;
+    case 3: /* LDR/STR with register offset, or undefined */
+      if(BIT(4) || (BITS(0,3) == 15))
+        return false;
+      /* fall through */
+    case 2: /* LDR/STR */
+      if(!BIT(20) || !BIT(24) || BIT(21) || (BITS(12,15) == 15))
+        return false; /* Only pre-indexed loads without writeback */
+      *regs |= 1<<BITS(12,15);
+      return true;
+    default: /* LDM/STM, branch, coprocessor, SWI */
+      return false;
+  }
+}
+
+/* Check that all the loads performed by an idle loop are free of side
+   effects. Only valid once the loop has been seen to reach a fixed point, so
+   that the registers used to calculate the addresses won't change. Values
+   written by simple MOV/ADD/SUB immediate ops are tracked, anything else
+   makes the register unknown. */
+static bool ARMul_BlockCache_IdleLoads(ARMul_State *state,const ARMul_Block *blk,ARMword addr)
+{
+  ARMword regs[16];
+  uint16_t known = 0x7fff; /* Registers whose values are held in regs[] */
+  uint_fast16_t i;
+  memcpy(regs,state->Reg,sizeof(regs));
+  for(i=0;i<blk->IdleOps-1;i++)
+  {
+    ARMword instr = blk->Ops[i].instr;
+    uint16_t written = 0;
+    regs[15] = (addr+(i<<2)+8) & R15PCBITS;
+    if(BITS(26,27) == 1)
+    {
+      ARMword offset;
+      if((LHSReg != 15) && !(known & (1<<LHSReg)))
+        return false;
+      if(!BIT(25))
+        offset = BITS(0,11);
+      else if(!BITS(4,11) && (known & (1<<RHSReg)))
+        offset = regs[RHSReg];
+      else
+        return false;
+      if(!ARMul_ReadIsSideEffectFree(state,BIT(23) ? regs[LHSReg]+offset : regs[LHSReg]-offset))
+        return false;
+    }
+    ARMul_BlockCache_IdleOp(instr,&written);
+    if((BITS(25,27) == 1) && ((instr>>28) == AL) && (LHSReg != 15))
+    {
+      bool valid = (known>>LHSReg) & 1;
+      switch(BITS(21,24)) {
+        case 0x2: /* SUB */
+          regs[DESTReg] = regs[LHSReg] - DPImmRHS;
+          break;
+        case 0x4: /* ADD */
+          regs[DESTReg] = regs[LHSReg] + DPImmRHS;
+          break;
+        case 0xd: /* MOV */
+          regs[DESTReg] = DPImmRHS;
+          valid = true;
+          break;
+        case 0xf: /* MVN */
+          regs[DESTReg] = ~DPImmRHS;
+          valid = true;
+          break;
+        default:
+          valid = false;
+          break;
+      }
+      if(valid)
+        written &= ~(1<<DESTReg);
+    }
+    known &= ~written;
+  }
+  return true;
+}
+
+/* Called each time an idle loop candidate branches back to its start. Returns
+   true if the loop can't make any progress until the next event, i.e. the
+   registers it writes are the same as last time round, no events happened
+   in between, and none of its loads have side effects. */
+static bool ARMul_BlockCache_IdleCheck(ARMul_State *state,ARMul_IdleState *idle,const ARMul_Block *blk,ARMword addr)
+{
+  bool same = (idle->Block == blk) && (idle->Serial == blk->Serial) && (idle->Horizon == state->EventHorizon);
+  uint_fast8_t r;
+  for(r=0;r<16;r++)
+  {
+    if(blk->IdleRegs & (1<<r))
+    {
+      same = same && (idle->Regs[r] == state->Reg[r]);
+      idle->Regs[r] = state->Reg[r];
+    }
+  }
+  idle->Block = blk;
+  idle->Serial = blk->Serial;
+  idle->Horizon = state->EventHorizon;
+  return same && ARMul_BlockCache_IdleLoads(state,blk,addr);
+}
+
+static inline void ARMul_BlockCache_DecodeOp(ARMul_State *state,ARMword *data,PipelineEntry *p)
+{
+  ARMEmuFuncCache *pfunc = FastMap_Phy2Func(state,data);
+  ARMEmuFuncCache temp = *pfunc;
+  ARMword instr = *data;
+  if(temp == FASTMAP_CLOBBEREDFUNC)
+  {
+    /* Decode the instruction */
+    temp = *pfunc = ARMul_Emulate_DecodeInstrCache(instr);
+    FastMap_PhyMarkCode(state,data);
+  }
+  p->instr = instr;
+  p->func = ARMul_EmuFuncCache_Func(temp);
+}
+
+/* Build a new block for the given physical address */
+static ARMul_Block *ARMul_BlockCache_Translate(ARMul_State *state,ARMword *phys,ARMword addr)
+{
+  ARMul_BlockCache *cache = state->BlockCache;
+  ARMul_Block *blk, **bucket;
+  FastMapUInt page;
+  uint_fast16_t i,limit;
+
+  /* Work out how many instructions will fit before the end of the page */
+  limit = BLOCK_WORDS_PER_PAGE-BLOCK_LOOKAHEAD-((addr & 4095)>>2);
+  if(limit > BLOCK_MAX_OPS)
+    limit = BLOCK_MAX_OPS;
+
+  if(!cache->Free)
+    ARMul_BlockCache_Flush(state);
+#ifdef ARMUL_NATIVE_X64
+  else if(cache->CodeFull)
+    ARMul_BlockCache_Flush(state);
+#endif
+  bucket = &cache->Hash[BLOCK_HASH(phys)];
+  if(*bucket)
+    ARMul_BlockCache_FreeBlock(cache,*bucket);
+  blk = cache->Free;
+  cache->Free = blk->PageNext;
+
+  i = 0;
+  do {
+    ARMul_BlockCache_DecodeOp(state,phys+i,&blk->Ops[i]);
+  } while((++i < limit) && !ARMul_BlockCache_EndsBlock(blk->Ops[i-1].instr));
+  blk->NumOps = i;
+  ARMul_BlockCache_DecodeOp(state,phys+i,&blk->Ops[i]);
+  ARMul_BlockCache_DecodeOp(state,phys+i+1,&blk->Ops[i+1]);
+
+  /* Pre-decode operands, and look for pairs which can be fused (both must
+     be in the block) */
+  --i;
+  ARMul_Emulate_PredecodeInstr(blk->Ops[i].instr,&blk->Info[i]);
+  while(i--)
+  {
+    ARMul_BlockFunc fused = ARMul_Emulate_FuseInstr(blk->Ops[i].instr,blk->Ops[i+1].instr);
+    ARMul_Emulate_PredecodeInstr(blk->Ops[i].instr,&blk->Info[i]);
+    if(fused)
+      blk->Info[i].Func = fused;
+  }
+
+  /* Look for loops which may be idle: a branch back to the start of the
+     block, preceded only by ops which are safe for idle loops */
+  blk->IdleOps = 0;
+  if(CONFIG.bIdleSkip)
+  {
+    uint16_t regs = 0;
+    for(i=0;i<blk->NumOps;i++)
+    {
+      ARMword instr = blk->Ops[i].instr;
+      if(BITS(24,27) == 0xa)
+      {
+        ARMword offset = (BITS(0,23)<<2) | (BIT(23) ? 0xfc000000 : 0);
+        if(!(((i<<2)+8+offset) & R15PCBITS))
+          blk->IdleOps = i+1;
+        break;
+      }
+      if(!ARMul_BlockCache_IdleOp(instr,&regs))
+        break;
+    }
+    blk->IdleRegs = regs;
+  }
+
+  blk->Phys = phys;
+  blk->Serial = cache->NextSerial++;
+  if(!cache->NextSerial)
+    cache->NextSerial = 1;
+  blk->FallThrough.Block = NULL;
+  blk->Branch.Block = NULL;
+#ifdef ARMUL_NATIVE_X64
+  blk->Native = NULL;
+  blk->Runs = 0;
+#endif
+
+  /* Link into the page list & hash */
+  page = (((FastMapUInt)phys)-state->BlockPageBase)>>12;
+  blk->PagePrev = &state->BlockPages[page];
+  blk->PageNext = state->BlockPages[page];
+  if(blk->PageNext)
+    blk->PageNext->PagePrev = &blk->PageNext;
+  state->BlockPages[page] = blk;
+  *bucket = blk;
+  return blk;
+}
+
+/* Find (or build) the block for the given logical address */
+static ARMul_Block *ARMul_BlockCache_Lookup(ARMul_State *state,ARMword addr)
+{
+  FastMapEntry *entry;
+  FastMapRes res;
+  ARMword *phys;
+  ARMul_Block *blk;
+
+  if((addr & 4095) > 4096-4-(BLOCK_LOOKAHEAD*4))
+    return NULL; /* Too close to the end of the page */
+
+  entry = FastMap_GetEntryNoWrap(state,addr);
+  res = FastMap_DecodeRead(entry,state->FastMapMode);
+  if(!FASTMAP_RESULT_DIRECT(res))
+    return NULL; /* Leave access functions and aborts to ARMul_LoadInstr */
+
+  phys = FastMap_Log2Phy(entry,addr);
+  blk = state->BlockCache->Hash[BLOCK_HASH(phys)];
+  if(blk && (blk->Phys == phys))
+    return blk;
+  return ARMul_BlockCache_Translate(state,phys,addr);
+}
+
+static inline void ARMul_BlockCache_SetLink(ARMul_BlockLink *link,ARMul_Block *blk,ARMword addr,uint32_t mapgen)
+{
+  link->Block = blk;
+  link->Serial = blk->Serial;
+  link->MapGen = mapgen;
+  link->Addr = addr;
+}
+
+/* Execute blocks, starting from the (newly changed) PC. This matches the
+   behaviour of the main loop in ARMul_Emulate26, but uses the pre-decoded
+   instructions & prefetched words held in the blocks. */
+static ARMul_BlockRunResult ARMul_RunBlocks(ARMul_State *state,PipelineEntry *pipe)
+{
+  ARMword addr = state->Reg[15] & R15PCBITS;
+  ARMul_Block *blk = ARMul_BlockCache_Lookup(state,addr);
+  ARMul_IdleState idle;
+#ifdef ARMUL_NATIVE_X64
+  bool native = (state->BlockCache->Code != NULL);
+#endif
+  if(!blk)
+    return BLOCKRUN_NONE;
+  idle.Block = NULL;
+  idle.Serial = 0;
+  idle.Horizon = 0;
+
+  for(;;) {
+    uint32_t serial;
+    ARMul_Block *next;
+    uint_fast16_t i = 0;
+    /* Equivalent of ARMul_LoadInstrTriplet */
+    ARMword r15 = state->Reg[15] + 8;
+    state->NumCycles += 3;
+    ARMul_CLEARABORT;
+    state->BlockBreak = false;
+
+    for(;;) {
+      const PipelineEntry *op;
+      ARMword excep;
+
+#ifdef ARMUL_NATIVE_X64
+      if (!i && native)
+      {
+        if (!blk->Native && (++blk->Runs == NATIVE_THRESHOLD))
+          ARMul_Native_Translate(state,blk);
+        if (blk->Native)
+        {
+          uint32_t res = (blk->Native)(state,&r15);
+          i = res>>1;
+          if (res & 1)
+            goto executed;
+        }
+      }
+#endif
+
+      op = &blk->Ops[i];
+      NORMALCYCLE;
+
+      if (ARMul_Time >= state->EventHorizon)
+        excep = ARMul_ServiceEvents(state,r15);
+      else
+        excep = 0;
+
+      /* Write back updated PC before handling exception/instruction */
+      state->Reg[15] = r15;
+
+      if (excep) { /* Any exceptions */
+        pipe[1] = op[1];
+        pipe[2] = op[2];
+        if (excep & Exception_FIQ) {
+          Prof_BeginFunc(ARMul_Abort);
+          ARMul_Abort(state, ARMul_FIQV);
+          Prof_EndFunc(ARMul_Abort);
+        } else {
+          Prof_BeginFunc(ARMul_Abort);
+          ARMul_Abort(state, ARMul_IRQV);
+          Prof_EndFunc(ARMul_Abort);
+        }
+        return BLOCKRUN_EXCEPTION;
+      }
+
+      if (blk->Info[i].Func)
+        i += (blk->Info[i].Func)(state,op,&blk->Info[i],&r15);
+      else
+      {
+        execute_instruction(state,op,r15);
+        i++;
+      }
+
+#ifdef ARMUL_NATIVE_X64
+executed:
+#endif
+      if (state->NextInstr > PCINCED)
+        break; /* The program counter has been changed */
+
+      if (state->BlockBreak)
+      {
+        /* Block (or memory map) was changed underneath us, but the next two
+           instructions have already been fetched */
+        pipe[1] = blk->Ops[i];
+        pipe[2] = blk->Ops[i+1];
+        return BLOCKRUN_PIPE;
+      }
+
+      if (i == blk->NumOps)
+      {
+        /* Continue into the next block in the page */
+        next = blk->FallThrough.Block;
+        if (!next || (next->Serial != blk->FallThrough.Serial))
+        {
+          ARMword *phys = blk->Phys+i;
+          addr = (r15 - 4) & R15PCBITS;
+          pipe[1] = blk->Ops[i];
+          pipe[2] = blk->Ops[i+1];
+          if ((addr & 4095) > 4096-4-(BLOCK_LOOKAHEAD*4))
+            return BLOCKRUN_PIPE;
+          serial = blk->Serial;
+          next = state->BlockCache->Hash[BLOCK_HASH(phys)];
+          if (!next || (next->Phys != phys))
+            next = ARMul_BlockCache_Translate(state,phys,addr);
+          if (blk->Serial == serial)
+            ARMul_BlockCache_SetLink(&blk->FallThrough,next,addr,state->BlockMapGen);
+        }
+        blk = next;
+        i = 0;
+      }
+
+      /* Fetch */
+      r15 = state->Reg[15];
+      if (state->NextInstr == NORMAL)
+        r15 += 4; /* Assume we don't care about the flags being corrupted by the PC wrapping */
+      state->NumCycles++;
+      ARMul_CLEARABORT;
+    }
+
+    /* Follow the branch */
+    state->Aborted = 0;
+    addr = state->Reg[15] & R15PCBITS;
+    next = blk->Branch.Block;
+    if (!next || (blk->Branch.Addr != addr) || (blk->Branch.MapGen != state->BlockMapGen) || (next->Serial != blk->Branch.Serial))
+    {
+      serial = blk->Serial;
+      next = ARMul_BlockCache_Lookup(state,addr);
+      if (!next)
+        return BLOCKRUN_NONE;
+      if (blk->Serial == serial)
+        ARMul_BlockCache_SetLink(&blk->Branch,next,addr,state->BlockMapGen);
+    }
+
+    /* Skip ahead to the next event if we're stuck in an idle loop */
+    if ((next == blk) && (i == blk->IdleOps))
+    {
+      if (ARMul_BlockCache_IdleCheck(state,&idle,blk,addr))
+      {
+        if ((state->EventHorizon > ARMul_Time) && (state->EventHorizon != CYCLE_COUNT_NEVER))
+        {
+          EmuRate_IdleSkip(state,(CycleDiff) (state->EventHorizon-ARMul_Time));
+        }
+      }
+    }
+    else
+      idle.Block = NULL;
+    blk = next;
+  }
+}
+#endif
+
+#ifdef ARMUL_THREADED_DISPATCH
+/***************************************************************************\
+*                          Threaded dispatch                                *
+\***************************************************************************/
+
+/* The threaded interpreter compiles each instruction handler a second time,
+   wrapped in a function which fetches the next instruction and then jumps
+   straight to the next handler via a guaranteed tail call. Rather than going
+   through the pipeline array, the three pipeline entries are passed from
+   handler to handler as arguments (along with R15), so stay in host
+   registers. Each handler also gets its own indirect branch for the host CPU
+   to predict.
+
+   The common case of a sequential fetch from the cached fetch page is dealt
+   with by the handlers themselves, everything else (PC changes, fetches which
+   need decoding or which miss the fetch cache, and events) is left to
+   ARMul_Threaded_SlowStep.
+
+   ARMul_Time stays in the state struct. Handler bodies (multiplies, LDM/STM,
+   coprocessor ops) and memory accesses (IOC timers, event scheduling) read and
+   update state->NumCycles directly, so a register copy would need storing
+   back before every body and reloading after it, which is the same memory
+   traffic as now. It would also need a seventh argument, which no longer
+   fits in registers on x86-64 and breaks the sibling calls.
+
+   On GCC 12 this runs at about the same speed as the call-based loop (see
+   test/bench), so it stays opt-in. Its gains depend on the compiler
+   guaranteeing the tail calls and keeping the arguments in registers across
+   them. */
+
+#ifndef FLATPIPE
+#error "ARMUL_THREADED_DISPATCH requires FLATPIPE"
+#endif
+
+#if defined(__has_attribute)
+#if __has_attribute(musttail)
+#define ARMUL_MUSTTAIL __attribute__((musttail))
+#endif
+#endif
+#ifndef ARMUL_MUSTTAIL
+#ifdef __OPTIMIZE__
+/* No musttail (e.g. GCC < 15), so rely on sibling call optimisation */
+#define ARMUL_MUSTTAIL
+#else
+#error "ARMUL_THREADED_DISPATCH requires musttail support or an optimised build"
+#endif
+#endif
+
+/* The fast path of each threaded handler must be fully inlined */
+#define ARMUL_THREAD_INLINE inline __attribute__((always_inline))
+
+#define ARMUL_THREAD_NEWPC 3     /* Returned when the PC has been changed */
+#define ARMUL_THREAD_EXCEPTION 4 /* Returned when an exception needs taking */
+
+#define THREADOP(instr,idx) ((((ARMul_ThreadOp) (idx))<<32) | (instr))
+#define THREADOP_INSTR(op) ((ARMword) (op))
+#define THREADOP_FUNC(op) (ARMul_ThreadFuncTable[(op)>>32])
+
+static ARMUL_THREAD_INLINE ARMul_ThreadOp ARMul_Threaded_Op(ARMword instr)
+{
+  return THREADOP(instr,ARMul_EmuFuncDecodeTable[EMUFUNC_DECODE_KEY(instr)]);
+}
+
+/* Run any events which are due, and write back R15. Returns the exceptions
+   (if any) which need taking. */
+static ARMUL_THREAD_INLINE ARMword ARMul_Threaded_Events(ARMul_State *state,ARMword r15)
+{
+  ARMword excep;
+  if (ARMul_Time >= state->EventHorizon)
+    excep = ARMul_ServiceEvents(state,r15);
+  else
+    excep = 0;
+
+  /* Write back updated PC before handling exception/instruction */
+  state->Reg[15] = r15;
+  return excep;
+}
+
+/* Leave the threaded interpreter to take an exception, with op as the
+   instruction which was about to execute */
+static uint_fast8_t ARMul_Threaded_Exit(PipelineEntry *pipe,ARMul_ThreadOp op,ARMul_ThreadOp next,ARMul_ThreadOp next2)
+{
+  pipe[0].instr = THREADOP_INSTR(op);
+  pipe[1].instr = THREADOP_INSTR(next);
+  pipe[2].instr = THREADOP_INSTR(next2);
+  return ARMUL_THREAD_EXCEPTION;
+}
+
+/* Refill the pipeline from the current PC, and continue from there */
+static uint_fast8_t ARMul_Threaded_Refill(ARMul_State *state,PipelineEntry *pipe,ARMword r15,ARMul_ThreadOp op,ARMul_ThreadOp next,ARMul_ThreadOp next2)
+{
+  r15 = state->Reg[15];
+  state->Aborted = 0;
+  ARMul_LoadInstrTriplet(state, r15, pipe);
+  r15 += 8;
+  NORMALCYCLE;
+  op = ARMul_Threaded_Op(pipe[0].instr);
+  next = ARMul_Threaded_Op(pipe[1].instr);
+  next2 = ARMul_Threaded_Op(pipe[2].instr);
+
+  if (ARMul_Threaded_Events(state,r15))
+    return ARMul_Threaded_Exit(pipe,op,next,next2);
+  ARMUL_MUSTTAIL return THREADOP_FUNC(op)(state,pipe,r15,op,next,next2);
+}
+
+/* The full version of the fetch & event handling that each threaded handler
+   performs after op has executed, following the FLATPIPE loop */
+static uint_fast8_t ARMul_Threaded_SlowStep(ARMul_State *state,PipelineEntry *pipe,ARMword r15,ARMul_ThreadOp op,ARMul_ThreadOp next,ARMul_ThreadOp next2)
+{
+  r15 = state->Reg[15];
+  switch (state->NextInstr) {
+    case NORMAL: /* Advance the pipeline, and an S cycle */
+      r15 += 4; /* Assume we don't care about the flags being corrupted by the PC wrapping */
+      /* fall through */
+    case PCINCED: /* Program counter advanced, and an S cycle */
+      ARMul_LoadInstr(state, r15, &pipe[2]);
+      op = ARMul_Threaded_Op(pipe[2].instr);
+      NORMALCYCLE;
+      break;
+    default: /* The program counter has been changed */
+#ifdef ARMUL_BLOCK_CACHE
+      if (state->BlockCache) /* Let ARMul_Emulate26 try the block engine */
+        return ARMUL_THREAD_NEWPC;
+#endif
+      ARMUL_MUSTTAIL return ARMul_Threaded_Refill(state,pipe,r15,op,next,next2);
+  }
+
+  if (ARMul_Threaded_Events(state,r15))
+    return ARMul_Threaded_Exit(pipe,next,next2,op);
+  ARMUL_MUSTTAIL return THREADOP_FUNC(next)(state,pipe,r15,next,next2,op);
+}
+
+/* Enter the threaded interpreter with pipe[1] & pipe[2] holding the next two
+   instructions, and the fetch for pipe[0] still to be done */
+static inline uint_fast8_t ARMul_Threaded_Start(ARMul_State *state,PipelineEntry *pipe)
+{
+  return ARMul_Threaded_SlowStep(state,pipe,state->Reg[15],0,ARMul_Threaded_Op(pipe[1].instr),ARMul_Threaded_Op(pipe[2].instr));
+}
+
+/* Turns each handler in armemuinstr.c into an inline body, preceded by the
+   threaded wrapper which calls it */
+#undef EMFUNCDECL26
+#define EMFUNCDECL26(name) ARMul_ThreadBody_ ## name(ARMul_State *state, ARMword instr) __attribute__((always_inline)); \
+static uint_fast8_t ARMul_Thread_ ## name(ARMul_State *state,PipelineEntry *pipe,ARMword r15,ARMul_ThreadOp op,ARMul_ThreadOp next,ARMul_ThreadOp next2) \
+{ \
+  ARMword instr = THREADOP_INSTR(op); \
+  uint_fast16_t idx; \
+  if (ARMul_CCCheck(instr,(r15 & CCBITS))) \
+    ARMul_ThreadBody_ ## name(state,instr); \
+  r15 = state->Reg[15] + (state->NextInstr == NORMAL ? 4 : 0); \
+  idx = (r15 & 4095)>>2; \
+  if ((state->NextInstr > PCINCED) || ((r15 & 0x3fff000) != state->FetchPage) \
+      || (state->FetchFuncs[idx] == FASTMAP_CLOBBEREDFUNC) \
+      || (ARMul_Time+1 >= state->EventHorizon)) \
+    ARMUL_MUSTTAIL return ARMul_Threaded_SlowStep(state,pipe,r15,op,next,next2); \
+  op = THREADOP(state->FetchData[idx],state->FetchFuncs[idx]); \
+  state->NumCycles++; \
+  ARMul_CLEARABORT; \
+  NORMALCYCLE; \
+  state->Reg[15] = r15; \
+  ARMUL_MUSTTAIL return THREADOP_FUNC(next)(state,pipe,r15,next,next2,op); \
+} \
+static ARMUL_THREAD_INLINE void ARMul_ThreadBody_ ## name
+#define EMFUNC_CONDTEST
+#include "armemuinstr.c"
+
+#undef EMFUNCDECL26
+#undef EMFUNC_CONDTEST
+
+static ARMul_ThreadFunc ARMul_Threaded_DecodeInstr(ARMword instr) {
+  ARMul_ThreadFunc f;
+#define ARMEmuFunc ARMul_ThreadFunc
+#define EMFUNCDECL26(name) ARMul_Thread_ ## name
+#include "armemudec.c"
+#undef ARMEmuFunc
+#undef EMFUNCDECL26
+
+  return f;
+} /* ARMul_Threaded_DecodeInstr */
+#endif
+
 void
 ARMul_Emulate26(ARMul_State *state)
 {
@@ -1184,6 +2383,9 @@ ARMul_Emulate26(ARMul_State *state)
 #endif
     }
     Prof_End("ARMul_Emulate26 prime");
+#ifdef ARMUL_THREADED_DISPATCH
+    pipeidx = ARMul_Threaded_Start(state, pipe);
+#endif
 
     for (;;) { /* just keep going */
 #ifndef FLATPIPE
@@ -1232,7 +2434,7 @@ ARMul_Emulate26(ARMul_State *state)
       CycleCount local_time = ARMul_Time;
 #if 1
       /* Regular EventQ code */
-      while(((CycleDiff) (local_time-state->EventQ[0].Time)) >= 0)
+      while(local_time >= state->EventQ[0].Time)
       {
         EventQ_Func func = state->EventQ[0].Func;
         Prof_BeginFunc(func);
@@ -1242,7 +2444,7 @@ ARMul_Emulate26(ARMul_State *state)
 #else
       /* Code with runaway loop timer for debugging */
       int loops = 256;
-      while((((CycleDiff) (local_time-state->EventQ[0].Time)) >= 0) && --loops)
+      while((local_time >= state->EventQ[0].Time) && --loops)
       {
         EventQ_Func func = state->EventQ[0].Func;
         Prof_BeginFunc(func);
@@ -1251,7 +2453,7 @@ ARMul_Emulate26(ARMul_State *state)
       }
       if(!loops)
       {
-        ControlPane_Error(true,"Runaway loop in EventQ. Head event func %08x time %08x (local_time %08x)",state->EventQ[0].Func,state->EventQ[0].Time,loops);
+        ControlPane_Error(true,"Runaway loop in EventQ. Head event func %p time %"PRIu64" (local_time %"PRIu64")",(void *) state->EventQ[0].Func,state->EventQ[0].Time,local_time);
       }
 #endif
 
@@ -1271,9 +2473,39 @@ ARMul_Emulate26(ARMul_State *state)
 
       /*dbug("exec: pc=0x%08x instr=0x%08x\n", pc, pipe[pipeidx].instr);*/
       execute_instruction(state,&pipe[pipeidx],state->Reg[15]);
+#elif defined(ARMUL_THREADED_DISPATCH)
+      if (pipeidx == ARMUL_THREAD_NEWPC) {
+#ifdef ARMUL_BLOCK_CACHE
+        switch (ARMul_RunBlocks(state, pipe)) {
+          case BLOCKRUN_PIPE: /* Resume from the pipeline state left by the block */
+            pipeidx = ARMul_Threaded_Start(state, pipe);
+            continue;
+          case BLOCKRUN_EXCEPTION:
+            pipeidx = 0;
+            goto exception_taken;
+          default: /* Couldn't use a block */
+            break;
+        }
+#endif
+        pipeidx = ARMul_Threaded_Refill(state, pipe, 0, 0, 0, 0);
+        continue;
+      }
+
+      /* Exception, with the pipeline written back to pipe[] */
+      ARMword excep = state->Exception &~state->Reg[15];
+      pipeidx = 0;
+      if (excep & Exception_FIQ) {
+        Prof_BeginFunc(ARMul_Abort);
+        ARMul_Abort(state, ARMul_FIQV);
+        Prof_EndFunc(ARMul_Abort);
+      } else {
+        Prof_BeginFunc(ARMul_Abort);
+        ARMul_Abort(state, ARMul_IRQV);
+        Prof_EndFunc(ARMul_Abort);
+      }
+      break;
 #else
 /* pipeidx = 0 */
-      CycleCount local_time;
       ARMword excep;
       ARMword r15 = state->Reg[15];
       Prof_Begin("Fetch/decode");
@@ -1290,16 +2522,10 @@ ARMul_Emulate26(ARMul_State *state)
       }
       Prof_End("Fetch/decode");
 
-      local_time = ARMul_Time;
-      while(((CycleDiff) (local_time-state->EventQ[0].Time)) >= 0)
-      {
-        EventQ_Func func = state->EventQ[0].Func;
-        Prof_BeginFunc(func);
-        (func)(state,local_time);
-        Prof_EndFunc(func);
-      }
-
-      excep = state->Exception &~r15;
+      if (ARMul_Time >= state->EventHorizon)
+        excep = ARMul_ServiceEvents(state,r15);
+      else
+        excep = 0;
       
       /* Write back updated PC before handling exception/instruction */
       state->Reg[15] = r15;
@@ -1336,16 +2562,10 @@ ARMul_Emulate26(ARMul_State *state)
       }
       Prof_End("Fetch/decode");
 
-      local_time = ARMul_Time;
-      while(((CycleDiff) (local_time-state->EventQ[0].Time)) >= 0)
-      {
-        EventQ_Func func = state->EventQ[0].Func;
-        Prof_BeginFunc(func);
-        (func)(state,local_time);
-        Prof_EndFunc(func);
-      }
-
-      excep = state->Exception &~r15;
+      if (ARMul_Time >= state->EventHorizon)
+        excep = ARMul_ServiceEvents(state,r15);
+      else
+        excep = 0;
       
       /* Write back updated PC before handling exception/instruction */
       state->Reg[15] = r15;
@@ -1378,6 +2598,22 @@ ARMul_Emulate26(ARMul_State *state)
           break;
         default: /* The program counter has been changed */
         reset_pipe:
+#ifdef ARMUL_BLOCK_CACHE
+          if (state->BlockCache) { /* Block engine selected */
+            Prof_End("Fetch/decode");
+            switch (ARMul_RunBlocks(state, pipe)) {
+              case BLOCKRUN_PIPE: /* Resume from the pipeline state left by the block */
+                continue;
+              case BLOCKRUN_EXCEPTION:
+                pipeidx = 0;
+                goto exception_taken;
+              default: /* Couldn't use a block */
+                break;
+            }
+            Prof_Begin("Fetch/decode");
+            r15 = state->Reg[15];
+          }
+#endif
           state->Aborted = 0;
           ARMul_LoadInstrTriplet(state, r15, pipe);
           r15 += 8;
@@ -1386,16 +2622,10 @@ ARMul_Emulate26(ARMul_State *state)
       NORMALCYCLE;
       Prof_End("Fetch/decode");
 
-      local_time = ARMul_Time;
-      while(((CycleDiff) (local_time-state->EventQ[0].Time)) >= 0)
-      {
-        EventQ_Func func = state->EventQ[0].Func;
-        Prof_BeginFunc(func);
-        (func)(state,local_time);
-        Prof_EndFunc(func);
-      }
-
-      excep = state->Exception &~r15;
+      if (ARMul_Time >= state->EventHorizon)
+        excep = ARMul_ServiceEvents(state,r15);
+      else
+        excep = 0;
       
       /* Write back updated PC before handling exception/instruction */
       state->Reg[15] = r15;
@@ -1417,6 +2647,9 @@ ARMul_Emulate26(ARMul_State *state)
       execute_instruction(state,&pipe[0],r15);
 #endif
     } /* for loop */
+#ifdef ARMUL_BLOCK_CACHE
+exception_taken:
+#endif
 
     state->decoded = pipe[(pipeidx+1)%PIPESIZE].instr;
     state->loaded = pipe[(pipeidx+2)%PIPESIZE].instr;
@@ -59,6 +59,7 @@
 #include "c99.h"
 #include "arch/fastmap.h"
 #include <stdlib.h>
+#include <string.h>
 
 /***************************************************************************\
 *                           Condition code values                           *
@@ -334,6 +335,13 @@ static inline ARMword inlLHS(ARMul_State *state,ARMword r)
 #define WRITESDESTNORM(d) {DEST = d; \
                          ARMul_NegZero(state, d); }
 
+/* As WRITESDEST, for when ARMul_AddFlags/ARMul_SubFlags have already set N & Z */
+#define WRITESDESTARITH(d) { if (DESTReg == 15) \
+                                WriteSR15(state, d); \
+                             else \
+                                DEST = d; \
+                           }
+
 #define WRITESDESTPC(d) WriteSR15(state, d)
 
 #define LOADMULT(instr,address,wb) LoadMult(state,instr,address,wb)
@@ -361,7 +369,41 @@ extern uint_least8_t ARMul_BitList[];       /* Number of bits in a byte table */
 extern uint_least16_t ARMul_CCTable[16];
 #define ARMul_CCCheck(instr,psr) (ARMul_CCTable[instr>>28] & (1<<(psr>>28)))
 
-ARMword ARMul_SwitchMode(ARMul_State *state,ARMword oldmode, ARMword newmode);
+/***************************************************************************\
+* This routine controls the saving and restoring of registers across mode   *
+* changes.  Reg[] always holds the live view of the current bank, so only   *
+* the registers that are actually banked get moved: r13/r14 between the     *
+* USER, IRQ and SVC banks, and r8-r14 whenever FIQ mode is on either side.  *
+* Only rows 13 and 14 of the regbank matrix are used for the non-FIQ banks, *
+* 8 to 14 for FIQ, and the USER row also holds the unbanked copy of r8-r12  *
+* while in FIQ mode.  old and new parameter are modes numbers.              *
+* Notice the side effect of changing the Bank variable.                     *
+\***************************************************************************/
+
+static inline ARMword ARMul_SwitchMode(ARMul_State *state,ARMword oldmode, ARMword newmode)
+{
+ ARMword oldbank = oldmode & 3, newbank = newmode & 3;
+
+ state->Bank = newbank;
+ if (oldbank == newbank)
+    return(newmode);
+ if (oldbank == FIQBANK) {
+    memcpy(&state->RegBank[FIQBANK][8],&state->Reg[8],7*sizeof(ARMword));
+    memcpy(&state->Reg[8],&state->RegBank[USERBANK][8],5*sizeof(ARMword));
+    }
+ else {
+    state->RegBank[oldbank][13] = state->Reg[13];
+    state->RegBank[oldbank][14] = state->Reg[14];
+    if (newbank == FIQBANK) {
+       memcpy(&state->RegBank[USERBANK][8],&state->Reg[8],5*sizeof(ARMword));
+       memcpy(&state->Reg[8],&state->RegBank[FIQBANK][8],7*sizeof(ARMword));
+       return(newmode);
+       }
+    }
+ state->Reg[13] = state->RegBank[newbank][13];
+ state->Reg[14] = state->RegBank[newbank][14];
+ return(newmode);
+}
 
 /***************************************************************************\
 * This routine updates the state of the emulator after register 15 has      *
@@ -374,8 +416,12 @@ static inline void ARMul_R15Altered(ARMul_State *state)
  register ARMword mode = R15MODE;
  if (state->Bank != mode) {
     ARMul_SwitchMode(state,state->Bank,mode);
-    state->NtransSig = (mode)?HIGH:LOW;
-    FastMap_RebuildMapMode(state);
+    /* The memory map only depends on privilege, so IRQ/FIQ/SVC switches
+       needn't flush the fetch and block caches */
+    if (state->NtransSig != ((mode)?HIGH:LOW)) {
+       state->NtransSig = (mode)?HIGH:LOW;
+       FastMap_RebuildMapMode(state);
+       }
     }
 }
 
@@ -20,18 +20,21 @@
 
       case 0x1: {
         static const ARMEmuFunc funcs1[2][16]={
-          { EMFUNCDECL26(TstRegMrs1SwpNorm),EMFUNCDECL26(TstpRegNorm),EMFUNCDECL26(Noop),EMFUNCDECL26(TeqpRegNorm),
-            EMFUNCDECL26(CmpRegMrs2SwpNorm),EMFUNCDECL26(CmppRegNorm),EMFUNCDECL26(Noop),EMFUNCDECL26(CmnpRegNorm),
+          { EMFUNCDECL26(Noop),EMFUNCDECL26(TstpRegNorm),EMFUNCDECL26(Noop),EMFUNCDECL26(TeqpRegNorm),
+            EMFUNCDECL26(Noop),EMFUNCDECL26(CmppRegNorm),EMFUNCDECL26(Noop),EMFUNCDECL26(CmnpRegNorm),
             EMFUNCDECL26(OrrRegNorm),EMFUNCDECL26(OrrsRegNorm),EMFUNCDECL26(MovRegNorm),EMFUNCDECL26(MovsRegNorm),
             EMFUNCDECL26(BicRegNorm),EMFUNCDECL26(BicsRegNorm),EMFUNCDECL26(MvnRegNorm),EMFUNCDECL26(MvnsRegNorm)
           }, {
-            EMFUNCDECL26(TstRegMrs1SwpPC), EMFUNCDECL26(TstpRegPC), EMFUNCDECL26(Noop), EMFUNCDECL26(TeqpRegPC),
-            EMFUNCDECL26(CmpRegMrs2SwpPC), EMFUNCDECL26(CmppRegPC), EMFUNCDECL26(Noop), EMFUNCDECL26(CmnpRegPC),
+            EMFUNCDECL26(Noop), EMFUNCDECL26(TstpRegPC), EMFUNCDECL26(Noop), EMFUNCDECL26(TeqpRegPC),
+            EMFUNCDECL26(Noop), EMFUNCDECL26(CmppRegPC), EMFUNCDECL26(Noop), EMFUNCDECL26(CmnpRegPC),
             EMFUNCDECL26(OrrRegPC), EMFUNCDECL26(OrrsRegPC), EMFUNCDECL26(MovRegPC), EMFUNCDECL26(MovsRegPC),
             EMFUNCDECL26(BicRegPC), EMFUNCDECL26(BicsRegPC), EMFUNCDECL26(MvnRegPC), EMFUNCDECL26(MvnsRegPC)
           }
         };
-        f=funcs1[(DESTReg==15)][((int)BITS(20,23))];
+        if (((BITS(20,23) & ~4) == 0) && (BITS(4,7) == 9))
+          f = (BIT(22) ? EMFUNCDECL26(SwpB) : EMFUNCDECL26(Swp));
+        else
+          f=funcs1[(DESTReg==15)][((int)BITS(20,23))];
       };
       break;
 
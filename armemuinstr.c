@@ -176,7 +176,7 @@ static void EMFUNCDECL26(SubsReg) (ARMul_State *state, ARMword instr) {
              rhs = DPRegRHS;
              dest = lhs - rhs;
              ARMul_SubFlags(state,lhs,rhs,dest);
-             WRITESDEST(dest);
+             WRITESDESTARITH(dest);
 
 } /* EMFUNCDECL26(SubsReg */
 
@@ -199,7 +199,7 @@ static void EMFUNCDECL26(RsbsReg) (ARMul_State *state, ARMword instr) {
              rhs = DPRegRHS;
              dest = rhs - lhs;
              ARMul_SubFlags(state,rhs,lhs,dest);
-             WRITESDEST(dest);
+             WRITESDESTARITH(dest);
 
 } /* EMFUNCDECL26(RsbsReg */
 
@@ -223,7 +223,7 @@ static void EMFUNCDECL26(AddsReg) (ARMul_State *state, ARMword instr) {
              rhs = DPRegRHS;
              dest = lhs + rhs;
              ARMul_AddFlags(state,lhs,rhs,dest);
-             WRITESDEST(dest);
+             WRITESDESTARITH(dest);
 
 } /* EMFUNCDECL26(AddsReg */
 
@@ -248,7 +248,7 @@ static void EMFUNCDECL26(AdcsReg) (ARMul_State *state, ARMword instr) {
              rhs = DPRegRHS;
              dest = lhs + rhs + CFLAG;
              ARMul_AddFlags(state,lhs,rhs,dest);
-             WRITESDEST(dest);
+             WRITESDESTARITH(dest);
 
 } /* EMFUNCDECL26(AdcsReg */
 
@@ -272,7 +272,7 @@ static void EMFUNCDECL26(SbcsReg) (ARMul_State *state, ARMword instr) {
              rhs = DPRegRHS;
              dest = lhs - rhs - !CFLAG;
              ARMul_SubFlags(state,lhs,rhs,dest);
-             WRITESDEST(dest);
+             WRITESDESTARITH(dest);
 
 } /* EMFUNCDECL26(SbcsReg */
 
@@ -295,44 +295,72 @@ static void EMFUNCDECL26(RscsReg) (ARMul_State *state, ARMword instr) {
              rhs = DPRegRHS;
              dest = rhs - lhs - !CFLAG;
              ARMul_SubFlags(state,rhs,lhs,dest);
-             WRITESDEST(dest);
+             WRITESDESTARITH(dest);
 
 } /* EMFUNCDECL26(RscsReg */
 
-static void EMFUNCDECL26(TstRegMrs1SwpNorm) (ARMul_State *state, ARMword instr) {
+/* SWP and SWPB: decoded separately from the TST/CMP encodings they share,
+   so the model check is only paid by the instructions that need it */
+static void EMFUNCDECL26(Swp) (ARMul_State *state, ARMword instr) {
   register ARMword dest, temp;
 
   EMFUNC_CONDTEST
-             if (BITS(4,11) == 9) { /* SWP */
-                if (!state->HasSWP) {
-                  ARMul_Abort(state,ARMul_UndefinedInstrV);
-                  return;
-                }
+             if (BITS(8,11))
+                return;
+             if (!state->HasSWP) {
+                ARMul_Abort(state,ARMul_UndefinedInstrV);
+                return;
+             }
 
-                temp = LHS;
-                BUSUSEDINCPCS;
+             temp = LHS;
+             BUSUSEDINCPCS;
 
-                if (ADDREXCEPT(temp)) {
-                   dest = 0; /* Stop GCC warning, not sure what's appropriate */
-                   INTERNALABORT(temp);
-                   (void)ARMul_LoadWordN(state,temp);
-                   (void)ARMul_LoadWordN(state,temp);
+             if (ADDREXCEPT(temp)) {
+                dest = 0; /* Stop GCC warning, not sure what's appropriate */
+                INTERNALABORT(temp);
+                (void)ARMul_LoadWordN(state,temp);
+                (void)ARMul_LoadWordN(state,temp);
 
-                } else {
-                  dest = ARMul_SwapWord(state,temp,state->Reg[RHSReg]);
-                }
+             } else {
+               dest = ARMul_SwapWord(state,temp,state->Reg[RHSReg]);
+             }
 
-                if (temp & 3) {
-                  DEST = ARMul_Align(temp,dest);
-                } else {
-                  DEST = dest;
-                }
+             if (temp & 3) {
+               DEST = ARMul_Align(temp,dest);
+             } else {
+               DEST = dest;
+             }
 
-                if (state->abortSig || state->Aborted) {
-                  TAKEABORT;
-                }
+             if (state->abortSig || state->Aborted) {
+               TAKEABORT;
+             }
+
+} /* EMFUNCDECL26( */
+
+static void EMFUNCDECL26(SwpB) (ARMul_State *state, ARMword instr) {
+  register ARMword temp;
+  EMFUNC_CONDTEST
+
+             if (BITS(8,11))
+                return;
+             if (!state->HasSWP) {
+                ARMul_Abort(state,ARMul_UndefinedInstrV);
+                return;
              }
 
+             temp = LHS;
+             BUSUSEDINCPCS;
+             if (ADDREXCEPT(temp)) {
+                INTERNALABORT(temp);
+                (void)ARMul_LoadByte(state,temp);
+                (void)ARMul_LoadByte(state,temp);
+                }
+             else
+                DEST = ARMul_SwapByte(state,temp,state->Reg[RHSReg]);
+             if (state->abortSig || state->Aborted) {
+                TAKEABORT;
+                }
+
 } /* EMFUNCDECL26( */
 
 static void EMFUNCDECL26(TstpRegNorm) (ARMul_State *state, ARMword instr) {
@@ -355,32 +383,6 @@ static void EMFUNCDECL26(TeqpRegNorm) (ARMul_State *state, ARMword instr) {
   ARMul_NegZero(state,dest);
 } /* EMFUNCDECL26( */
 
-static void EMFUNCDECL26(CmpRegMrs2SwpNorm) (ARMul_State *state, ARMword instr) {
-  register ARMword temp;
-  EMFUNC_CONDTEST
-
-             if (BITS(4,11) == 9) { /* SWP */
-                if (!state->HasSWP) {
-                  ARMul_Abort(state,ARMul_UndefinedInstrV);
-                  return;
-                }
-
-                temp = LHS;
-                BUSUSEDINCPCS;
-                if (ADDREXCEPT(temp)) {
-                   INTERNALABORT(temp);
-                   (void)ARMul_LoadByte(state,temp);
-                   (void)ARMul_LoadByte(state,temp);
-                   }
-                else
-                DEST = ARMul_SwapByte(state,temp,state->Reg[RHSReg]);
-                if (state->abortSig || state->Aborted) {
-                   TAKEABORT;
-                   }
-                }
-
-} /* EMFUNCDECL26( */
-
 static void EMFUNCDECL26(CmppRegNorm) (ARMul_State *state, ARMword instr) {
   register ARMword dest;
   ARMword lhs,rhs;
@@ -389,7 +391,6 @@ static void EMFUNCDECL26(CmppRegNorm) (ARMul_State *state, ARMword instr) {
   lhs = LHS;
   rhs = DPRegRHS;
   dest = lhs - rhs;
-  ARMul_NegZero(state,dest);
   ARMul_SubFlags(state,lhs,rhs,dest);
 } /* EMFUNCDECL26( */
 
@@ -476,37 +477,6 @@ static void EMFUNCDECL26(MvnsRegNorm) (ARMul_State *state, ARMword instr) {
   WRITESDESTNORM(dest);
 } /* EMFUNCDECL26( */
 
-static void EMFUNCDECL26(TstRegMrs1SwpPC) (ARMul_State *state, ARMword instr) {
-  register ARMword dest, temp;
-
-  EMFUNC_CONDTEST
-             if (BITS(4,11) == 9) { /* SWP */
-                if (!state->HasSWP) {
-                  ARMul_Abort(state,ARMul_UndefinedInstrV);
-                  return;
-                }
-
-                temp = LHS;
-                BUSUSEDINCPCS;
-                if (ADDREXCEPT(temp)) {
-                   dest = 0; /* Stop GCC warning, not sure what's appropriate */
-                   INTERNALABORT(temp);
-                   (void)ARMul_LoadWordN(state,temp);
-                   (void)ARMul_LoadWordN(state,temp);
-                   }
-                else
-                  dest = ARMul_SwapWord(state,temp,state->Reg[RHSReg]);
-                if (temp & 3)
-                    DEST = ARMul_Align(temp,dest);
-                else
-                    DEST = dest;
-                if (state->abortSig || state->Aborted) {
-                   TAKEABORT;
-                   }
-                }
-
-} /* EMFUNCDECL26( */
-
 static void EMFUNCDECL26(TstpRegPC) (ARMul_State *state, ARMword instr) {
   register ARMword temp;
   ARMword rhs;
@@ -527,32 +497,6 @@ static void EMFUNCDECL26(TeqpRegPC) (ARMul_State *state, ARMword instr) {
   SETR15PSR(temp);
 } /* EMFUNCDECL26( */
 
-static void EMFUNCDECL26(CmpRegMrs2SwpPC) (ARMul_State *state, ARMword instr) {
-  register ARMword temp;
-  EMFUNC_CONDTEST
-
-             if (BITS(4,11) == 9) { /* SWP */
-                if (!state->HasSWP) {
-                  ARMul_Abort(state,ARMul_UndefinedInstrV);
-                  return;
-                }
-
-                temp = LHS;
-                BUSUSEDINCPCS;
-                if (ADDREXCEPT(temp)) {
-                   INTERNALABORT(temp);
-                   (void)ARMul_LoadByte(state,temp);
-                   (void)ARMul_LoadByte(state,temp);
-                   }
-                else
-                  DEST = ARMul_SwapByte(state,temp,state->Reg[RHSReg]);
-                if (state->abortSig || state->Aborted) {
-                   TAKEABORT;
-                   }
-                }
-
-} /* EMFUNCDECL26( */
-
 static void EMFUNCDECL26(CmppRegPC) (ARMul_State *state, ARMword instr) {
   register ARMword temp;
   ARMword rhs;
@@ -700,7 +644,7 @@ static void EMFUNCDECL26(SubsImmNorm) (ARMul_State *state, ARMword instr) {
              if (DESTReg == 15)
                 WRITESDESTPC(dest);
              else
-                WRITESDESTNORM(dest);
+                WRITEDESTNORM(dest);
 
 } /* EMFUNCDECL26( */
 
@@ -732,7 +676,7 @@ static void EMFUNCDECL26(RsbsImm) (ARMul_State *state, ARMword instr) {
              rhs = DPImmRHS;
              dest = rhs - lhs;
              ARMul_SubFlags(state,rhs,lhs,dest);
-             WRITESDEST(dest);
+             WRITESDESTARITH(dest);
 
 } /* EMFUNCDECL26( */
 
@@ -752,7 +696,7 @@ static void EMFUNCDECL26(AddsImm) (ARMul_State *state, ARMword instr) {
              rhs = DPImmRHS;
              dest = lhs + rhs;
              ARMul_AddFlags(state,lhs,rhs,dest);
-             WRITESDEST(dest);
+             WRITESDESTARITH(dest);
 
 } /* EMFUNCDECL26( */
 
@@ -772,7 +716,7 @@ static void EMFUNCDECL26(AdcsImm) (ARMul_State *state, ARMword instr) {
              rhs = DPImmRHS;
              dest = lhs + rhs + CFLAG;
              ARMul_AddFlags(state,lhs,rhs,dest);
-             WRITESDEST(dest);
+             WRITESDESTARITH(dest);
 
 } /* EMFUNCDECL26( */
 
@@ -791,7 +735,7 @@ static void EMFUNCDECL26(SbcsImm) (ARMul_State *state, ARMword instr) {
              rhs = DPImmRHS;
              dest = lhs - rhs - !CFLAG;
              ARMul_SubFlags(state,lhs,rhs,dest);
-             WRITESDEST(dest);
+             WRITESDESTARITH(dest);
 } /* EMFUNCDECL26( */
 
 static void EMFUNCDECL26(RscImm) (ARMul_State *state, ARMword instr) {
@@ -810,7 +754,7 @@ static void EMFUNCDECL26(RscsImm) (ARMul_State *state, ARMword instr) {
              rhs = DPImmRHS;
              dest = rhs - lhs - !CFLAG;
              ARMul_SubFlags(state,rhs,lhs,dest);
-             WRITESDEST(dest);
+             WRITESDESTARITH(dest);
 
 } /* EMFUNCDECL26( */
 
@@ -858,7 +802,6 @@ static void EMFUNCDECL26(CmppImm) (ARMul_State *state, ARMword instr) {
                 lhs = LHS; /* CMP immed */
                 rhs = DPImmRHS;
                 dest = lhs - rhs;
-                ARMul_NegZero(state,dest);
                 ARMul_SubFlags(state,lhs,rhs,dest);
                 }
 
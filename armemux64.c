@@ -0,0 +1,703 @@
+/*  armemux64.c -- x86-64 code generation for the block cache
+
+    Part of ArcEm released under the GNU GPL, see file COPYING for details.
+
+    Included by armemu.c when ARMUL_NATIVE_X64 is defined, and used by the
+    'native' CPU engine.
+
+    Once a block has been entered NATIVE_THRESHOLD times it's translated to
+    x86-64 code, which does the same job as the ARMul_RunBlocks loop for the
+    ops in the block:
+
+    - Data processing instructions with an immediate or immediate-shifted
+      register operand, which don't touch R15 (other than the flags), are
+      translated to the equivalent x86 instructions. Runs of them share a
+      single event check, since they can't change the event horizon.
+    - Everything else is a direct call to the op's handler, followed by the
+      same checks the loop makes after executing an instruction.
+
+    The generated code keeps the state in RBX and the loop's r15 value in
+    R12D, and returns to ARMul_RunBlocks (with r15 written back) whenever an
+    event is due, the PC is changed, the block is broken, or the end of the
+    block is reached. The return value says where to pick up in the loop:
+    the op index shifted left one, with bit 0 set if the op before it has
+    just been executed, or clear to continue from the top of that op.
+
+    Code is allocated from a single buffer, which is never writable and
+    executable at once (some hosts refuse RWX mappings): it's mapped RW, and
+    the free part of it is made writable while a block is translated and
+    executable again afterwards. Blocks never free their code; when the
+    buffer fills up the translation is abandoned (leaving the block to the
+    ARMul_RunBlocks loop), the whole block cache is flushed (from
+    ARMul_BlockCache_Translate, so never while native code is on the stack)
+    and the buffer is reused from the start. */
+
+#define NATIVE_THRESHOLD 16 /* Number of times a block is entered before it's translated */
+#define NATIVE_CODE_SIZE (16*1024*1024) /* Size of the code buffer */
+#define NATIVE_OP_BYTES 192 /* Upper bound on the code generated for one op */
+
+/* Registers */
+#define X64_EAX 0
+#define X64_ECX 1
+#define X64_EBX 3
+#define X64_ESI 6
+#define X64_EDI 7
+#define X64_R8D 8
+#define X64_R9D 9
+#define X64_R10D 10
+#define X64_R11D 11
+#define X64_R12D 12
+#define X64_R13D 13
+
+/* Condition codes for Jcc & SETcc */
+#define X64_CC_O 0x0
+#define X64_CC_B 0x2
+#define X64_CC_AE 0x3
+#define X64_CC_E 0x4
+#define X64_CC_NE 0x5
+#define X64_CC_A 0x7
+#define X64_CC_S 0x8
+
+/* ALU opcodes (the "op r/m32,r32" form) and their /digit for the immediate forms */
+#define X64_ADD 0x01
+#define X64_OR 0x09
+#define X64_ADC 0x11
+#define X64_SBB 0x19
+#define X64_AND 0x21
+#define X64_SUB 0x29
+#define X64_XOR 0x31
+#define X64_CMP 0x39
+#define X64_MOV 0x89
+#define X64_TEST 0x85
+#define X64_ALU_DIGIT(op) ((op)>>3)
+
+/* Shift /digits */
+#define X64_ROR 1
+#define X64_RCR 3
+#define X64_SHL 4
+#define X64_SHR 5
+#define X64_SAR 7
+
+#define STATE_OFS(field) ((uint32_t) offsetof(ARMul_State,field))
+
+/* Where to pick up in ARMul_RunBlocks, see above */
+#define NATIVE_EXIT_TOP(i) ((i)<<1)
+#define NATIVE_EXIT_EXECUTED(i) (((i)<<1)|1)
+#define NATIVE_NUM_EXITS (2*(BLOCK_MAX_OPS+1))
+
+/* Upper bound on the code generated for a block other than its ops: the
+   prologue, the epilogue and an exit stub for every exit */
+#define NATIVE_TAIL_BYTES (32+NATIVE_NUM_EXITS*10)
+
+typedef struct {
+  uint8_t *p;             /* Next byte to write */
+  uint8_t *End;           /* End of the buffer */
+  uint_fast16_t NumFixups;
+  struct {
+    uint8_t *Rel;         /* rel32 field to point at the exit stub */
+    uint32_t Exit;        /* Value to return */
+  } Fixups[NATIVE_NUM_EXITS*2];
+} X64_Asm;
+
+static inline void X64_Byte(X64_Asm *a,uint8_t b)
+{
+  *a->p++ = b;
+}
+
+static inline void X64_Imm32(X64_Asm *a,uint32_t v)
+{
+  memcpy(a->p,&v,4);
+  a->p += 4;
+}
+
+/* Check there's room for num more ops, and whatever follows them */
+static inline bool X64_Room(const X64_Asm *a,uint_fast16_t num)
+{
+  return (a->End - a->p) >= (ptrdiff_t) (NATIVE_TAIL_BYTES + num*NATIVE_OP_BYTES);
+}
+
+static void X64_Rex(X64_Asm *a,bool w,int reg,int rm)
+{
+  uint8_t rex = 0x40 | (w ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((rm & 8) ? 1 : 0);
+  if(rex != 0x40)
+    X64_Byte(a,rex);
+}
+
+/* op reg,rm or op rm,reg with register operands */
+static void X64_OpRR(X64_Asm *a,bool w,uint8_t op,int reg,int rm)
+{
+  X64_Rex(a,w,reg,rm);
+  X64_Byte(a,op);
+  X64_Byte(a,0xc0 | ((reg & 7)<<3) | (rm & 7));
+}
+
+/* As X64_OpRR, for 0F xx opcodes */
+static void X64_Op0FRR(X64_Asm *a,uint8_t op,int reg,int rm)
+{
+  X64_Rex(a,false,reg,rm);
+  X64_Byte(a,0x0f);
+  X64_Byte(a,op);
+  X64_Byte(a,0xc0 | ((reg & 7)<<3) | (rm & 7));
+}
+
+/* op with a [rbx+ofs] memory operand, i.e. a field of the ARMul_State */
+static void X64_OpState(X64_Asm *a,bool w,uint8_t op,int reg,uint32_t ofs)
+{
+  X64_Rex(a,w,reg,X64_EBX);
+  X64_Byte(a,op);
+  if(ofs < 128)
+  {
+    X64_Byte(a,0x40 | ((reg & 7)<<3) | X64_EBX);
+    X64_Byte(a,ofs);
+  }
+  else
+  {
+    X64_Byte(a,0x80 | ((reg & 7)<<3) | X64_EBX);
+    X64_Imm32(a,ofs);
+  }
+}
+
+static inline void X64_Load(X64_Asm *a,int reg,uint32_t ofs)
+{
+  X64_OpState(a,false,0x8b,reg,ofs);
+}
+
+static inline void X64_Store(X64_Asm *a,uint32_t ofs,int reg)
+{
+  X64_OpState(a,false,0x89,reg,ofs);
+}
+
+static void X64_MovRI(X64_Asm *a,int reg,uint32_t imm)
+{
+  X64_Rex(a,false,0,reg);
+  X64_Byte(a,0xb8 | (reg & 7));
+  X64_Imm32(a,imm);
+}
+
+/* ALU op with an immediate operand, op being one of the X64_ADD etc. values */
+static void X64_AluRI(X64_Asm *a,bool w,uint8_t op,int reg,uint32_t imm)
+{
+  if((imm < 128) || (imm >= 0xffffff80))
+  {
+    X64_OpRR(a,w,0x83,X64_ALU_DIGIT(op),reg);
+    X64_Byte(a,imm);
+  }
+  else
+  {
+    X64_OpRR(a,w,0x81,X64_ALU_DIGIT(op),reg);
+    X64_Imm32(a,imm);
+  }
+}
+
+static void X64_Shift(X64_Asm *a,int digit,int reg,uint_fast8_t amount)
+{
+  if(amount == 1)
+    X64_OpRR(a,false,0xd1,digit,reg);
+  else
+  {
+    X64_OpRR(a,false,0xc1,digit,reg);
+    X64_Byte(a,amount);
+  }
+}
+
+/* bt reg,bit */
+static void X64_BitTest(X64_Asm *a,int reg,uint_fast8_t bit)
+{
+  X64_Rex(a,false,0,reg);
+  X64_Byte(a,0x0f);
+  X64_Byte(a,0xba);
+  X64_Byte(a,0xe0 | (reg & 7));
+  X64_Byte(a,bit);
+}
+
+/* setcc on the low byte of reg */
+static void X64_SetCC(X64_Asm *a,uint8_t cc,int reg)
+{
+  X64_Op0FRR(a,0x90 | cc,0,reg);
+}
+
+/* Zero extend the low byte of reg (from X64_SetCC) and move it to the given bit */
+static void X64_FlagBit(X64_Asm *a,int reg,uint_fast8_t bit)
+{
+  X64_Op0FRR(a,0xb6,reg,reg); /* movzx */
+  X64_Shift(a,X64_SHL,reg,bit);
+}
+
+/* Forward jump, returns the rel32 field to be patched */
+static uint8_t *X64_Jcc(X64_Asm *a,uint8_t cc)
+{
+  X64_Byte(a,0x0f);
+  X64_Byte(a,0x80 | cc);
+  X64_Imm32(a,0);
+  return a->p-4;
+}
+
+static void X64_Patch(uint8_t *rel,const uint8_t *target)
+{
+  int32_t disp = (int32_t) (target-(rel+4));
+  memcpy(rel,&disp,4);
+}
+
+/* Conditional exit from the block */
+static void X64_ExitIf(X64_Asm *a,uint8_t cc,uint32_t exit)
+{
+  a->Fixups[a->NumFixups].Rel = X64_Jcc(a,cc);
+  a->Fixups[a->NumFixups].Exit = exit;
+  a->NumFixups++;
+}
+
+static void X64_Exit(X64_Asm *a,uint32_t exit)
+{
+  X64_Byte(a,0xe9); /* jmp rel32 */
+  X64_Imm32(a,0);
+  a->Fixups[a->NumFixups].Rel = a->p-4;
+  a->Fixups[a->NumFixups].Exit = exit;
+  a->NumFixups++;
+}
+
+/* Skip over the op if its condition fails. Returns the jump to patch, or
+   NULL if the op always executes. */
+static uint8_t *ARMul_Native_Condition(X64_Asm *a,ARMword instr)
+{
+  uint_least16_t mask = ARMul_CCTable[instr>>28];
+  if(mask == 0xffff)
+    return NULL;
+  X64_OpRR(a,false,X64_MOV,X64_R12D,X64_EAX);
+  X64_Shift(a,X64_SHR,X64_EAX,28);
+  X64_MovRI(a,X64_ECX,mask);
+  X64_Op0FRR(a,0xa3,X64_EAX,X64_ECX); /* bt ecx,eax */
+  return X64_Jcc(a,X64_CC_AE);
+}
+
+/* Exit before op i if an event is due before the last of the next num ops
+   has started */
+static void ARMul_Native_EventCheck(X64_Asm *a,uint_fast16_t i,uint_fast16_t num)
+{
+  X64_OpState(a,true,0x8b,X64_EAX,STATE_OFS(NumCycles));
+  if(num > 1)
+    X64_AluRI(a,true,X64_ADD,X64_EAX,num-1);
+  X64_OpState(a,true,0x3b,X64_EAX,STATE_OFS(EventHorizon));
+  X64_ExitIf(a,X64_CC_AE,NATIVE_EXIT_TOP(i));
+}
+
+/* Whether the instruction can be translated by ARMul_Native_DataProc */
+static bool ARMul_Native_CanTranslate(ARMword instr)
+{
+  ARMword opcode = BITS(21,24);
+  if(BITS(26,27))
+    return false;
+  if(!BIT(25) && (BIT(4) || (RHSReg == 15)))
+    return false; /* Register specified shift, multiply, swap, or reads R15 */
+  if((opcode & 0xc) == 0x8)
+  {
+    /* TST, TEQ, CMP, CMN. Without S these encodings are something else,
+       and with Rd == 15 they write the PSR */
+    if(!BIT(20) || (DESTReg == 15))
+      return false;
+  }
+  else if(DESTReg == 15)
+    return false;
+  if((opcode != 0xd) && (opcode != 0xf) && (LHSReg == 15))
+    return false;
+  return true;
+}
+
+/* How a logical op with S set affects the C flag */
+typedef enum {
+  NATIVE_C_KEEP,          /* Unchanged */
+  NATIVE_C_CLEAR,
+  NATIVE_C_SET,
+  NATIVE_C_R10            /* Shifter carry out, in R10B */
+} ARMul_NativeCarry;
+
+static void ARMul_Native_DataProc(X64_Asm *a,ARMword instr)
+{
+  ARMword opcode = BITS(21,24);
+  bool logical = ((opcode & 6) == 0) || (opcode >= 0xc); /* AND EOR TST TEQ ORR MOV BIC MVN */
+  bool s = BIT(20);
+  bool shiftercarry = s && logical;
+  bool borrow = false;
+  ARMul_NativeCarry carry = NATIVE_C_KEEP;
+  int dest = X64_EAX;
+  uint8_t *skip = ARMul_Native_Condition(a,instr);
+
+  /* Second operand in ECX */
+  if(BIT(25))
+  {
+    ARMword imm = DPImmRHS;
+    X64_MovRI(a,X64_ECX,imm);
+    if(BITS(8,11))
+      carry = (imm>>31) ? NATIVE_C_SET : NATIVE_C_CLEAR;
+  }
+  else
+  {
+    uint_fast8_t shamt = BITS(7,11);
+    X64_Load(a,X64_ECX,RHSReg*4);
+    switch(BITS(5,6)) {
+      case LSL:
+        if(!shamt)
+          break;
+        X64_Shift(a,X64_SHL,X64_ECX,shamt);
+        carry = NATIVE_C_R10;
+        break;
+      case LSR:
+        if(shamt)
+          X64_Shift(a,X64_SHR,X64_ECX,shamt);
+        else
+        {
+          /* LSR #32 */
+          X64_BitTest(a,X64_ECX,31);
+          if(shiftercarry)
+            X64_SetCC(a,X64_CC_B,X64_R10D);
+          X64_OpRR(a,false,X64_XOR,X64_ECX,X64_ECX);
+          shiftercarry = false;
+        }
+        carry = NATIVE_C_R10;
+        break;
+      case ASR:
+        if(shamt)
+          X64_Shift(a,X64_SAR,X64_ECX,shamt);
+        else
+        {
+          /* ASR #32 */
+          X64_BitTest(a,X64_ECX,31);
+          if(shiftercarry)
+            X64_SetCC(a,X64_CC_B,X64_R10D);
+          X64_Shift(a,X64_SAR,X64_ECX,31);
+          shiftercarry = false;
+        }
+        carry = NATIVE_C_R10;
+        break;
+      case ROR:
+        if(shamt)
+          X64_Shift(a,X64_ROR,X64_ECX,shamt);
+        else
+        {
+          /* RRX */
+          X64_BitTest(a,X64_R12D,29);
+          X64_Shift(a,X64_RCR,X64_ECX,1);
+        }
+        carry = NATIVE_C_R10;
+        break;
+    }
+    if(shiftercarry && (carry == NATIVE_C_R10))
+      X64_SetCC(a,X64_CC_B,X64_R10D);
+  }
+
+  /* First operand in EAX */
+  if((opcode != 0xd) && (opcode != 0xf))
+    X64_Load(a,X64_EAX,LHSReg*4);
+
+  switch(opcode) {
+    case 0x0: /* AND */
+    case 0x8: /* TST */
+      X64_OpRR(a,false,X64_AND,X64_ECX,X64_EAX);
+      break;
+    case 0x1: /* EOR */
+    case 0x9: /* TEQ */
+      X64_OpRR(a,false,X64_XOR,X64_ECX,X64_EAX);
+      break;
+    case 0x2: /* SUB */
+    case 0xa: /* CMP */
+      X64_OpRR(a,false,X64_SUB,X64_ECX,X64_EAX);
+      borrow = true;
+      break;
+    case 0x3: /* RSB */
+      X64_OpRR(a,false,X64_SUB,X64_EAX,X64_ECX);
+      dest = X64_ECX;
+      borrow = true;
+      break;
+    case 0x4: /* ADD */
+    case 0xb: /* CMN */
+      X64_OpRR(a,false,X64_ADD,X64_ECX,X64_EAX);
+      break;
+    case 0x5: /* ADC */
+      X64_BitTest(a,X64_R12D,29);
+      X64_OpRR(a,false,X64_ADC,X64_ECX,X64_EAX);
+      break;
+    case 0x6: /* SBC */
+      X64_BitTest(a,X64_R12D,29);
+      X64_Byte(a,0xf5); /* cmc */
+      X64_OpRR(a,false,X64_SBB,X64_ECX,X64_EAX);
+      borrow = true;
+      break;
+    case 0x7: /* RSC */
+      X64_BitTest(a,X64_R12D,29);
+      X64_Byte(a,0xf5); /* cmc */
+      X64_OpRR(a,false,X64_SBB,X64_EAX,X64_ECX);
+      dest = X64_ECX;
+      borrow = true;
+      break;
+    case 0xc: /* ORR */
+      X64_OpRR(a,false,X64_OR,X64_ECX,X64_EAX);
+      break;
+    case 0xd: /* MOV */
+      dest = X64_ECX;
+      if(s)
+        X64_OpRR(a,false,X64_TEST,X64_ECX,X64_ECX);
+      break;
+    case 0xe: /* BIC */
+      X64_OpRR(a,false,0xf7,2,X64_ECX); /* not */
+      X64_OpRR(a,false,X64_AND,X64_ECX,X64_EAX);
+      break;
+    case 0xf: /* MVN */
+      X64_OpRR(a,false,0xf7,2,X64_ECX); /* not */
+      dest = X64_ECX;
+      if(s)
+        X64_OpRR(a,false,X64_TEST,X64_ECX,X64_ECX);
+      break;
+  }
+
+  if(s)
+  {
+    ARMword mask = NBIT | ZBIT;
+    X64_SetCC(a,X64_CC_S,X64_R8D);
+    X64_SetCC(a,X64_CC_E,X64_R9D);
+    if(!logical)
+    {
+      X64_SetCC(a,(borrow ? X64_CC_AE : X64_CC_B),X64_R10D);
+      X64_SetCC(a,X64_CC_O,X64_R11D);
+      mask |= CBIT | VBIT;
+    }
+    X64_FlagBit(a,X64_R8D,31);
+    X64_FlagBit(a,X64_R9D,30);
+    X64_OpRR(a,false,X64_OR,X64_R9D,X64_R8D);
+    if(!logical || (carry == NATIVE_C_R10))
+    {
+      X64_FlagBit(a,X64_R10D,29);
+      X64_OpRR(a,false,X64_OR,X64_R10D,X64_R8D);
+      mask |= CBIT;
+    }
+    else if(carry != NATIVE_C_KEEP)
+      mask |= CBIT;
+    if(!logical)
+    {
+      X64_FlagBit(a,X64_R11D,28);
+      X64_OpRR(a,false,X64_OR,X64_R11D,X64_R8D);
+    }
+    X64_AluRI(a,false,X64_AND,X64_R12D,~mask);
+    X64_OpRR(a,false,X64_OR,X64_R8D,X64_R12D);
+    if(logical && (carry == NATIVE_C_SET))
+      X64_AluRI(a,false,X64_OR,X64_R12D,CBIT);
+  }
+
+  if((opcode & 0xc) != 0x8)
+    X64_Store(a,DESTReg*4,dest);
+
+  if(skip)
+    X64_Patch(skip,a->p);
+}
+
+/* Call the normal handler for op i, then make the same checks as the
+   ARMul_RunBlocks loop */
+static void ARMul_Native_Call(X64_Asm *a,const ARMul_Block *blk,uint_fast16_t i)
+{
+  const PipelineEntry *op = &blk->Ops[i];
+  uint8_t *skip, *normal;
+  uint64_t func = (uint64_t) (uintptr_t) op->func;
+
+  ARMul_Native_EventCheck(a,i,1);
+  X64_OpState(a,false,0xc7,0,STATE_OFS(NextInstr)); /* NORMALCYCLE */
+  X64_Imm32(a,NORMAL);
+  X64_Store(a,STATE_OFS(Reg[15]),X64_R12D);
+
+  skip = ARMul_Native_Condition(a,op->instr);
+  X64_OpRR(a,true,X64_MOV,X64_EBX,X64_EDI);
+  X64_MovRI(a,X64_ESI,op->instr);
+  X64_Byte(a,0x48); /* mov rax,func */
+  X64_Byte(a,0xb8);
+  X64_Imm32(a,(uint32_t) func);
+  X64_Imm32(a,(uint32_t) (func>>32));
+  X64_Byte(a,0xff); /* call rax */
+  X64_Byte(a,0xd0);
+  if(skip)
+    X64_Patch(skip,a->p);
+
+  X64_OpState(a,false,0x83,7,STATE_OFS(NextInstr)); /* cmp NextInstr,PCINCED */
+  X64_Byte(a,PCINCED);
+  X64_ExitIf(a,X64_CC_A,NATIVE_EXIT_EXECUTED(i+1));
+  X64_OpState(a,false,0x80,7,STATE_OFS(BlockBreak)); /* cmp BlockBreak,0 */
+  X64_Byte(a,0);
+  X64_ExitIf(a,X64_CC_NE,NATIVE_EXIT_EXECUTED(i+1));
+  if(i+1 == blk->NumOps)
+  {
+    X64_Exit(a,NATIVE_EXIT_EXECUTED(i+1));
+    return;
+  }
+
+  /* Fetch */
+  X64_Load(a,X64_R12D,STATE_OFS(Reg[15]));
+  X64_OpState(a,false,0x83,7,STATE_OFS(NextInstr)); /* cmp NextInstr,NORMAL */
+  X64_Byte(a,NORMAL);
+  normal = X64_Jcc(a,X64_CC_NE);
+  X64_AluRI(a,false,X64_ADD,X64_R12D,4);
+  X64_Patch(normal,a->p);
+  X64_OpState(a,true,0x83,0,STATE_OFS(NumCycles)); /* add NumCycles,1 */
+  X64_Byte(a,1);
+  X64_OpState(a,false,0xc6,0,STATE_OFS(abortSig)); /* ARMul_CLEARABORT */
+  X64_Byte(a,LOW);
+}
+
+/* Translate ops start to start+num-1, which are all data processing ops
+   accepted by ARMul_Native_CanTranslate */
+static void ARMul_Native_Run(X64_Asm *a,const ARMul_Block *blk,uint_fast16_t start,uint_fast16_t num)
+{
+  uint_fast16_t i;
+  bool last = (start+num == blk->NumOps);
+
+  /* None of these ops can change the event horizon, so one check covers them
+     all. abortSig is already clear, and nothing here sets it. */
+  ARMul_Native_EventCheck(a,start,num);
+  X64_OpState(a,false,0xc7,0,STATE_OFS(NextInstr)); /* NORMALCYCLE */
+  X64_Imm32(a,NORMAL);
+
+  /* Reg[15] is only read by the handlers & the events, so it's written once
+     at the end of the run */
+  for(i=start;i<start+num;i++)
+    ARMul_Native_DataProc(a,blk->Ops[i].instr);
+
+  if(last)
+  {
+    /* Leave r15 at the value used by the last op */
+    if(num > 1)
+    {
+      X64_AluRI(a,false,X64_ADD,X64_R12D,(num-1)*4);
+      X64_OpState(a,true,0x83,0,STATE_OFS(NumCycles));
+      X64_Byte(a,num-1);
+    }
+    X64_Store(a,STATE_OFS(Reg[15]),X64_R12D);
+    X64_Exit(a,NATIVE_EXIT_EXECUTED(blk->NumOps));
+  }
+  else
+  {
+    X64_AluRI(a,false,X64_ADD,X64_R12D,num*4);
+    X64_OpState(a,true,0x83,0,STATE_OFS(NumCycles));
+    X64_Byte(a,num);
+  }
+}
+
+/* Change the protection of the pages covering start to end */
+static bool ARMul_Native_Protect(uint8_t *start,uint8_t *end,int prot)
+{
+  uintptr_t mask = ((uintptr_t) sysconf(_SC_PAGESIZE))-1;
+  uintptr_t first = ((uintptr_t) start) & ~mask;
+  uintptr_t last = (((uintptr_t) end)+mask) & ~mask;
+  return !mprotect((void *) first,last-first,prot);
+}
+
+static bool ARMul_Native_Init(ARMul_BlockCache *cache)
+{
+  void *code;
+  if((sizeof(ARMStartIns) != 4) || (sizeof(bool) != 1) || (sizeof(CycleCount) != 8))
+    return false;
+  code = mmap(NULL,NATIVE_CODE_SIZE,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+  if(code == MAP_FAILED)
+    return false;
+  /* Find out now if the host will let us execute it */
+  if(!ARMul_Native_Protect(code,((uint8_t *) code)+NATIVE_CODE_SIZE,PROT_READ|PROT_EXEC))
+  {
+    munmap(code,NATIVE_CODE_SIZE);
+    return false;
+  }
+  cache->Code = cache->CodeNext = code;
+  cache->CodeEnd = cache->Code+NATIVE_CODE_SIZE;
+  cache->CodeFull = false;
+  return true;
+}
+
+static void ARMul_Native_Exit(ARMul_BlockCache *cache)
+{
+  if(cache->Code)
+    munmap(cache->Code,NATIVE_CODE_SIZE);
+  cache->Code = NULL;
+}
+
+static void ARMul_Native_Translate(ARMul_State *state,ARMul_Block *blk)
+{
+  ARMul_BlockCache *cache = state->BlockCache;
+  X64_Asm a;
+  uint8_t *epilogue, *stubs[NATIVE_NUM_EXITS];
+  uint_fast16_t i;
+
+  /* The rest of the buffer, including the tail of the page the last block
+     ended in */
+  if(!ARMul_Native_Protect(cache->CodeNext,cache->CodeEnd,PROT_READ|PROT_WRITE))
+    return;
+  a.p = cache->CodeNext;
+  a.End = cache->CodeEnd;
+  a.NumFixups = 0;
+
+  /* Prologue. Three pushes keep the stack 16 byte aligned for the calls */
+  X64_Byte(&a,0x53); /* push rbx */
+  X64_Byte(&a,0x41); /* push r12 */
+  X64_Byte(&a,0x54);
+  X64_Byte(&a,0x41); /* push r13 */
+  X64_Byte(&a,0x55);
+  X64_OpRR(&a,true,X64_MOV,X64_EDI,X64_EBX);
+  X64_OpRR(&a,true,X64_MOV,X64_ESI,X64_R13D);
+  X64_Byte(&a,0x45); /* mov r12d,[r13] */
+  X64_Byte(&a,0x8b);
+  X64_Byte(&a,0x65);
+  X64_Byte(&a,0x00);
+
+  for(i=0;i<blk->NumOps;)
+  {
+    uint_fast16_t num = 0;
+    while((i+num < blk->NumOps) && ARMul_Native_CanTranslate(blk->Ops[i+num].instr))
+      num++;
+    if(!X64_Room(&a,num ? num : 1))
+    {
+      /* Give up on this block, and flush the cache at the next opportunity */
+      cache->CodeFull = true;
+      if(!ARMul_Native_Protect(cache->CodeNext,cache->CodeNext,PROT_READ|PROT_EXEC))
+        ControlPane_Error(true,"Couldn't make the native code buffer executable");
+      return;
+    }
+    if(num)
+    {
+      ARMul_Native_Run(&a,blk,i,num);
+      i += num;
+    }
+    else
+    {
+      ARMul_Native_Call(&a,blk,i);
+      i++;
+    }
+  }
+
+  /* Epilogue, with r15 written back */
+  epilogue = a.p;
+  X64_Byte(&a,0x45); /* mov [r13],r12d */
+  X64_Byte(&a,0x89);
+  X64_Byte(&a,0x65);
+  X64_Byte(&a,0x00);
+  X64_Byte(&a,0x41); /* pop r13 */
+  X64_Byte(&a,0x5d);
+  X64_Byte(&a,0x41); /* pop r12 */
+  X64_Byte(&a,0x5c);
+  X64_Byte(&a,0x5b); /* pop rbx */
+  X64_Byte(&a,0xc3); /* ret */
+
+  /* Exit stubs, shared between all the exits to the same place */
+  memset(stubs,0,sizeof(stubs));
+  for(i=0;i<a.NumFixups;i++)
+  {
+    uint32_t exit = a.Fixups[i].Exit;
+    if(!stubs[exit])
+    {
+      stubs[exit] = a.p;
+      X64_MovRI(&a,X64_EAX,exit);
+      X64_Byte(&a,0xe9); /* jmp epilogue */
+      X64_Imm32(&a,0);
+      X64_Patch(a.p-4,epilogue);
+    }
+    X64_Patch(a.Fixups[i].Rel,stubs[exit]);
+  }
+
+  if(!ARMul_Native_Protect(cache->CodeNext,a.p,PROT_READ|PROT_EXEC))
+    ControlPane_Error(true,"Couldn't make the native code buffer executable");
+
+  blk->Native = (ARMul_NativeFunc) (void *) cache->CodeNext;
+  /* Keep the code 16 byte aligned */
+  cache->CodeNext = (uint8_t *) ((((uintptr_t) a.p)+15) & ~(uintptr_t) 15);
+}
@@ -16,6 +16,7 @@
     Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
 
 #include <stdlib.h>
+#include <string.h>
 #include "armdefs.h"
 #include "armemu.h"
 #include "armcopro.h"
@@ -26,8 +27,6 @@
 #include "eventq.h"
 #include "hostfs.h"
 
-FastMapEntry FastMap[FASTMAP_SIZE];
-
 /***************************************************************************\
 *                 Definitions for the emulator architecture                 *
 \***************************************************************************/
@@ -48,9 +47,17 @@ uint_least16_t ARMul_CCTable[16];
 *         Call this routine once to set up the emulator's tables.           *
 \***************************************************************************/
 
+/* The tables are shared by all instances, and are built by the first call
+   (normally via the first ARMul_NewState). There's no locking, so that first
+   call must complete before any other thread creates an ARMul_State; once it
+   has, the tables are read-only and later calls return straight away. */
 void ARMul_EmulateInit(void) {
+  static bool done = false;
   unsigned int i, j;
 
+  if (done)
+    return;
+
 #ifdef ARMUL_USE_IMMEDTABLE
   for (i = 0; i < 4096; i++) { /* the values of 12 bit dp rhs's */
     ARMul_ImmedTable[i] = ROTATER(i & 0xffL,(i >> 7L) & 0x1eL);
@@ -92,6 +99,13 @@ void ARMul_EmulateInit(void) {
 #undef Z
 #undef N
 #undef COMPUTE
+
+#ifdef ARMUL_INSTR_FUNC_INDEX
+  ARMul_EmuFuncTable_Init();
+#endif
+
+  /* Only mark as done once everything is built */
+  done = true;
 }
 
 
@@ -111,6 +125,9 @@ ARMul_State *ARMul_NewState(ArcemConfig *pConfig)
     return NULL;
  }
 
+ /* Everything not explicitly set up below starts off as zero */
+ memset(state,0,sizeof(ARMul_State));
+
  for (i = 0; i < 16; i++) {
     state->Reg[i] = 0;
     for (j = 0; j < 4; j++)
@@ -119,9 +136,26 @@ ARMul_State *ARMul_NewState(ArcemConfig *pConfig)
 
  state->Aborted = ARMul_ResetV;
  state->Display = NULL;
- state->FastMap = FastMap;
  state->Config  = pConfig;
 
+ state->FastMap = calloc(FASTMAP_SIZE,sizeof(FastMapEntry));
+ if (!state->FastMap) {
+    ControlPane_Error(false,"Could not allocate FastMap");
+    state_free(state);
+    return NULL;
+ }
+ if (!EventQ_Init(state)) {
+    free(state->FastMap);
+    state_free(state);
+    return NULL;
+ }
+ if (!EmuRate_Init(state)) {
+    EventQ_Exit(state);
+    free(state->FastMap);
+    state_free(state);
+    return NULL;
+ }
+
  switch (CONFIG.eProcessor) {
  case Processor_ARM2:
      state->HasSWP  = false;
@@ -137,9 +171,8 @@ ARMul_State *ARMul_NewState(ArcemConfig *pConfig)
      state->HasCP15 = true;
      break;
  }
+ state->HasFPA = CONFIG.bFPA;
  
- ARMul_Reset(state);
- EventQ_Init(state);
  ARMul_Reset(state);
  if (!ARMul_MemoryInit(state)) {
     ARMul_FreeState(state);
@@ -156,6 +189,11 @@ ARMul_State *ARMul_NewState(ArcemConfig *pConfig)
     ARMul_FreeState(state);
     return NULL;
  }
+ if (state->HasFPA) {
+    ControlPane_Error(false,"FPA support is not available in this build of ArcEm. Exiting");
+    ARMul_FreeState(state);
+    return NULL;
+ }
 #endif
  ARMul_Reset(state);
 
@@ -172,6 +210,8 @@ void ARMul_FreeState(ARMul_State *state)
  ARMul_CoProExit(state);
 #endif
  ARMul_MemoryExit(state);
+ EventQ_Exit(state);
+ free(state->FastMap);
  state_free(state);
 }
 
@@ -188,10 +228,12 @@ void ARMul_Reset(ARMul_State *state)
 
  state->Exception = 0;
  state->NtransSig = (R15MODE) ? HIGH : LOW;
+ ARMul_FetchCache_Invalidate(state);
  state->abortSig = LOW;
  state->AbortAddr = 1;
 
  state->NumCycles = 0;
+ EventQ_UpdateHorizon(state);
 }
 
 void ARMul_Exit(ARMul_State *state, uint_least8_t exit_code) {
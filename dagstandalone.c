@@ -25,6 +25,7 @@
 #include "dagstandalone.h"
 #include "armdefs.h"
 #include "arch/ArcemConfig.h"
+#include "prof.h"
 
 static ArcemConfig hArcemConfig;
 
@@ -67,7 +68,13 @@ int dagstandalone(int argc, char *argv[]) {
   }
 
   /* Execute */
+#ifndef SYSTEM_riscos_single /* RISC OS drives the profiler from its tweak menu */
+  Prof_Init();
+#endif
   exit_code = ARMul_DoProg(state);
+#ifndef SYSTEM_riscos_single
+  Prof_Dump(stderr);
+#endif
 
   /* Finalise */
   ARMul_FreeState(state);
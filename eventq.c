@@ -11,18 +11,84 @@
   so real-time events will need an extra helping hand (e.g. ARMul_EmuRate)
 */
 
+#include <stdlib.h>
 #include "eventq.h"
+#include "arch/ControlPane.h"
+
+/* Initial number of entries; the queue grows on demand */
+#define EVENTQ_INITIAL_SIZE 8
 
 static void DummyEventFunc(ARMul_State *state,CycleCount nowtime)
 {
 	/* Queue should (must!) be empty, so just poke our time value */
-	state->EventQ[0].Time = nowtime+MAX_CYCLES_INTO_FUTURE;
+	UNUSED_VAR(nowtime);
+	state->EventQ[0].Time = CYCLE_COUNT_NEVER;
+	EventQ_UpdateHorizon(state);
+}
+
+/* Add handles [from,to) to the free list */
+static void EventQ_FreeHandles(ARMul_State *state,int from,int to)
+{
+	while(to > from)
+	{
+		state->EventQPos[--to] = state->EventQFree;
+		state->EventQFree = to;
+	}
 }
 
-void EventQ_Init(ARMul_State *state)
+void EventQ_Clear(ARMul_State *state)
 {
 	/* When empty, the first entry in the queue is a dummy entry so that the main loop doesn't have to worry about checking for an empty queue */
 	state->NumEvents = 0;
-	state->EventQ[0].Time = ARMul_Time+MAX_CYCLES_INTO_FUTURE;
+	state->EventQ[0].Time = CYCLE_COUNT_NEVER;
 	state->EventQ[0].Func = DummyEventFunc;
+	state->EventQ[0].Handle = 0;
+	EventQ_UpdateHorizon(state);
+}
+
+bool EventQ_Init(ARMul_State *state)
+{
+	state->EventQ = malloc(sizeof(EventQ_Entry)*EVENTQ_INITIAL_SIZE);
+	state->EventQPos = malloc(sizeof(int)*EVENTQ_INITIAL_SIZE);
+	if(!state->EventQ || !state->EventQPos)
+	{
+		ControlPane_Error(false,"Couldn't allocate event queue");
+		EventQ_Exit(state);
+		return false;
+	}
+	state->EventQSize = EVENTQ_INITIAL_SIZE;
+	state->EventQFree = -1;
+	EventQ_FreeHandles(state,0,EVENTQ_INITIAL_SIZE);
+	EventQ_Clear(state);
+	return true;
+}
+
+void EventQ_Exit(ARMul_State *state)
+{
+	free(state->EventQ);
+	free(state->EventQPos);
+	state->EventQ = NULL;
+	state->EventQPos = NULL;
+	state->EventQSize = 0;
+	state->NumEvents = 0;
+}
+
+void EventQ_Grow(ARMul_State *state)
+{
+	int oldsize = state->EventQSize;
+	int newsize = oldsize*2;
+	EventQ_Entry *q = realloc(state->EventQ,sizeof(EventQ_Entry)*newsize);
+	int *pos;
+	if(q)
+		state->EventQ = q;
+	pos = realloc(state->EventQPos,sizeof(int)*newsize);
+	if(pos)
+		state->EventQPos = pos;
+	if(!q || !pos)
+	{
+		ControlPane_Error(true,"Couldn't grow event queue to %d entries",newsize);
+		return;
+	}
+	state->EventQSize = newsize;
+	EventQ_FreeHandles(state,oldsize,newsize);
 }
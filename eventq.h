@@ -10,92 +10,129 @@
   Events are scheduled using the cycle counter (ARMul_Time) as the time base,
   so real-time events will need an extra helping hand (e.g. ARMul_EmuRate)
 
+  The queue is a binary min-heap stored in state->EventQ, so the next event
+  to fire is always EventQ[0]. Each entry is identified by a stable handle;
+  state->EventQPos maps handles to heap positions so that arbitrary entries
+  can be rescheduled or removed in O(log n).
+
   See also armdefs.h for more docs
 */
 
 #ifndef EVENTQ_H
 #define EVENTQ_H
 
-#include <string.h>
 #include "armdefs.h"
 
 /* Event queue functions */
 
-/* Initialise the queue */
-extern void EventQ_Init(ARMul_State *state);
+/* Allocate and initialise the queue, returns false on failure */
+extern bool EventQ_Init(ARMul_State *state);
+
+/* Free the queue */
+extern void EventQ_Exit(ARMul_State *state);
+
+/* Reset the queue to the empty state */
+extern void EventQ_Clear(ARMul_State *state);
 
-/* Remove an entry with a certain index */
-static inline void EventQ_Remove(ARMul_State *state,int idx)
+/* Enlarge the queue storage, called by EventQ_Insert when full */
+extern void EventQ_Grow(ARMul_State *state);
+
+/* Recalculate the event horizon, must be called after any change to the
+   head of the queue or to state->Exception */
+static inline void EventQ_UpdateHorizon(ARMul_State *state)
 {
-	if(--state->NumEvents)
+	/* If an interrupt is being requested, force the core to check at the next
+	   instruction (and keep checking until the request goes away) */
+	state->EventHorizon = (state->Exception ? ARMul_Time : state->EventQ[0].Time);
+}
+
+/* Store an entry at the given heap position, moving it up or down as
+   necessary to restore the heap ordering */
+static inline void EventQ_Place(ARMul_State *state,int idx,EventQ_Entry entry)
+{
+	EventQ_Entry *q = state->EventQ;
+	int num = state->NumEvents;
+	while(idx > 0)
 	{
-		memmove(&state->EventQ[idx],&state->EventQ[idx+1],sizeof(EventQ_Entry)*(state->NumEvents-idx));
+		int parent = (idx-1)>>1;
+		if(q[parent].Time <= entry.Time)
+			break;
+		q[idx] = q[parent];
+		state->EventQPos[q[idx].Handle] = idx;
+		idx = parent;
 	}
-	else
+	for(;;)
 	{
-		EventQ_Init(state); /* Unlikely case */
+		int child = 2*idx+1;
+		if(child >= num)
+			break;
+		if((child+1 < num) && (q[child+1].Time < q[child].Time))
+			child++;
+		if(q[child].Time >= entry.Time)
+			break;
+		q[idx] = q[child];
+		state->EventQPos[q[idx].Handle] = idx;
+		idx = child;
 	}
+	q[idx] = entry;
+	state->EventQPos[entry.Handle] = idx;
 }
 
-/* Reschedule an arbitrary entry, returns new index */
-static inline int EventQ_Reschedule(ARMul_State *state,CycleCount eventtime,EventQ_Func func,int idx)
+/* Remove the entry with the given handle. The handle becomes invalid. */
+static inline void EventQ_Remove(ARMul_State *state,EventQ_Handle handle)
 {
-	int top = state->NumEvents-1;
-	while((idx > 0) && (((CycleDiff) (state->EventQ[idx-1].Time-eventtime)) > 0))
+	int idx = state->EventQPos[handle];
+	/* Return the handle to the free list */
+	state->EventQPos[handle] = state->EventQFree;
+	state->EventQFree = handle;
+	if(--state->NumEvents)
 	{
-		state->EventQ[idx] = state->EventQ[idx-1];
-		idx--;
+		if(idx != state->NumEvents)
+			EventQ_Place(state,idx,state->EventQ[state->NumEvents]);
+		EventQ_UpdateHorizon(state);
 	}
-	while((idx < top) && (((CycleDiff) (state->EventQ[idx+1].Time-eventtime)) < 0))
+	else
 	{
-		state->EventQ[idx] = state->EventQ[idx+1];
-		idx++;
+		EventQ_Clear(state); /* Unlikely case */
 	}
-	state->EventQ[idx].Time = eventtime;
-	state->EventQ[idx].Func = func;
-	return idx;
 }
 
-/* Reschedule the head entry, returns new index */
-static inline int EventQ_RescheduleHead(ARMul_State *state,CycleCount eventtime,EventQ_Func func)
+/* Reschedule an arbitrary entry. The handle remains valid. */
+static inline void EventQ_Reschedule(ARMul_State *state,CycleCount eventtime,EventQ_Func func,EventQ_Handle handle)
 {
-	return EventQ_Reschedule(state,eventtime,func,0);
+	EventQ_Entry entry;
+	entry.Time = eventtime;
+	entry.Func = func;
+	entry.Handle = handle;
+	EventQ_Place(state,state->EventQPos[handle],entry);
+	EventQ_UpdateHorizon(state);
 }
 
-/* Insert new entry, returns index */
-static inline int EventQ_Insert(ARMul_State *state,CycleCount eventtime,EventQ_Func func)
+/* Reschedule the head entry */
+static inline void EventQ_RescheduleHead(ARMul_State *state,CycleCount eventtime,EventQ_Func func)
 {
-	/* Assume new events will occur far in the future, so insert from back */
-	int idx = state->NumEvents++;
-	while((idx > 0) && (((CycleDiff) (state->EventQ[idx-1].Time-eventtime)) > 0))
-	{
-		state->EventQ[idx] = state->EventQ[idx-1];
-		idx--;
-	}
-	state->EventQ[idx].Time = eventtime;
-	state->EventQ[idx].Func = func;
-	return idx;
+	EventQ_Reschedule(state,eventtime,func,state->EventQ[0].Handle);
 }
 
-/* Return index of given event func, or -1 if not found */
-static inline int EventQ_Find(ARMul_State *state,EventQ_Func func)
+/* Insert new entry, returns its handle */
+static inline EventQ_Handle EventQ_Insert(ARMul_State *state,CycleCount eventtime,EventQ_Func func)
 {
-	int idx = state->NumEvents;
-	while(--idx >= 0)
-	{
-		if(state->EventQ[idx].Func == func)
-			break;
-	}
-	return idx;
+	EventQ_Entry entry;
+	if(state->EventQFree < 0)
+		EventQ_Grow(state);
+	entry.Time = eventtime;
+	entry.Func = func;
+	entry.Handle = state->EventQFree;
+	state->EventQFree = state->EventQPos[entry.Handle];
+	EventQ_Place(state,state->NumEvents++,entry);
+	EventQ_UpdateHorizon(state);
+	return entry.Handle;
 }
 
-/* Return index of given event func, searching forward. Func must exist! */
-static inline int EventQ_Find2(ARMul_State *state,EventQ_Func func)
+/* Return the time an entry is scheduled for */
+static inline CycleCount EventQ_GetTime(ARMul_State *state,EventQ_Handle handle)
 {
-	int idx = 0;
-	while(state->EventQ[idx].Func != func)
-		idx++;
-	return idx;
+	return state->EventQ[state->EventQPos[handle]].Time;
 }
 
 #endif
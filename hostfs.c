@@ -175,6 +175,7 @@ typedef struct {
  */
 typedef struct {
   size_t name_offset; /**< Offset within cache_names[] */
+  const char *name; /**< Pointer into cache_names[], only valid while sorting */
   risc_os_object_info object_info;
 } cache_directory_entry;
 
@@ -197,17 +198,28 @@ typedef struct {
 /** Disc name of default disc or if no disc name is present */
 static const char *const disc_name_default = "HostFS";
 
-static FILE *open_file[MAX_OPEN_FILES + 1]; /* array subscript 0 is never used */
+struct HostFSStruct {
+  FILE *open_file[MAX_OPEN_FILES + 1]; /* array subscript 0 is never used */
 
-static uint8_t *buffer = NULL;
-static size_t buffer_size = 0;
+  uint8_t *buffer;
+  size_t buffer_size;
 
-static cache_directory_entry *cache_entries = NULL;
-static unsigned cache_entries_count = 0; /**< Number of valid entries in \a cache_entries */
-static char *cache_names = NULL;
+  cache_directory_entry *cache_entries;
+  unsigned cache_entries_count; /**< Number of valid entries in \a cache_entries */
+  unsigned cache_entries_capacity; /**< Allocated size of \a cache_entries */
+  char *cache_names;
+  unsigned cache_names_capacity; /**< Allocated size of \a cache_names */
 
-/** Current registration state of HostFS module with backend code */
-static HostFSState hostfs_state = HOSTFS_STATE_UNREGISTERED;
+  /** Current registration state of HostFS module with backend code */
+  HostFSState registration;
+};
+
+#ifdef HOSTFS_ARCEM
+#define HOSTFS (*(state->HostFS))
+#else
+static struct HostFSStruct hostfs_instance;
+#define HOSTFS hostfs_instance
+#endif
 
 static void
 path_construct(ARMul_State *state, const char *old_path, const char *ro_path,
@@ -275,18 +287,19 @@ hostfs_disc_name_valid(const char *disc_name)
 }
 
 /**
+ * @param state Emulator state
  * @param buffer_size_needed Required buffer
  */
 static void
-hostfs_ensure_buffer_size(size_t buffer_size_needed)
+hostfs_ensure_buffer_size(ARMul_State *state, size_t buffer_size_needed)
 {
-  if (buffer_size_needed > buffer_size) {
-    buffer = realloc(buffer, buffer_size_needed);
-    if (!buffer) {
+  if (buffer_size_needed > HOSTFS.buffer_size) {
+    HOSTFS.buffer = realloc(HOSTFS.buffer, buffer_size_needed);
+    if (!HOSTFS.buffer) {
       hostfs_error(true,"HostFS could not increase buffer size to %"PRIuSIZE" bytes",
               buffer_size_needed);
     }
-    buffer_size = buffer_size_needed;
+    HOSTFS.buffer_size = buffer_size_needed;
   }
 }
 
@@ -1004,7 +1017,7 @@ hostfs_path_process(ARMul_State *state,
    A return of 0 indicates that no array index could be allocated.
  */
 static unsigned
-hostfs_open_allocate_index(void)
+hostfs_open_allocate_index(ARMul_State *state)
 {
   unsigned i;
 
@@ -1013,7 +1026,7 @@ hostfs_open_allocate_index(void)
   /* Start our search at array index 1.
      Reserve a return of 0 for a special meaning: no free entry */
   for (i = 1; i < (MAX_OPEN_FILES + 1); i++) {
-    if (open_file[i] == NULL) {
+    if (HOSTFS.open_file[i] == NULL) {
       return i;
     }
   }
@@ -1049,7 +1062,7 @@ hostfs_open(ARMul_State *state)
   /* TODO Handle the case that a file exists to be replaced, (and the filetype is
      not data - the recommeded default for new files) */
 
-  idx = hostfs_open_allocate_index();
+  idx = hostfs_open_allocate_index(state);
   if (idx == 0) {
     /* No more space in the open_file[] array.
        This should never occur, because RISC OS is constraining the max
@@ -1061,7 +1074,7 @@ hostfs_open(ARMul_State *state)
   switch (state->Reg[0]) {
   case OPEN_MODE_READ:
     dbug_hostfs("\tOpen for read\n");
-    open_file[idx] = fopen64(host_pathname, "rb");
+    HOSTFS.open_file[idx] = fopen64(host_pathname, "rb");
     state->Reg[0] = FILE_INFO_WORD_READ_OK;
     break;
 
@@ -1071,22 +1084,22 @@ hostfs_open(ARMul_State *state)
 
   case OPEN_MODE_UPDATE:
     dbug_hostfs("\tOpen for update\n");
-    open_file[idx] = fopen64(host_pathname, "rb+");
+    HOSTFS.open_file[idx] = fopen64(host_pathname, "rb+");
     state->Reg[0] = (uint32_t) (FILE_INFO_WORD_READ_OK | FILE_INFO_WORD_WRITE_OK);
     break;
   }
 
   /* Check for errors from opening the file */
-  if (open_file[idx] == NULL) {
+  if (HOSTFS.open_file[idx] == NULL) {
     state->Reg[1] = 0; /* Signal to RISC OS file not found */
     state->Reg[9] = errno_to_hostfs_error(host_pathname,__func__,"open");
     return;
   }
 
   /* Find the extent of the file */
-  fseeko64(open_file[idx], 0, SEEK_END);
-  state->Reg[3] = (ARMword) ftello64(open_file[idx]);
-  rewind(open_file[idx]); /* Return to start */
+  fseeko64(HOSTFS.open_file[idx], 0, SEEK_END);
+  state->Reg[3] = (ARMword) ftello64(HOSTFS.open_file[idx]);
+  rewind(HOSTFS.open_file[idx]); /* Return to start */
 
   dbug_hostfs("\tFile opened OK, handle %u, size %"PRIu32"\n",idx,state->Reg[3]);
 
@@ -1099,7 +1112,7 @@ hostfs_open(ARMul_State *state)
 static void
 hostfs_getbytes(ARMul_State *state)
 {
-  FILE *f = open_file[state->Reg[1]];
+  FILE *f = HOSTFS.open_file[state->Reg[1]];
   ARMword ptr = state->Reg[2];
 
   assert(state);
@@ -1119,7 +1132,7 @@ hostfs_getbytes(ARMul_State *state)
 static void
 hostfs_putbytes(ARMul_State *state)
 {
-  FILE *f = open_file[state->Reg[1]];
+  FILE *f = HOSTFS.open_file[state->Reg[1]];
   ARMword ptr = state->Reg[2];
 
   assert(state);
@@ -1144,7 +1157,7 @@ hostfs_args_3_write_file_extent(ARMul_State *state)
 
   assert(state);
 
-  f = open_file[state->Reg[1]];
+  f = HOSTFS.open_file[state->Reg[1]];
 
   dbug_hostfs("\tWrite file extent\n");
   dbug_hostfs("\tr1 = %"PRIu32" (our file handle)\n", state->Reg[1]);
@@ -1183,7 +1196,7 @@ hostfs_args_7_ensure_file_size(ARMul_State *state)
 
   assert(state);
 
-  f = open_file[state->Reg[1]];
+  f = HOSTFS.open_file[state->Reg[1]];
 
   dbug_hostfs("\tEnsure file size\n");
   dbug_hostfs("\tr1 = %"PRIu32" (our file handle)\n", state->Reg[1]);
@@ -1203,7 +1216,7 @@ hostfs_args_8_write_zeros(ARMul_State *state)
 
   assert(state);
 
-  f = open_file[state->Reg[1]];
+  f = HOSTFS.open_file[state->Reg[1]];
 
   dbug_hostfs("\tWrite zeros to file\n");
   dbug_hostfs("\tr1 = %"PRIu32" (our file handle)\n", state->Reg[1]);
@@ -1212,15 +1225,15 @@ hostfs_args_8_write_zeros(ARMul_State *state)
 
   fseeko64(f, (off64_t) state->Reg[2], SEEK_SET);
 
-  hostfs_ensure_buffer_size(BUFSIZE);
-  memset(buffer, 0, BUFSIZE);
+  hostfs_ensure_buffer_size(state, BUFSIZE);
+  memset(HOSTFS.buffer, 0, BUFSIZE);
 
   length = state->Reg[3];
   while (length > 0) {
     size_t buffer_amount = MIN(length, BUFSIZE);
     size_t written;
 
-    written = fwrite(buffer, 1, buffer_amount, f);
+    written = fwrite(HOSTFS.buffer, 1, buffer_amount, f);
     if (written < buffer_amount) {
       warn_hostfs("fwrite(): %s\n", strerror(errno));
       return;
@@ -1267,7 +1280,7 @@ hostfs_close(ARMul_State *state)
 
   assert(state);
 
-  f = open_file[state->Reg[1]];
+  f = HOSTFS.open_file[state->Reg[1]];
   load = state->Reg[2];
   exec = state->Reg[3];
 
@@ -1280,7 +1293,7 @@ hostfs_close(ARMul_State *state)
   fclose(f);
 
   /* Free up the open_file[] entry */
-  open_file[state->Reg[1]] = NULL;
+  HOSTFS.open_file[state->Reg[1]] = NULL;
 
   /* If load and exec addresses are both 0, then nothing to do */
   if (load == 0 && exec == 0) {
@@ -1369,12 +1382,12 @@ hostfs_write_file(ARMul_State *state, bool with_data)
     bytes_written = File_WriteRAM(state,f,ptr,length);
   } else {
     /* Fill the data buffer with 0's if we are not saving supplied data */
-    hostfs_ensure_buffer_size(BUFSIZE);
-    memset(buffer, 0, BUFSIZE);
+    hostfs_ensure_buffer_size(state, BUFSIZE);
+    memset(HOSTFS.buffer, 0, BUFSIZE);
     while(length > 0) {
       size_t buffer_amount = MIN(length,BUFSIZE);
       /* TODO check for errors */
-      size_t temp = fwrite(buffer, 1, buffer_amount, f);
+      size_t temp = fwrite(HOSTFS.buffer, 1, buffer_amount, f);
       length -= temp;
       bytes_written += temp;
       if(temp != buffer_amount)
@@ -1798,25 +1811,22 @@ hostfs_directory_entry_compare(const void *e1, const void *e2)
 {
   const cache_directory_entry *entry1 = e1;
   const cache_directory_entry *entry2 = e2;
-  const char *name1 = cache_names + entry1->name_offset;
-  const char *name2 = cache_names + entry2->name_offset;
 
-  return STRCASEEQ(name1, name2);
+  return STRCASEEQ(entry1->name, entry2->name);
 }
 
 /**
  * Reads the entries in the directory \a directory_name. Stores them in the
  * cache, sorted in case-insensitive order of name.
  *
+ * @param state          Emulator state
  * @param directory_name Full path to host directory to be read and cached
  */
 static void
-hostfs_cache_dir(const char *directory_name)
+hostfs_cache_dir(ARMul_State *state, const char *directory_name)
 {
-  static unsigned cache_entries_capacity = 128; /* Initial capacity of cache_entries[] */
-  static unsigned cache_names_capacity = 2048; /* Initial capacity of cache_names[] */
-
   unsigned entry_ptr = 0;
+  unsigned i;
   size_t name_ptr = 0;
 
 #ifdef __riscos__
@@ -1838,13 +1848,15 @@ hostfs_cache_dir(const char *directory_name)
   assert(directory_name);
 
   /* Allocate memory initially */
-  if (!cache_entries) {
-    cache_entries = malloc(cache_entries_capacity * sizeof(cache_directory_entry));
+  if (!HOSTFS.cache_entries) {
+    HOSTFS.cache_entries_capacity = 128; /* Initial capacity of cache_entries[] */
+    HOSTFS.cache_entries = malloc(HOSTFS.cache_entries_capacity * sizeof(cache_directory_entry));
   }
-  if (!cache_names) {
-    cache_names = malloc(cache_names_capacity);
+  if (!HOSTFS.cache_names) {
+    HOSTFS.cache_names_capacity = 2048; /* Initial capacity of cache_names[] */
+    HOSTFS.cache_names = malloc(HOSTFS.cache_names_capacity);
   }
-  if ((!cache_entries) || (!cache_names)) {
+  if ((!HOSTFS.cache_entries) || (!HOSTFS.cache_names)) {
     hostfs_error(true,"hostfs_cache_dir(): Out of memory");
   }
 
@@ -1869,37 +1881,37 @@ hostfs_cache_dir(const char *directory_name)
       size_t string_space;
 
       /* Copy over attributes */
-      cache_entries[entry_ptr].object_info.type = (gbpb_buffer.type == OBJECT_TYPE_IMAGEFILE?OBJECT_TYPE_FILE:gbpb_buffer.type);
-      cache_entries[entry_ptr].object_info.load = gbpb_buffer.load;
-      cache_entries[entry_ptr].object_info.exec = gbpb_buffer.exec;
-      cache_entries[entry_ptr].object_info.length = gbpb_buffer.length;
-      cache_entries[entry_ptr].object_info.attribs = gbpb_buffer.attribs;
+      HOSTFS.cache_entries[entry_ptr].object_info.type = (gbpb_buffer.type == OBJECT_TYPE_IMAGEFILE?OBJECT_TYPE_FILE:gbpb_buffer.type);
+      HOSTFS.cache_entries[entry_ptr].object_info.load = gbpb_buffer.load;
+      HOSTFS.cache_entries[entry_ptr].object_info.exec = gbpb_buffer.exec;
+      HOSTFS.cache_entries[entry_ptr].object_info.length = gbpb_buffer.length;
+      HOSTFS.cache_entries[entry_ptr].object_info.attribs = gbpb_buffer.attribs;
 
       /* Calculate space required to store name (+ terminator) */
       string_space = strlen(gbpb_buffer.name) + 1;
 
       /* Check whether cache_names[] is large enough; increase if required */
-      if (string_space > (cache_names_capacity - name_ptr)) {
-        cache_names_capacity *= 2;
-        cache_names = realloc(cache_names, cache_names_capacity);
-        if (!cache_names) {
+      if (string_space > (HOSTFS.cache_names_capacity - name_ptr)) {
+        HOSTFS.cache_names_capacity *= 2;
+        HOSTFS.cache_names = realloc(HOSTFS.cache_names, HOSTFS.cache_names_capacity);
+        if (!HOSTFS.cache_names) {
           hostfs_error(true,"hostfs_cache_dir(): Out of memory");
         }
       }
 
       /* Copy string into cache_names[]. Put offset ptr into local_entries[] */
-      strcpy(cache_names + name_ptr, gbpb_buffer.name);
-      cache_entries[entry_ptr].name_offset = name_ptr;
+      strcpy(HOSTFS.cache_names + name_ptr, gbpb_buffer.name);
+      HOSTFS.cache_entries[entry_ptr].name_offset = name_ptr;
 
       /* Advance name_ptr */
       name_ptr += string_space;
 
       /* Advance entry_ptr, increasing space of cache_entries[] if required */
       entry_ptr++;
-      if (entry_ptr == cache_entries_capacity) {
-        cache_entries_capacity *= 2;
-        cache_entries = realloc(cache_entries, cache_entries_capacity * sizeof(cache_directory_entry));
-        if (!cache_entries) {
+      if (entry_ptr == HOSTFS.cache_entries_capacity) {
+        HOSTFS.cache_entries_capacity *= 2;
+        HOSTFS.cache_entries = realloc(HOSTFS.cache_entries, HOSTFS.cache_entries_capacity * sizeof(cache_directory_entry));
+        if (!HOSTFS.cache_entries) {
           hostfs_error(true,"hostfs_cache_dir(): Out of memory");
         }
       }
@@ -1925,11 +1937,11 @@ hostfs_cache_dir(const char *directory_name)
     strcat(entry_path, entry->d_name);
 
     hostfs_read_object_info(entry_path, ro_leaf,
-                            &cache_entries[entry_ptr].object_info);
+                            &HOSTFS.cache_entries[entry_ptr].object_info);
 
     /* Ignore entries we can not read information about,
        or which are neither regular files or directories */
-    if (cache_entries[entry_ptr].object_info.type == OBJECT_TYPE_NOT_FOUND) {
+    if (HOSTFS.cache_entries[entry_ptr].object_info.type == OBJECT_TYPE_NOT_FOUND) {
       continue;
     }
 
@@ -1937,27 +1949,27 @@ hostfs_cache_dir(const char *directory_name)
     string_space = strlen(ro_leaf) + 1;
 
     /* Check whether cache_names[] is large enough; increase if required */
-    if (string_space > (cache_names_capacity - name_ptr)) {
-      cache_names_capacity *= 2;
-      cache_names = realloc(cache_names, cache_names_capacity);
-      if (!cache_names) {
+    if (string_space > (HOSTFS.cache_names_capacity - name_ptr)) {
+      HOSTFS.cache_names_capacity *= 2;
+      HOSTFS.cache_names = realloc(HOSTFS.cache_names, HOSTFS.cache_names_capacity);
+      if (!HOSTFS.cache_names) {
         hostfs_error(true,"hostfs_cache_dir(): Out of memory");
       }
     }
 
     /* Copy string into cache_names[]. Put offset ptr into local_entries[] */
-    strcpy(cache_names + name_ptr, ro_leaf);
-    cache_entries[entry_ptr].name_offset = name_ptr;
+    strcpy(HOSTFS.cache_names + name_ptr, ro_leaf);
+    HOSTFS.cache_entries[entry_ptr].name_offset = name_ptr;
 
     /* Advance name_ptr */
     name_ptr += string_space;
 
     /* Advance entry_ptr, increasing space of cache_entries[] if required */
     entry_ptr++;
-    if (entry_ptr == cache_entries_capacity) {
-      cache_entries_capacity *= 2;
-      cache_entries = realloc(cache_entries, cache_entries_capacity * sizeof(cache_directory_entry));
-      if (!cache_entries) {
+    if (entry_ptr == HOSTFS.cache_entries_capacity) {
+      HOSTFS.cache_entries_capacity *= 2;
+      HOSTFS.cache_entries = realloc(HOSTFS.cache_entries, HOSTFS.cache_entries_capacity * sizeof(cache_directory_entry));
+      if (!HOSTFS.cache_entries) {
         hostfs_error(true,"hostfs_cache_dir(): Out of memory");
       }
     }
@@ -1967,12 +1979,16 @@ hostfs_cache_dir(const char *directory_name)
 
 #endif /* !__riscos__ */
 
-  /* Sort the directory entries, case-insensitive */
-  qsort(cache_entries, entry_ptr, sizeof(cache_directory_entry),
+  /* Sort the directory entries, case-insensitive. cache_names[] has stopped
+     moving by now, so the comparator can use direct pointers into it */
+  for (i = 0; i < entry_ptr; i++) {
+    HOSTFS.cache_entries[i].name = HOSTFS.cache_names + HOSTFS.cache_entries[i].name_offset;
+  }
+  qsort(HOSTFS.cache_entries, entry_ptr, sizeof(cache_directory_entry),
         hostfs_directory_entry_compare);
 
   /* Store the number of directory entries found */
-  cache_entries_count = entry_ptr;
+  HOSTFS.cache_entries_count = entry_ptr;
 }
 
 /**
@@ -2018,7 +2034,7 @@ hostfs_read_dir(ARMul_State *state, bool with_info, bool with_timestamp)
 
   /* Determine if we should use the cached directory contents or should re-read */
   if (!STREQ(host_pathname, cached_directory) || (state->Reg[4] == 0)) {
-    hostfs_cache_dir(host_pathname);
+    hostfs_cache_dir(state, host_pathname);
   }
 
   {
@@ -2028,11 +2044,11 @@ hostfs_read_dir(ARMul_State *state, bool with_info, bool with_timestamp)
     ARMword offset = state->Reg[4]; /* Offset of item to read */
     ARMword ptr = state->Reg[2]; /* Pointer to return buffer */
 
-    while ((count < num_objects_to_read) && (offset < cache_entries_count)) {
+    while ((count < num_objects_to_read) && (offset < HOSTFS.cache_entries_count)) {
       unsigned string_space, entry_space;
 
       /* Calculate space required to return name and (optionally) info */
-      string_space = (unsigned) strlen(cache_names + cache_entries[offset].name_offset) + 1;
+      string_space = (unsigned) strlen(HOSTFS.cache_names + HOSTFS.cache_entries[offset].name_offset) + 1;
       if (with_info) {
         if (with_timestamp) {
           /* Space required for info with timestamp:
@@ -2054,21 +2070,21 @@ hostfs_read_dir(ARMul_State *state, bool with_info, bool with_timestamp)
 
       /* Fill in this entry */
       if (with_info) {
-        ARMul_StoreWordS(state, ptr + 0,  cache_entries[offset].object_info.load);
-        ARMul_StoreWordS(state, ptr + 4,  cache_entries[offset].object_info.exec);
-        ARMul_StoreWordS(state, ptr + 8,  cache_entries[offset].object_info.length);
-        ARMul_StoreWordS(state, ptr + 12, cache_entries[offset].object_info.attribs);
-        ARMul_StoreWordS(state, ptr + 16, cache_entries[offset].object_info.type);
+        ARMul_StoreWordS(state, ptr + 0,  HOSTFS.cache_entries[offset].object_info.load);
+        ARMul_StoreWordS(state, ptr + 4,  HOSTFS.cache_entries[offset].object_info.exec);
+        ARMul_StoreWordS(state, ptr + 8,  HOSTFS.cache_entries[offset].object_info.length);
+        ARMul_StoreWordS(state, ptr + 12, HOSTFS.cache_entries[offset].object_info.attribs);
+        ARMul_StoreWordS(state, ptr + 16, HOSTFS.cache_entries[offset].object_info.type);
 
         if (with_timestamp) {
           ARMul_StoreWordS(state, ptr + 20, 0); /* Always 0 */
           /* Test if Load and Exec contain timestamp */
-          if ((cache_entries[offset].object_info.load & UINT32_C(0xfff00000)) == UINT32_C(0xfff00000)) {
+          if ((HOSTFS.cache_entries[offset].object_info.load & UINT32_C(0xfff00000)) == UINT32_C(0xfff00000)) {
             ARMul_StoreWordS(state, ptr + 24,
-                             (cache_entries[offset].object_info.load << 24) |
-                             (cache_entries[offset].object_info.exec >> 8));
+                             (HOSTFS.cache_entries[offset].object_info.load << 24) |
+                             (HOSTFS.cache_entries[offset].object_info.exec >> 8));
             ARMul_StoreByte(state, ptr + 28,
-                            cache_entries[offset].object_info.exec & 0xff);
+                            HOSTFS.cache_entries[offset].object_info.exec & 0xff);
           } else {
             ARMul_StoreWordS(state, ptr + 24, 0);
             ARMul_StoreByte(state, ptr + 28, 0);
@@ -2078,7 +2094,7 @@ hostfs_read_dir(ARMul_State *state, bool with_info, bool with_timestamp)
           ptr += 20;
         }
       }
-      put_string(state, ptr, cache_names + cache_entries[offset].name_offset);
+      put_string(state, ptr, HOSTFS.cache_names + HOSTFS.cache_entries[offset].name_offset);
 
       ptr += string_space;
       if (with_info) {
@@ -2090,7 +2106,7 @@ hostfs_read_dir(ARMul_State *state, bool with_info, bool with_timestamp)
     }
 
     /* Find out whether we have now completed the directory */
-    if (offset >= cache_entries_count && count == 0) {
+    if (offset >= HOSTFS.cache_entries_count && count == 0) {
       /* We have completed the directory - return this fact */
       dbug_hostfs("HostFS completed directory\n");
       state->Reg[4] = (uint32_t) -1;
@@ -2343,24 +2359,31 @@ hostfs_register(ARMul_State *state)
     /* Successful registration - acknowledge by setting R0 to 0xffffffff */
     warn_hostfs("HostFS: Registration request version %"PRIu32" accepted\n", state->Reg[0]);
     state->Reg[0] = 0xffffffff;
-    hostfs_reset();
-    hostfs_state = HOSTFS_STATE_REGISTERED;
+    hostfs_reset(state);
+    HOSTFS.registration = HOSTFS_STATE_REGISTERED;
 
   } else {
     /* Failed registration due to an unsupported version */
     warn_hostfs("HostFS: Registration request version %"PRIu32" rejected\n", state->Reg[0]);
-    hostfs_state = HOSTFS_STATE_IGNORE;
+    HOSTFS.registration = HOSTFS_STATE_IGNORE;
   }
 }
 
 /**
  * Initialise HostFS module. Called on program startup.
+ *
+ * @param state Emulator state
+ * @return true on success
  */
-void
-hostfs_init(void)
+bool
+hostfs_init(ARMul_State *state)
 {
 #ifdef HOSTFS_ARCEM
-  /* Do nothing for ArcEm */
+  state->HostFS = calloc(1, sizeof(struct HostFSStruct));
+  if (!state->HostFS) {
+    hostfs_error(false,"Couldn't allocate HostFS state");
+    return false;
+  }
 #else
   int c;
 
@@ -2371,27 +2394,58 @@ hostfs_init(void)
     }
   }
 #endif
+  return true;
 }
 
 /**
  * Reset the HostFS state to initial values.
+ *
+ * @param state Emulator state
  */
 void
-hostfs_reset(void)
+hostfs_reset(ARMul_State *state)
 {
   unsigned i;
 
-  hostfs_state = HOSTFS_STATE_UNREGISTERED;
+  HOSTFS.registration = HOSTFS_STATE_UNREGISTERED;
 
   /* Close any open files */
   for (i = 1; i < (MAX_OPEN_FILES + 1); i++) {
-    if (open_file[i]) {
-      fclose(open_file[i]);
-      open_file[i] = NULL;
+    if (HOSTFS.open_file[i]) {
+      fclose(HOSTFS.open_file[i]);
+      HOSTFS.open_file[i] = NULL;
     }
   }
 }
 
+/**
+ * Release the HostFS state. Called on emulator shutdown.
+ *
+ * @param state Emulator state
+ */
+void
+hostfs_exit(ARMul_State *state)
+{
+#ifdef HOSTFS_ARCEM
+  if (!state->HostFS) {
+    return;
+  }
+#endif
+
+  hostfs_reset(state);
+
+  free(HOSTFS.buffer);
+  free(HOSTFS.cache_entries);
+  free(HOSTFS.cache_names);
+
+#ifdef HOSTFS_ARCEM
+  free(state->HostFS);
+  state->HostFS = NULL;
+#else
+  memset(&HOSTFS, 0, sizeof(HOSTFS));
+#endif
+}
+
 /**
  * Entry point when the HostFS SWI is issued. The ARM register R0 must contain
  * the HostFS operation.
@@ -2420,7 +2474,7 @@ hostfs(ARMul_State *state)
 #endif
 
   /* Other HostFS operations depend on the current registration state */
-  switch (hostfs_state) {
+  switch (HOSTFS.registration) {
   case HOSTFS_STATE_REGISTERED:
     switch (state->Reg[9]) {
     case 0: hostfs_open(state);     break;
@@ -2441,7 +2495,7 @@ hostfs(ARMul_State *state)
     /* Log attempt to use HostFS without registration and ignore further
        operations */
     warn_hostfs("HostFS: Attempt to use HostFS without registration - ignoring\n");
-    hostfs_state = HOSTFS_STATE_IGNORE;
+    HOSTFS.registration = HOSTFS_STATE_IGNORE;
     break;
 
   case HOSTFS_STATE_IGNORE:
@@ -16,8 +16,9 @@
 #define HOSTFS_ARCEM /* Build ArcEm version, not RPCEmu */
 
 extern void hostfs(ARMul_State *state);
-extern void hostfs_init(void);
-extern void hostfs_reset(void);
+extern bool hostfs_init(ARMul_State *state);
+extern void hostfs_reset(ARMul_State *state);
+extern void hostfs_exit(ARMul_State *state);
 
 #ifdef __amigaos4__
 #include <sys/_types.h>
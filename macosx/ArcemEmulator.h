@@ -50,6 +50,9 @@ struct ARMul_State;
 - (void)keyUp:(int)key;
 - (void)mouseMovedX:(int)xdiff
                   Y:(int)ydiff;
+- (void)insertFloppy:(int)drive
+                image:(const char *)image;
+- (void)ejectFloppy:(int)drive;
 
 - (void)threadStart:(id)anObject;  //!< Where the thread is launched
 
@@ -36,6 +36,7 @@
 #import "PreferenceController.h"
 #import "win.h"
 #include "../arch/keyboard.h"
+#include "../arch/fdc1772.h"
 
 #import <pthread.h>
 
@@ -202,4 +203,23 @@ void updateDisplay(int x, int y, int width, int height)
     KBD.MouseYCount = -ydiff & 127;
 }
 
+/*------------------------------------------------------------------------------
+ * insertFloppy
+ */
+- (void)insertFloppy:(int)drive
+                image:(const char *)image
+{
+    if (state)
+        FDC_InsertFloppy(state, drive, image);
+}
+
+/*------------------------------------------------------------------------------
+ * ejectFloppy
+ */
+- (void)ejectFloppy:(int)drive
+{
+    if (state)
+        FDC_EjectFloppy(state, drive);
+}
+
 @end
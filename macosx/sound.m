@@ -171,10 +171,11 @@ static void Sound_Resume(void)
   AudioQueueStart(queue, NULL);
 }
 
-SoundData *Sound_GetHostBuffer(int32_t *destavail)
+SoundData *Sound_GetHostBuffer(ARMul_State *state,int32_t *destavail)
 {
   /* Work out how much space is available until next wrap point, or we start overwriting data */
   int32_t local_buffer_in,used,ofs,buffree;
+  UNUSED_VAR(state);
   Sound_Lock();
   local_buffer_in = sound_buffer_in;
   used = local_buffer_in-sound_buffer_out;
@@ -233,9 +234,10 @@ static void adjust_fudgerate(int32_t used, int32_t out)
   Sound_FudgeRate = adjust;
 }
 
-void Sound_HostBuffered(SoundData *buffer,int32_t numSamples)
+void Sound_HostBuffered(ARMul_State *state,SoundData *buffer,int32_t numSamples)
 {
   int32_t local_buffer_in,used,out,underflows;
+  UNUSED_VAR(state);
   UNUSED_VAR(buffer);
   numSamples <<= 1;
   Sound_Lock();
@@ -0,0 +1,262 @@
+/*
+  prof.c
+
+  Part of Arcem released under the GNU GPL, see file COPYING
+  for details.
+
+  Portable C implementation of the prof.h profiling interface, for hosts
+  other than RISC OS (see riscos-single/prof.s for that one).
+
+  Each Prof_Begin/Prof_BeginFunc key gets a call count, inclusive time
+  (including any nested Begin/End pairs) and exclusive time (excluding
+  them). Time is measured with the TSC on x86 GCC/Clang builds, otherwise
+  with the monotonic clock. Prof_Dump writes the results as CSV, sorted by
+  exclusive time.
+
+  Functions are named via dladdr() where possible. Static functions usually
+  aren't in the dynamic symbol table, so they're reported as an offset
+  within the executable, suitable for passing to addr2line -f -e arcem.
+*/
+
+#ifdef PROFILE_ENABLED
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* For dladdr */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "c99.h"
+#include "prof.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <dlfcn.h>
+#define PROF_DLADDR
+#endif
+
+#if (defined(__i386__) || defined(__x86_64__)) && defined(__GNUC__)
+#include <x86intrin.h>
+#define PROF_UNITS "TSC ticks"
+static inline uint64_t Prof_Now(void)
+{
+  return __rdtsc();
+}
+#elif defined(CLOCK_MONOTONIC)
+#define PROF_UNITS "ns"
+static inline uint64_t Prof_Now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ((uint64_t) ts.tv_sec)*1000000000+ts.tv_nsec;
+}
+#else
+#define PROF_UNITS "clock() ticks"
+static inline uint64_t Prof_Now(void)
+{
+  return (uint64_t) clock();
+}
+#endif
+
+#define PROF_TABLE_SIZE 1024 /* Must be a power of two */
+#define PROF_MAX_DEPTH 64
+
+typedef struct {
+  const void *Key;     /* String or function pointer passed to Begin */
+  bool IsFunc;         /* Key is a function rather than a string */
+  uint32_t Active;     /* Recursion depth, so inclusive time isn't counted twice */
+  uint64_t Calls;
+  uint64_t Inclusive;
+  uint64_t Exclusive;
+} ProfEntry;
+
+typedef struct {
+  const void *Key;     /* Key passed to Begin */
+  ProfEntry *Entry;
+  uint64_t Start;      /* Time Begin was called */
+  uint64_t Children;   /* Time spent in nested entries */
+} ProfFrame;
+
+static ProfEntry prof_table[PROF_TABLE_SIZE];
+static ProfEntry prof_overflow; /* Used if the table fills up */
+static ProfFrame prof_stack[PROF_MAX_DEPTH];
+static int prof_depth;
+static int prof_lost; /* Begins which didn't fit on the stack */
+
+static ProfEntry *Prof_Lookup(const void *key,bool isfunc)
+{
+  uintptr_t hash = (uintptr_t) key;
+  unsigned idx, i;
+  hash ^= hash >> 12;
+  idx = ((unsigned) hash * 2654435761u) & (PROF_TABLE_SIZE-1);
+  for(i=0;i<PROF_TABLE_SIZE;i++)
+  {
+    ProfEntry *e = &prof_table[idx];
+    if(e->Key == key)
+      return e;
+    if(!e->Key)
+    {
+      e->Key = key;
+      e->IsFunc = isfunc;
+      return e;
+    }
+    idx = (idx+1) & (PROF_TABLE_SIZE-1);
+  }
+  return &prof_overflow;
+}
+
+static void Prof_Push(const void *key,bool isfunc)
+{
+  ProfFrame *f;
+  if(prof_depth == PROF_MAX_DEPTH)
+  {
+    prof_lost++;
+    return;
+  }
+  f = &prof_stack[prof_depth++];
+  f->Key = key;
+  f->Entry = Prof_Lookup(key,isfunc);
+  f->Entry->Active++;
+  f->Children = 0;
+  f->Start = Prof_Now();
+}
+
+static void Prof_Pop(const void *key)
+{
+  uint64_t now = Prof_Now();
+  int depth;
+
+  if(prof_lost)
+  {
+    prof_lost--;
+    return;
+  }
+  /* Find the matching Begin. Anything above it was never ended, so end it
+     now rather than letting the stack get out of step */
+  for(depth=prof_depth-1;depth>=0;depth--)
+    if(prof_stack[depth].Key == key)
+      break;
+  if(depth < 0)
+    return;
+  while(prof_depth > depth)
+  {
+    ProfFrame *f = &prof_stack[--prof_depth];
+    ProfEntry *e = f->Entry;
+    uint64_t elapsed = now-f->Start;
+    e->Calls++;
+    e->Exclusive += elapsed-f->Children;
+    if(!--e->Active)
+      e->Inclusive += elapsed;
+    if(prof_depth)
+      prof_stack[prof_depth-1].Children += elapsed;
+  }
+}
+
+void Prof_Init(void)
+{
+  memset(prof_table,0,sizeof(prof_table));
+  memset(&prof_overflow,0,sizeof(prof_overflow));
+  prof_overflow.Key = "(table full)";
+  prof_depth = 0;
+  prof_lost = 0;
+}
+
+void Prof_Reset(void)
+{
+  /* Clear the counters but keep any open entries open, so that the calling
+     code can carry on and End them as normal */
+  uint64_t now = Prof_Now();
+  int i;
+  for(i=0;i<PROF_TABLE_SIZE;i++)
+  {
+    prof_table[i].Calls = 0;
+    prof_table[i].Inclusive = 0;
+    prof_table[i].Exclusive = 0;
+  }
+  prof_overflow.Calls = prof_overflow.Inclusive = prof_overflow.Exclusive = 0;
+  for(i=0;i<prof_depth;i++)
+  {
+    prof_stack[i].Start = now;
+    prof_stack[i].Children = 0;
+  }
+}
+
+void Prof_BeginFunc(const void *func)
+{
+  Prof_Push(func,true);
+}
+
+void Prof_EndFunc(const void *func)
+{
+  Prof_Pop(func);
+}
+
+void Prof_Begin(const char *name)
+{
+  Prof_Push(name,false);
+}
+
+void Prof_End(const char *name)
+{
+  Prof_Pop(name);
+}
+
+static int Prof_Compare(const void *a,const void *b)
+{
+  const ProfEntry *ea = *(const ProfEntry * const *) a;
+  const ProfEntry *eb = *(const ProfEntry * const *) b;
+  if(ea->Exclusive != eb->Exclusive)
+    return (ea->Exclusive < eb->Exclusive ? 1 : -1);
+  return (ea->Calls < eb->Calls ? 1 : (ea->Calls > eb->Calls ? -1 : 0));
+}
+
+static void Prof_PrintName(FILE *f,const ProfEntry *e)
+{
+  if(e->IsFunc)
+  {
+#ifdef PROF_DLADDR
+    Dl_info info;
+    if(dladdr(e->Key,&info))
+    {
+      if(info.dli_sname && (info.dli_saddr == e->Key))
+        fprintf(f,"%s",info.dli_sname);
+      else
+        fprintf(f,"%s+0x%lx",info.dli_fname,(unsigned long) ((const char *) e->Key-(const char *) info.dli_fbase));
+      return;
+    }
+#endif
+    fprintf(f,"%p",e->Key);
+  }
+  else
+    fprintf(f,"\"%s\"",(const char *) e->Key);
+}
+
+void Prof_Dump(FILE *f)
+{
+  const ProfEntry *sorted[PROF_TABLE_SIZE+1];
+  size_t num = 0, i;
+  uint64_t total = 0;
+
+  for(i=0;i<PROF_TABLE_SIZE;i++)
+    if(prof_table[i].Calls)
+      sorted[num++] = &prof_table[i];
+  if(prof_overflow.Calls)
+    sorted[num++] = &prof_overflow;
+  qsort(sorted,num,sizeof(sorted[0]),Prof_Compare);
+
+  for(i=0;i<num;i++)
+    total += sorted[i]->Exclusive;
+
+  fprintf(f,"# Times are in " PROF_UNITS "\n");
+  fprintf(f,"name,calls,inclusive,exclusive,exclusive %%,exclusive per call\n");
+  for(i=0;i<num;i++)
+  {
+    const ProfEntry *e = sorted[i];
+    Prof_PrintName(f,e);
+    fprintf(f,",%"PRIu64",%"PRIu64",%"PRIu64",%.2f,%.1f\n",e->Calls,e->Inclusive,e->Exclusive,
+            (total ? (100.0*e->Exclusive)/total : 0.0),((double) e->Exclusive)/e->Calls);
+  }
+}
+
+#endif
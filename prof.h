@@ -7,7 +7,8 @@
   for details.
 
   Basic profiling interface; vanishes to nothingness if profiling is disabled.
-  See prof.s for the true horror show.
+  See riscos-single/prof.s for the true horror show, or prof.c for the
+  portable version.
 
 */
 
@@ -16,6 +17,8 @@
 
 #ifdef PROFILE_ENABLED
 
+#include <stdio.h>
+
 extern void Prof_Init(void);
 extern void Prof_Dump(FILE *f);
 extern void Prof_BeginFunc(const void *);
@@ -844,7 +844,7 @@ static void Host_PollDisplay_Common(ARMul_State *state,const DisplayParams *para
   if(enable_stats)
   {
     static clock_t oldtime;
-    static ARMword oldcycles;
+    static CycleCount oldcycles;
     static int fps;
     clock_t nowtime2 = clock();
 
@@ -1305,9 +1305,9 @@ static const char *const values_skip[] = {"0","1","2","3","4","5","6","7","8","9
 #define ITEMS \
   X('1',"Display driver",values_display,CONFIG.eDisplayDriver,true) \
   X('2',"Red/blue swap 16bpp output",values_bool,CONFIG.bRedBlueSwap,true) \
-  X('3',"Display auto UpdateFlags",values_bool,DisplayDev_AutoUpdateFlags,true) \
-  X('4',"Display uses UpdateFlags",values_bool,DisplayDev_UseUpdateFlags,true) \
-  X('5',"Display frameskip",values_skip,DisplayDev_FrameSkip,true) \
+  X('3',"Display auto UpdateFlags",values_bool,MEMC.AutoUpdateFlags,true) \
+  X('4',"Display uses UpdateFlags",values_bool,MEMC.UseUpdateFlags,true) \
+  X('5',"Display frameskip",values_skip,MEMC.FrameSkip,true) \
   X('6',"Aspect ratio correction",values_bool,CONFIG.bAspectRatioCorrection,true) \
   X('7',"2X upscaling",values_bool,CONFIG.bUpscale,true) \
   X('8',"Take screenshots on Print Screen",values_bool,enable_screenshots,true) \
@@ -1373,8 +1373,8 @@ static void GoMenu(ARMul_State *state)
       if(c == '3')
       {
         /* Make sure these are sane when changing AutoUpdateFlags */
-        DisplayDev_UseUpdateFlags = 1;
-        DisplayDev_FrameSkip = 0;
+        MEMC.UseUpdateFlags = 1;
+        MEMC.FrameSkip = 0;
       }
     }
   } while(1);
@@ -1385,10 +1385,10 @@ static void GoMenu(ARMul_State *state)
   {
     exit(EXIT_FAILURE);
   }
-  /* Ensure DisplayDev_UseUpdateFlags is on for SDD */
+  /* Ensure MEMC.UseUpdateFlags is on for SDD */
   if(CONFIG.eDisplayDriver == DisplayDriver_Standard)
-    DisplayDev_UseUpdateFlags = 1;
-  /* Rebuild fastmap for DisplayDev_UseUpdateFlags changes */
+    MEMC.UseUpdateFlags = 1;
+  /* Rebuild fastmap for MEMC.UseUpdateFlags changes */
   ARMul_RebuildFastMap(state);
   /* Gobble any keyboard input */
   while(_swi (ArcEmKey_GetKey, _RETURN(0))) {};
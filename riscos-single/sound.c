@@ -46,6 +46,8 @@ extern void error_handler(void); /* Assembler function attached to ErrorV */
 
 static void shutdown_sharedsound(void);
 
+static ARMul_State *dump_state; /* Machine to dump from sigfunc */
+
 #ifdef __TARGET_UNIXLIB__
 extern void __write_backtrace(int signo);
 static void sigfunc(int sig)
@@ -53,7 +55,7 @@ static void sigfunc(int sig)
 	shutdown_sharedsound();
 #if 0
 	/* Dump some emulator state */
-	ARMul_State *state = &statestr;
+	ARMul_State *state = dump_state;
 	dbug_sound("r0 = %08x  r4 = %08x  r8  = %08x  r12 = %08x\n"
 	           "r1 = %08x  r5 = %08x  r9  = %08x  sp  = %08x\n"
 	           "r2 = %08x  r6 = %08x  r10 = %08x  lr  = %08x\n"
@@ -65,7 +67,7 @@ static void sigfunc(int sig)
 	  state->Reg[3], state->Reg[7], state->Reg[11], state->Reg[15]);
 	int i;
 	for(i=0;i<4;i++)
-	  dbug_sound("Timer%d Count %08x Latch %08x\n",i,ioc.TimerCount[i],ioc.TimerInputLatch[i]);
+	  dbug_sound("Timer%d Count %08x Latch %08x\n",i,IOC.TimerCount[i],IOC.TimerInputLatch[i]);
 	FILE *f = fopen("$.dump","wb");
 	if(f)
 	{
@@ -181,7 +183,7 @@ static void shutdown_sharedsound(void)
 
 bool Sound_InitHost(ARMul_State *state)
 {
-  UNUSED_VAR(state);
+  dump_state = state;
 
   /* We want the right channel first */
   eSound_StereoSense = Stereo_RightLeft;
@@ -208,9 +210,10 @@ void Sound_ShutdownHost(ARMul_State *state)
   shutdown_sharedsound();
 }
 
-SoundData *Sound_GetHostBuffer(int32_t *destavail)
+SoundData *Sound_GetHostBuffer(ARMul_State *state,int32_t *destavail)
 {
   int used, ofs, buffree;
+  UNUSED_VAR(state);
   /* Work out how much space is available until next wrap point, or we start overwriting data */
   if(!sound_handler_id)
   {
@@ -224,10 +227,11 @@ SoundData *Sound_GetHostBuffer(int32_t *destavail)
   return sound_buffer + ofs;
 }
 
-void Sound_HostBuffered(SoundData *buffer,int32_t numSamples)
+void Sound_HostBuffered(ARMul_State *state,SoundData *buffer,int32_t numSamples)
 {
   int used, buffree;
 
+  UNUSED_VAR(state);
   UNUSED_VAR(buffer);
 
   if(!sound_handler_id)
@@ -0,0 +1,191 @@
+@ ArcEm CPU benchmark ROM
+@
+@ A minimal ROM image which runs a fixed mix of ALU, load/store, LDM/STM and
+@ branch instructions, then powers off the emulator via ArcEm_Shutdown. No
+@ RISC OS is involved, so the run time only depends on the CPU emulation.
+@
+@ Each pass of the outer loop executes 906 instructions:
+@   mov + 32 * (ldmia, stmia, subs, bne)          = 129
+@   mov + 64 * (12 instruction ALU/memory body)    = 769
+@   bl + 3 instruction subroutine                  =   4
+@   pointer resets, subs, bne                      =   4
+@ The setup before the loop and the checksum after it add another 48253.
+@ run.sh relies on these counts to work out the MIPS figure, so keep them
+@ up to date if the code changes.
+@
+@ The checksum covers the registers and the memory the loop leaves behind,
+@ and the results and flags of every data processing instruction (with each
+@ kind of operand) applied to pairs of awkward values. The exit status is 0
+@ if it matches the value stored in the ROM, or else the top byte of the
+@ checksum with bit 0 set, so an emulation bug makes the run fail. The
+@ checking loop runs enough times for the block cache and the native engine
+@ to translate it. The checksum is left in r11, for when it needs updating.
+@
+@ Usage: arcem --rom bench.rom (see run.sh)
+
+	ROM_BASE = 0x3800000
+	RAM_BASE = 0x2000000		@ Physically mapped RAM, SVC mode only
+	ITERATIONS = 200000
+	OPERANDS = 8			@ Number of values in the operands table
+
+	ARCEM_SWI_BASE = 0x56ac0
+	ArcEm_Shutdown = ARCEM_SWI_BASE + 0
+
+	@ Apply a data processing instruction, then fold its result (for those
+	@ which write r2) and the flags into the checksum in r11
+	.macro	check_op op, operands:vararg
+	\op	\operands
+	add	r11, r2, r11, ror #5
+	mov	r3, pc
+	and	r3, r3, #0xf0000000
+	eor	r11, r11, r3
+	.endm
+
+	@ Apply an instruction to r1 shifted every way, and to two immediates
+	@ (one with the top bit set, for the carry out of logical ops)
+	.macro	check_forms op, regs
+	check_op \op, \regs r1
+	check_op \op, \regs r1, lsl #3
+	check_op \op, \regs r1, lsr #32
+	check_op \op, \regs r1, asr #7
+	check_op \op, \regs r1, asr #32
+	check_op \op, \regs r1, ror #13
+	check_op \op, \regs r1, rrx
+	check_op \op, \regs #0xff000000
+	check_op \op, \regs #0x3fc
+	.endm
+
+	.global _start
+
+_start:
+
+	.org	0
+
+	@ After reset the ROM also appears at 0. Jump to the real copy
+	ldr	pc, rom_start
+
+rom_start:
+	.int	ROM_BASE + start
+
+start:
+	mov	r8, #RAM_BASE		@ Copy source
+	add	r9, r8, #0x8000		@ Copy destination
+	add	sp, r8, #0x10000
+	ldr	r4, iterations
+
+outer:
+	mov	r10, #32
+copy:
+	ldmia	r8!, {r0-r3, r5-r7}
+	stmia	r9!, {r0-r3, r5-r7}
+	subs	r10, r10, #1
+	bne	copy
+
+	mov	r10, #64
+alu:
+	add	r0, r0, r10, lsl #2
+	eor	r1, r1, r0, ror #7
+	subs	r2, r1, r0
+	addmi	r3, r3, #1
+	ldr	r5, [r8, #-4]
+	str	r5, [r9, #-8]
+	ldrb	r6, [r9, #-12]
+	add	r7, r7, r6
+	cmp	r7, #1000
+	subhi	r7, r7, #1000
+	subs	r10, r10, #1
+	bne	alu
+
+	bl	subroutine
+	sub	r8, r8, #32*7*4
+	sub	r9, r9, #32*7*4
+	subs	r4, r4, #1
+	bne	outer
+
+	@ Checksum the registers and the copied data
+	mov	r11, #0
+	add	r11, r0, r11, ror #5
+	add	r11, r1, r11, ror #5
+	add	r11, r2, r11, ror #5
+	add	r11, r3, r11, ror #5
+	add	r11, r5, r11, ror #5
+	add	r11, r6, r11, ror #5
+	add	r11, r7, r11, ror #5
+	mov	r10, #32*7
+sum:
+	ldr	r0, [r9], #4
+	add	r11, r0, r11, ror #5
+	subs	r10, r10, #1
+	bne	sum
+
+	@ Check the data processing instructions with every pair of operands
+	ldr	r8, operands_addr
+	mov	r9, #0
+check_lhs:
+	ldr	r0, [r8, r9, lsl #2]
+	mov	r10, #0
+check_rhs:
+	ldr	r1, [r8, r10, lsl #2]
+	check_forms ands, "r2, r0,"
+	check_forms eors, "r2, r0,"
+	check_forms subs, "r2, r0,"
+	check_forms rsbs, "r2, r0,"
+	check_forms adds, "r2, r0,"
+	check_forms adcs, "r2, r0,"
+	check_forms sbcs, "r2, r0,"
+	check_forms rscs, "r2, r0,"
+	check_forms orrs, "r2, r0,"
+	check_forms bics, "r2, r0,"
+	check_forms movs, "r2,"
+	check_forms mvns, "r2,"
+	check_forms tst, "r0,"
+	check_forms teq, "r0,"
+	check_forms cmp, "r0,"
+	check_forms cmn, "r0,"
+	@ And the conditions, each adding a different bit if it passes
+	cmp	r0, r1
+	addeq	r11, r11, #1
+	addne	r11, r11, #2
+	addcs	r11, r11, #4
+	addcc	r11, r11, #8
+	addmi	r11, r11, #16
+	addpl	r11, r11, #32
+	addvs	r11, r11, #64
+	addvc	r11, r11, #128
+	addhi	r11, r11, #256
+	addls	r11, r11, #512
+	addge	r11, r11, #1024
+	addlt	r11, r11, #2048
+	addgt	r11, r11, #4096
+	addle	r11, r11, #8192
+	add	r10, r10, #1
+	cmp	r10, #OPERANDS
+	blt	check_rhs
+	add	r9, r9, #1
+	cmp	r9, #OPERANDS
+	blt	check_lhs
+
+	ldr	r1, checksum
+	subs	r0, r11, r1
+	movne	r0, r11, lsr #24
+	orrne	r0, r0, #1
+	swi	ArcEm_Shutdown
+hang:
+	b	hang
+
+subroutine:
+	stmdb	sp!, {r0-r2, lr}
+	add	r0, r0, #3
+	ldmia	sp!, {r0-r2, pc}
+
+iterations:
+	.int	ITERATIONS
+
+operands_addr:
+	.int	ROM_BASE + operands
+
+checksum:
+	.int	0x10560f1a
+
+operands:
+	.int	0, 1, 0x7fffffff, 0x80000000, 0xffffffff, 0x80000001, 0x12345678, 0xfedcba98
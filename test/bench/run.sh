@@ -0,0 +1,94 @@
+#!/bin/bash
+# Runs the CPU benchmark ROM (bench.rom, built from bench.s) a few times on
+# each CPU engine the arcem binary supports, checks that every run got the
+# right checksum, and reports the best user CPU time and the corresponding
+# emulated MIPS for each engine.
+#
+# Usage: run.sh <arcem binary> [runs] [extra arcem options]
+# e.g.   run.sh ./arcem 5 --processor ARM3
+#
+# ArcEm still opens its display, so without a $DISPLAY the run is wrapped in
+# xvfb-run if that's available. SDL builds use SDL's dummy drivers.
+#
+# Only user time is counted, so the time spent starting the display (and
+# the X server, which sits idle) barely affects the result, unlike the
+# wall-clock time.
+#
+# The ROM exits with a non-zero status if its checksum is wrong (see
+# bench.s), so a run which fails on one engine and not another points at a
+# bug in that engine. The script exits with status 1 if any run failed.
+
+if [ $# -lt 1 ]; then
+  echo "Usage: $0 <arcem binary> [runs] [extra arcem options]" >&2
+  exit 1
+fi
+
+ARCEM=$1
+RUNS=${2:-3}
+shift
+[ $# -gt 0 ] && shift
+
+BENCHDIR=$(cd "$(dirname "$0")" && pwd)
+ROM=$BENCHDIR/bench.rom
+
+# Keep in step with bench.s
+INSTRS_PER_ITERATION=906
+ITERATIONS=200000
+INSTRS_OUTSIDE_LOOP=48253
+INSTRS=$((INSTRS_PER_ITERATION*ITERATIONS+INSTRS_OUTSIDE_LOOP))
+
+WRAP=
+if [ -z "$DISPLAY" ] && command -v xvfb-run >/dev/null 2>&1; then
+  WRAP="xvfb-run -a"
+fi
+export SDL_VIDEODRIVER=${SDL_VIDEODRIVER:-dummy}
+export SDL_AUDIODRIVER=${SDL_AUDIODRIVER:-dummy}
+
+# The engines this binary was built with, going by its --help
+HELP=$("$ARCEM" --help 2>&1)
+ENGINES=
+case "$HELP" in
+  *--engine*)
+    for ENGINE in interp blocks native; do
+      case "$HELP" in *"'$ENGINE'"*) ENGINES="$ENGINES $ENGINE" ;; esac
+    done
+    ;;
+  *)
+    # Only the interpreter
+    ENGINES=default
+    ;;
+esac
+
+# User time of the run (and its children) in seconds, to the millisecond
+TIMEFORMAT=%3U
+export LC_NUMERIC=C
+
+FAILED=
+for ENGINE in $ENGINES; do
+  ENGINE_OPTS=
+  [ "$ENGINE" != default ] && ENGINE_OPTS="--engine $ENGINE"
+  BEST=
+  for i in $(seq "$RUNS"); do
+    USER=$( { time $WRAP "$ARCEM" --rom "$ROM" --processor ARM2 $ENGINE_OPTS "$@" >/dev/null 2>&1; } 2>&1 )
+    STATUS=$?
+    if [ $STATUS -ne 0 ]; then
+      echo "$ENGINE run $i: $ARCEM exited with status $STATUS, wrong checksum or failed to start" >&2
+      FAILED=1
+      continue
+    fi
+    MS=$((10#${USER/./}))
+    [ $MS -gt 0 ] || MS=1
+    echo "$ENGINE run $i: $MS ms user"
+    if [ -z "$BEST" ] || [ $MS -lt $BEST ]; then
+      BEST=$MS
+    fi
+  done
+  if [ -n "$BEST" ]; then
+    echo "$ENGINE best: $BEST ms user, $((INSTRS/1000/BEST)) MIPS ($INSTRS instructions)"
+  fi
+done
+
+if [ -n "$FAILED" ]; then
+  echo "Some runs failed" >&2
+  exit 1
+fi
@@ -171,6 +171,14 @@ SOURCE=..\arch\cp15.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\arch\fpa.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\arch\fpa.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\arch\DispKbd.h
 # End Source File
 # Begin Source File
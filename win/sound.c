@@ -45,20 +45,22 @@ static void CALLBACK sound_callback(HWAVEOUT hwo, UINT uMsg, DWORD_PTR dwInstanc
 	LeaveCriticalSection(&waveCriticalSection);
 }
 
-SoundData *Sound_GetHostBuffer(int32_t *destavail)
+SoundData *Sound_GetHostBuffer(ARMul_State *state,int32_t *destavail)
 {
+	UNUSED_VAR(state);
 	/* Just assume we always have enough space for the max batch size */
 	*destavail = sizeof(sound_buffer)/(sizeof(SoundData)*2);
 	return sound_buffer;
 }
 
-void Sound_HostBuffered(SoundData *buffer,int32_t numSamples)
+void Sound_HostBuffered(ARMul_State *state,SoundData *buffer,int32_t numSamples)
 {
 	LPSTR lpbuffer = (LPSTR)buffer;
 	DWORD_PTR size = numSamples * 2 * sizeof(SoundData);
 
 	WAVEHDR* current;
 	DWORD_PTR remain;
+	UNUSED_VAR(state);
 	current = &waveBlocks[waveCurrentBlock];
 	while(size > 0) {
 		/*